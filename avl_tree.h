@@ -4,6 +4,12 @@
 #include <cstddef>
 #include <memory>
 #include <optional>
+#include <utility>
+#include <vector>
+
+#include <avl_tree_packed.h>
+#include <avl_tree_serializer.h>
+#include <executor.h>
 
 template<typename T>
 struct avl_tree {
@@ -60,7 +66,6 @@ public:
     typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
 
 private:
-    static int cmp(std::optional<T> const&, std::optional<T> const&);
     static ptrdiff_t height(node_ptr) noexcept;
     static void fix_height(node_ptr) noexcept;
     static ptrdiff_t difference(node_ptr) noexcept;
@@ -72,10 +77,58 @@ private:
     static node_ptr maximum(node_ptr const&) noexcept;
     static node_ptr minimum(node_ptr const&) noexcept;
     static void remove_minimum(node_ptr&) noexcept;
+    static node_ptr join(node_ptr, node_ptr, node_ptr) noexcept;
+    static node_ptr join_right(node_ptr, node_ptr, node_ptr) noexcept;
+    static node_ptr join_left(node_ptr, node_ptr, node_ptr) noexcept;
+    static void split(node_ptr const&, T const&, node_ptr&, node_ptr&);
+
+    // A batch is applied in two passes over the same subtrees. plan_batch
+    // does every comparison and allocation and records where each node split
+    // the sorted keys; apply_batch then only relinks, so it cannot fail.
+    struct batch_step {
+        size_t less_end;
+        size_t greater_begin;
+    };
+    struct batch_plan {
+        std::vector<batch_step> steps;
+        std::vector<batch_plan> children;
+    };
+    struct batch_cursor {
+        batch_plan const* plan;
+        size_t step = 0;
+        size_t child = 0;
+    };
 
-    node_ptr copy_subtree(node_ptr const&, avl_tree_node*);
+    using parallel = avl_execution::parallel_policy const*;
+
+    // null when the work is to stay on the calling thread
+    static parallel as_parallel(avl_execution::sequenced_policy const&) noexcept;
+    static parallel as_parallel(avl_execution::parallel_policy const&) noexcept;
+    static bool split_subtree(ptrdiff_t, parallel) noexcept;
+
+    static node_ptr join(node_ptr, node_ptr) noexcept;
+    static node_ptr build(std::vector<node_ptr> const&, size_t, size_t) noexcept;
+    static bool split_batch(batch_step const&, size_t, size_t, parallel) noexcept;
+    static std::vector<size_t> sort_batch(T const*, T const*, std::vector<T const*>&);
+    static void plan_batch(node_ptr const&, std::vector<T const*> const&, size_t, size_t, batch_plan&,
+                           std::vector<node_ptr>*, std::vector<char>&, parallel);
+    static node_ptr apply_batch(node_ptr, size_t, size_t, batch_cursor&, std::vector<node_ptr> const*,
+                                parallel) noexcept;
+    std::vector<bool> update_batch(T const*, T const*, bool, parallel);
+
+    static node_ptr copy_subtree(node_ptr const&, avl_tree_node*, parallel);
+    static avl_tree_node const* range_top(avl_tree_node const*, T const*, T const*);
+    template<typename F>
+    static void for_each_subtree(avl_tree_node const*, T const*, T const*, F&, parallel);
+    template<typename R, typename Reduce, typename Map>
+    static std::optional<R> reduce_subtree(avl_tree_node const*, T const*, T const*, Reduce&, Map&, parallel);
+    template<typename RandomIt>
+    static node_ptr build_sorted(RandomIt, size_t, avl_tree_node*, parallel);
+    template<typename Policy>
+    void load_packed(Policy const&, std::istream&, uint64_t);
+    void rebalance_upwards(avl_tree_node*) noexcept;
+    void append_maximum(avl_tree_node*&, T const&);
 
-    iterator find(node_ptr const&, T const&) const;
     std::pair<iterator, bool> insert(node_ptr&, avl_tree_node*, T const&);
     void remove(node_ptr&, T const&);
 
@@ -83,16 +136,83 @@ private:
 public:
     avl_tree() noexcept;
     avl_tree(avl_tree const&);
+    template<typename Policy>
+    avl_tree(avl_tree const&, Policy const&);
+    avl_tree(avl_tree&&) noexcept;
     avl_tree& operator=(avl_tree const&);
+    avl_tree& operator=(avl_tree&&) noexcept;
     ~avl_tree();
 
     iterator find(T const&) const;
     iterator lower_bound(T const&) const;
     iterator upper_bound(T const&) const;
     std::pair<iterator, bool> insert(T const&);
+    // Inserts value right before hint if it belongs there, with two
+    // comparisons and amortized O(1) rebalancing, and falls back to
+    // insert(value) otherwise. Returns the element equal to value.
+    iterator insert(const_iterator hint, T const& value);
     iterator erase(const_iterator);
     bool empty() const noexcept;
     void clear() noexcept;
+    // Detaches all nodes in O(1) and hands them to reclaimer.retire, which
+    // takes a std::shared_ptr<void>; the tree can be used again at once.
+    template<typename Reclaimer>
+    void clear_async(Reclaimer&);
+
+    // split keeps the values less than the argument and returns the rest,
+    // join appends a tree whose values are all greater and leaves it empty.
+    avl_tree split(T const&);
+    void join(avl_tree&) noexcept;
+
+    // Apply a whole batch in one pass over the tree. The result holds, per
+    // key in input order, whether it was inserted or erased; repeated keys
+    // only count the first time. On exception the tree is left unchanged.
+    std::vector<bool> insert_batch(T const*, T const*);
+    std::vector<bool> erase_batch(T const*, T const*);
+    template<typename Policy>
+    std::vector<bool> insert_batch(Policy const&, T const*, T const*);
+    template<typename Policy>
+    std::vector<bool> erase_batch(Policy const&, T const*, T const*);
+
+    // Replaces the contents with a strictly increasing range in O(n).
+    template<typename InputIt>
+    void assign_sorted(InputIt, InputIt);
+    template<typename Policy, typename InputIt>
+    void assign_sorted(Policy const&, InputIt, InputIt);
+    // Replaces the contents with the union of several ascending ranges,
+    // e.g. avl_tree_snapshot_reader streams. The ranges are merged through
+    // a heap of their heads and each value is appended at the right end of
+    // the tree, so memory stays at the tree plus one entry per range. A
+    // value not greater than the last one taken is dropped as a duplicate.
+    template<typename InputIt>
+    void assign_merged(std::vector<std::pair<InputIt, InputIt>>);
+
+    // save writes a versioned snapshot through avl_tree_serializer<T>.
+    // load replaces the contents with one in O(n) without comparing values,
+    // so the snapshot has to come from save; on error the tree is unchanged.
+    void save(std::ostream&) const;
+    void load(std::istream&);
+    template<typename Policy>
+    void load(Policy const&, std::istream&);
+    // Integral keys only: writes the snapshot as bit-packed deltas, which
+    // load recognizes and, with par, decodes in parallel.
+    void save_packed(std::ostream&) const;
+
+    // The overloads without a policy, and the copy constructor, stay on the
+    // calling thread, so T need not be safe to copy from several threads.
+    // Pass avl_execution::par, which can be pointed at another executor or
+    // given a coarser grain, to spread the work over a pool.
+    //
+    // Scans [first, last). With par the range is split into subtrees that
+    // are processed concurrently: for_each then calls f from several
+    // threads in no particular order, while the reductions still combine
+    // partial results in order, so reduce only has to be associative.
+    template<typename Policy, typename F>
+    void for_each(Policy const&, const_iterator, const_iterator, F) const;
+    template<typename Policy, typename R, typename Reduce>
+    R reduce(Policy const&, const_iterator, const_iterator, R, Reduce) const;
+    template<typename Policy, typename R, typename Reduce, typename Map>
+    R transform_reduce(Policy const&, const_iterator, const_iterator, R, Reduce, Map) const;
 
     void swap(avl_tree&) noexcept;
 
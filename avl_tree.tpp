@@ -1,10 +1,14 @@
 #include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <numeric>
+#include <type_traits>
 
 template<typename T>
 avl_tree<T>::avl_tree_node::avl_tree_node() noexcept { }
 
 template<typename T>
-avl_tree<T>::avl_tree_node::avl_tree_node(T const& value, avl_tree_node* parent) : value(value), parent(parent) { }
+avl_tree<T>::avl_tree_node::avl_tree_node(T const& value, avl_tree_node* parent) : value(value), height(1), parent(parent) { }
 
 template<typename T>
 ptrdiff_t avl_tree<T>::height(node_ptr node) noexcept
@@ -78,7 +82,7 @@ void avl_tree<T>::balance(node_ptr& node) noexcept
     fix_height(node);
     auto diff = difference(node);
     if (diff > 1) {
-        if (difference(node->left) > 0) {
+        if (difference(node->left) >= 0) {
             node = ll_rotation(node);
         }
         else {
@@ -140,7 +144,8 @@ typename avl_tree<T>::template const_noconst_iterator<is_const_iterator>& avl_tr
         }
     } else {
         avl_tree_node const* node = ptr->parent;
-        while (node && cmp(node->value, ptr->value) < 0) {
+        // climb while coming from the right, by pointer rather than by value
+        while (node && node->right.get() == ptr) {
             ptr = node;
             node = ptr->parent;
         }
@@ -161,7 +166,7 @@ typename avl_tree<T>::template const_noconst_iterator<is_const_iterator>& avl_tr
     }
     else {
         avl_tree_node const* node = ptr->parent;
-        while (node && cmp(node->value, ptr->value) > 0) {
+        while (node && node->left.get() == ptr) {
             ptr = node;
             node = ptr->parent;
         }
@@ -210,22 +215,25 @@ typename avl_tree<T>::template const_noconst_iterator<is_const_iterator>& avl_tr
     return *this;
 }
 
+// Descends like lower_bound, one comparison per level, and compares the
+// candidate once more at the end instead of testing for equality on the way.
 template<typename T>
-typename avl_tree<T>::iterator avl_tree<T>::find(node_ptr const& node, T const& value) const
+typename avl_tree<T>::iterator avl_tree<T>::find(T const& value) const
 {
-    if (node == nullptr) {
-        return iterator(&fake_end_node);
+    avl_tree_node const* candidate = nullptr;
+    for (avl_tree_node const* node = root.get(); node != nullptr;) {
+        if (*node->value < value) {
+            node = node->right.get();
+        }
+        else {
+            candidate = node;
+            node = node->left.get();
+        }
     }
-    if (node->value == value) {
-        return iterator(node.get());
+    if (candidate == nullptr || value < *candidate->value) {
+        return iterator(&fake_end_node);
     }
-    return value < node->value ? find(node->left, value) : find(node->right, value);
-}
-
-template<typename T>
-typename avl_tree<T>::iterator avl_tree<T>::find(T const& value) const
-{
-    return find(root, value);
+    return iterator(candidate);
 }
 
 template<typename T>
@@ -239,6 +247,16 @@ void avl_tree<T>::clear() noexcept {
     min = nullptr;
 }
 
+template<typename T>
+template<typename Reclaimer>
+void avl_tree<T>::clear_async(Reclaimer& reclaimer)
+{
+    node_ptr detached = std::move(root);
+    root = nullptr;
+    min = nullptr;
+    reclaimer.retire(std::move(detached));
+}
+
 template<typename T>
 std::pair<typename avl_tree<T>::iterator, bool> avl_tree<T>::insert(node_ptr& node, avl_tree_node* parent, T const& value)
 {
@@ -272,6 +290,35 @@ std::pair<typename avl_tree<T>::iterator, bool> avl_tree<T>::insert(T const& val
     return insert(root, &fake_end_node, value);
 }
 
+// value goes between the predecessor of hint and hint. If hint has no left
+// child it becomes that, otherwise the predecessor is the rightmost node
+// of that subtree and has no right child.
+template<typename T>
+typename avl_tree<T>::iterator avl_tree<T>::insert(const_iterator hint, T const& value)
+{
+    auto next = const_cast<avl_tree_node*>(hint.ptr);
+    if (root == nullptr || (next != &fake_end_node && !(value < *next->value))) {
+        if (root != nullptr && !(*next->value < value)) {
+            return iterator(next);
+        }
+        return insert(value).first;
+    }
+    avl_tree_node* prev = nullptr;
+    if (next != min) {
+        prev = const_cast<avl_tree_node*>((--hint).ptr);
+        if (!(*prev->value < value)) {
+            return value < *prev->value ? insert(value).first : iterator(prev);
+        }
+    }
+    node_ptr node(new avl_tree_node(value, next->left ? prev : next));
+    (next->left ? prev->right : next->left) = node;
+    if (prev == nullptr) {
+        min = node.get();
+    }
+    rebalance_upwards(node.get());
+    return iterator(node.get());
+}
+
 template<typename T>
 typename avl_tree<T>::node_ptr avl_tree<T>::minimum(avl_tree::node_ptr const& node) noexcept
 {
@@ -380,6 +427,345 @@ typename avl_tree<T>::iterator avl_tree<T>::upper_bound(T const& value) const {
     return iterator(successor);
 }
 
+// Links left and right under the detached node middle. Every value in left
+// must be less than middle's, every value in right greater.
+template<typename T>
+typename avl_tree<T>::node_ptr avl_tree<T>::join(node_ptr left, node_ptr middle, node_ptr right) noexcept
+{
+    if (height(left) > height(right) + 1) {
+        return join_right(left, middle, right);
+    }
+    if (height(right) > height(left) + 1) {
+        return join_left(left, middle, right);
+    }
+    middle->left = left;
+    middle->right = right;
+    if (left) {
+        left->parent = middle.get();
+    }
+    if (right) {
+        right->parent = middle.get();
+    }
+    fix_height(middle);
+    return middle;
+}
+
+template<typename T>
+typename avl_tree<T>::node_ptr avl_tree<T>::join_right(node_ptr left, node_ptr middle, node_ptr right) noexcept
+{
+    if (height(left) <= height(right) + 1) {
+        return join(left, middle, right);
+    }
+    left->right = join_right(left->right, middle, right);
+    left->right->parent = left.get();
+    balance(left);
+    return left;
+}
+
+template<typename T>
+typename avl_tree<T>::node_ptr avl_tree<T>::join_left(node_ptr left, node_ptr middle, node_ptr right) noexcept
+{
+    if (height(right) <= height(left) + 1) {
+        return join(left, middle, right);
+    }
+    right->left = join_left(left, middle, right->left);
+    right->left->parent = right.get();
+    balance(right);
+    return right;
+}
+
+// All comparisons happen on the way down, the tree is only taken apart on
+// the way back up, so a throwing comparison leaves it untouched.
+template<typename T>
+void avl_tree<T>::split(node_ptr const& node, T const& value, node_ptr& less, node_ptr& not_less)
+{
+    if (node == nullptr) {
+        less = nullptr;
+        not_less = nullptr;
+        return;
+    }
+    node_ptr middle = node;
+    if (middle->value < value) {
+        node_ptr right_less;
+        split(middle->right, value, right_less, not_less);
+        node_ptr left = middle->left;
+        middle->left = nullptr;
+        middle->right = nullptr;
+        less = join(left, middle, right_less);
+    }
+    else {
+        node_ptr left_not_less;
+        split(middle->left, value, less, left_not_less);
+        node_ptr right = middle->right;
+        middle->left = nullptr;
+        middle->right = nullptr;
+        not_less = join(left_not_less, middle, right);
+    }
+}
+
+template<typename T>
+avl_tree<T> avl_tree<T>::split(T const& value) {
+    avl_tree greater;
+    node_ptr less;
+    node_ptr not_less;
+    split(root, value, less, not_less);
+    root = less;
+    if (root) {
+        root->parent = &fake_end_node;
+    }
+    min = root ? minimum(root).get() : nullptr;
+    greater.root = not_less;
+    if (greater.root) {
+        greater.root->parent = &greater.fake_end_node;
+    }
+    greater.min = greater.root ? minimum(greater.root).get() : nullptr;
+    return greater;
+}
+
+template<typename T>
+void avl_tree<T>::join(avl_tree& greater) noexcept {
+    if (greater.root == nullptr) {
+        return;
+    }
+    if (root == nullptr) {
+        swap(greater);
+        return;
+    }
+    node_ptr middle = minimum(greater.root);
+    remove_minimum(greater.root);
+    middle->right = nullptr;
+    root = join(root, middle, greater.root);
+    root->parent = &fake_end_node;
+    greater.root = nullptr;
+    greater.min = nullptr;
+}
+
+// Joins two trees without a middle node by borrowing the minimum of right.
+template<typename T>
+typename avl_tree<T>::node_ptr avl_tree<T>::join(node_ptr left, node_ptr right) noexcept
+{
+    if (left == nullptr) {
+        return right;
+    }
+    if (right == nullptr) {
+        return left;
+    }
+    node_ptr middle = minimum(right);
+    remove_minimum(right);
+    middle->right = nullptr;
+    return join(left, middle, right);
+}
+
+template<typename T>
+typename avl_tree<T>::node_ptr avl_tree<T>::build(std::vector<node_ptr> const& nodes, size_t lo, size_t hi) noexcept
+{
+    if (lo == hi) {
+        return nullptr;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    node_ptr node = nodes[mid];
+    node->left = build(nodes, lo, mid);
+    node->right = build(nodes, mid + 1, hi);
+    if (node->left) {
+        node->left->parent = node.get();
+    }
+    if (node->right) {
+        node->right->parent = node.get();
+    }
+    fix_height(node);
+    return node;
+}
+
+template<typename T>
+avl_execution::parallel_policy const* avl_tree<T>::as_parallel(avl_execution::sequenced_policy const&) noexcept
+{
+    return nullptr;
+}
+
+template<typename T>
+avl_execution::parallel_policy const* avl_tree<T>::as_parallel(avl_execution::parallel_policy const& policy) noexcept
+{
+    return &policy;
+}
+
+// A subtree of height h holds at least 2^(h/2) and at most 2^h - 1 values;
+// halfway between is close enough to weigh it against the grain.
+template<typename T>
+bool avl_tree<T>::split_subtree(ptrdiff_t height, avl_execution::parallel_policy const* policy) noexcept
+{
+    return policy && (height >= 64 || (size_t(1) << (height - 1)) >= policy->grain);
+}
+
+// Both passes must agree on where the work was handed to another task.
+template<typename T>
+bool avl_tree<T>::split_batch(batch_step const& step, size_t lo, size_t hi,
+                              avl_execution::parallel_policy const* policy) noexcept
+{
+    return policy && step.less_end - lo >= policy->grain / 2 && hi - step.greater_begin >= policy->grain / 2;
+}
+
+// Leaves one pointer per distinct value in keys, sorted, and returns the
+// input index each of them came from.
+template<typename T>
+std::vector<size_t> avl_tree<T>::sort_batch(T const* first, T const* last, std::vector<T const*>& keys)
+{
+    std::vector<size_t> order(last - first);
+    std::iota(order.begin(), order.end(), size_t(0));
+    std::sort(order.begin(), order.end(), [first](size_t a, size_t b)
+    {
+        return first[a] < first[b] || (!(first[b] < first[a]) && a < b);
+    });
+    std::vector<size_t> origins;
+    for (size_t index : order) {
+        if (keys.empty() || *keys.back() < first[index]) {
+            keys.push_back(first + index);
+            origins.push_back(index);
+        }
+    }
+    return origins;
+}
+
+template<typename T>
+void avl_tree<T>::plan_batch(node_ptr const& node, std::vector<T const*> const& keys, size_t lo, size_t hi,
+                             batch_plan& plan, std::vector<node_ptr>* created, std::vector<char>& found,
+                             avl_execution::parallel_policy const* policy)
+{
+    if (lo == hi) {
+        return;
+    }
+    if (node == nullptr) {
+        if (created) {
+            for (size_t i = lo; i != hi; ++i) {
+                (*created)[i] = node_ptr(new avl_tree_node(*keys[i], nullptr));
+            }
+        }
+        return;
+    }
+    T const& value = *node->value;
+    batch_step step{};
+    step.less_end = std::lower_bound(keys.begin() + lo, keys.begin() + hi, value, [](T const* key, T const& v)
+    {
+        return *key < v;
+    }) - keys.begin();
+    step.greater_begin = step.less_end;
+    if (step.greater_begin != hi && !(value < *keys[step.greater_begin])) {
+        found[step.greater_begin++] = true;
+    }
+    plan.steps.push_back(step);
+
+    if (!split_batch(step, lo, hi, policy)) {
+        plan_batch(node->left, keys, lo, step.less_end, plan, created, found, policy);
+        plan_batch(node->right, keys, step.greater_begin, hi, plan, created, found, policy);
+        return;
+    }
+    // the left half is planned into a separate child, so that the right
+    // half can keep appending to this plan meanwhile
+    plan.children.emplace_back();
+    batch_plan& left = plan.children.back();
+    batch_plan right;
+    task_group group(policy->get_executor());
+    group.run([&node, &keys, lo, step, &left, created, &found, policy]
+    {
+        plan_batch(node->left, keys, lo, step.less_end, left, created, found, policy);
+    });
+    plan_batch(node->right, keys, step.greater_begin, hi, right, created, found, policy);
+    group.wait();
+    plan.children.emplace_back(std::move(right));
+}
+
+template<typename T>
+typename avl_tree<T>::node_ptr avl_tree<T>::apply_batch(node_ptr node, size_t lo, size_t hi, batch_cursor& cursor,
+                                                         std::vector<node_ptr> const* created,
+                                                         avl_execution::parallel_policy const* policy) noexcept
+{
+    if (lo == hi) {
+        return node;
+    }
+    if (node == nullptr) {
+        return created ? build(*created, lo, hi) : nullptr;
+    }
+    batch_step step = cursor.plan->steps[cursor.step++];
+    node_ptr left = node->left;
+    node_ptr right = node->right;
+    node->left = nullptr;
+    node->right = nullptr;
+
+    if (!split_batch(step, lo, hi, policy)) {
+        left = apply_batch(left, lo, step.less_end, cursor, created, policy);
+        right = apply_batch(right, step.greater_begin, hi, cursor, created, policy);
+    }
+    else {
+        batch_cursor left_cursor{&cursor.plan->children[cursor.child++]};
+        batch_cursor right_cursor{&cursor.plan->children[cursor.child++]};
+        auto apply_left = [&left, lo, step, &left_cursor, created, policy]
+        {
+            left = apply_batch(left, lo, step.less_end, left_cursor, created, policy);
+        };
+        task_group group(policy->get_executor());
+        try {
+            group.run(apply_left);
+        }
+        catch (...) {
+            apply_left();
+        }
+        right = apply_batch(right, step.greater_begin, hi, right_cursor, created, policy);
+    }
+    if (!created && step.greater_begin != step.less_end) {
+        return join(left, right);
+    }
+    return join(left, node, right);
+}
+
+template<typename T>
+std::vector<bool> avl_tree<T>::update_batch(T const* first, T const* last, bool inserting,
+                                            avl_execution::parallel_policy const* policy)
+{
+    std::vector<T const*> keys;
+    std::vector<size_t> origins = sort_batch(first, last, keys);
+    std::vector<node_ptr> created(inserting ? keys.size() : 0);
+    std::vector<char> found(keys.size());
+    batch_plan plan;
+    plan_batch(root, keys, 0, keys.size(), plan, inserting ? &created : nullptr, found, policy);
+    std::vector<bool> result(last - first);
+    for (size_t i = 0; i != keys.size(); ++i) {
+        result[origins[i]] = inserting != static_cast<bool>(found[i]);
+    }
+
+    batch_cursor cursor{&plan};
+    root = apply_batch(root, 0, keys.size(), cursor, inserting ? &created : nullptr, policy);
+    if (root) {
+        root->parent = &fake_end_node;
+    }
+    min = root ? minimum(root).get() : nullptr;
+    return result;
+}
+
+template<typename T>
+std::vector<bool> avl_tree<T>::insert_batch(T const* first, T const* last)
+{
+    return insert_batch(avl_execution::seq, first, last);
+}
+
+template<typename T>
+std::vector<bool> avl_tree<T>::erase_batch(T const* first, T const* last)
+{
+    return erase_batch(avl_execution::seq, first, last);
+}
+
+template<typename T>
+template<typename Policy>
+std::vector<bool> avl_tree<T>::insert_batch(Policy const& policy, T const* first, T const* last)
+{
+    return update_batch(first, last, true, as_parallel(policy));
+}
+
+template<typename T>
+template<typename Policy>
+std::vector<bool> avl_tree<T>::erase_batch(Policy const& policy, T const* first, T const* last)
+{
+    return update_batch(first, last, false, as_parallel(policy));
+}
+
 template<typename T>
 void avl_tree<T>::swap(avl_tree& other) noexcept {
     root.swap(other.root);
@@ -393,23 +779,440 @@ void avl_tree<T>::swap(avl_tree& other) noexcept {
 }
 
 template<typename T>
-typename avl_tree<T>::node_ptr avl_tree<T>::copy_subtree(avl_tree<T>::node_ptr const& node, avl_tree_node* parent) {
+typename avl_tree<T>::node_ptr avl_tree<T>::copy_subtree(avl_tree<T>::node_ptr const& node, avl_tree_node* parent,
+                                                          avl_execution::parallel_policy const* policy) {
     if (node == nullptr) {
         return nullptr;
     }
     node_ptr ptr(new avl_tree_node(node->value.value(), parent));
     ptr->height = node->height;
-    ptr->left = copy_subtree(node->left, ptr.get());
-    ptr->right = copy_subtree(node->right, ptr.get());
+    if (!split_subtree(node->height, policy)) {
+        ptr->left = copy_subtree(node->left, ptr.get(), policy);
+        ptr->right = copy_subtree(node->right, ptr.get(), policy);
+        return ptr;
+    }
+    task_group group(policy->get_executor());
+    group.run([&node, &ptr, policy]
+    {
+        ptr->left = copy_subtree(node->left, ptr.get(), policy);
+    });
+    ptr->right = copy_subtree(node->right, ptr.get(), policy);
+    group.wait();
     return ptr;
 }
 
 template<typename T>
-avl_tree<T>::avl_tree(avl_tree const& other) {
-    root = copy_subtree(other.root, &fake_end_node);
+template<typename RandomIt>
+typename avl_tree<T>::node_ptr avl_tree<T>::build_sorted(RandomIt first, size_t count, avl_tree_node* parent,
+                                                         avl_execution::parallel_policy const* policy)
+{
+    if (count == 0) {
+        return nullptr;
+    }
+    size_t mid = count / 2;
+    node_ptr node(new avl_tree_node(first[mid], parent));
+    if (!policy || count < policy->grain) {
+        node->left = build_sorted(first, mid, node.get(), policy);
+        node->right = build_sorted(first + mid + 1, count - mid - 1, node.get(), policy);
+    }
+    else {
+        task_group group(policy->get_executor());
+        group.run([first, mid, &node, policy]
+        {
+            node->left = build_sorted(first, mid, node.get(), policy);
+        });
+        node->right = build_sorted(first + mid + 1, count - mid - 1, node.get(), policy);
+        group.wait();
+    }
+    fix_height(node);
+    return node;
+}
+
+// lower and upper bound the range while they are on the path to its ends;
+// below a node inside the range one side no longer needs its bound.
+template<typename T>
+typename avl_tree<T>::avl_tree_node const* avl_tree<T>::range_top(avl_tree_node const* node, T const* lower,
+                                                                  T const* upper)
+{
+    while (node) {
+        if (lower && *node->value < *lower) {
+            node = node->right.get();
+        }
+        else if (upper && !(*node->value < *upper)) {
+            node = node->left.get();
+        }
+        else {
+            break;
+        }
+    }
+    return node;
+}
+
+template<typename T>
+template<typename F>
+void avl_tree<T>::for_each_subtree(avl_tree_node const* node, T const* lower, T const* upper, F& f,
+                                   avl_execution::parallel_policy const* policy)
+{
+    node = range_top(node, lower, upper);
+    if (node == nullptr) {
+        return;
+    }
+    if (!split_subtree(node->height, policy)) {
+        for_each_subtree(node->left.get(), lower, nullptr, f, policy);
+        f(*node->value);
+        for_each_subtree(node->right.get(), nullptr, upper, f, policy);
+        return;
+    }
+    task_group group(policy->get_executor());
+    group.run([node, lower, &f, policy]
+    {
+        for_each_subtree(node->left.get(), lower, nullptr, f, policy);
+    });
+    f(*node->value);
+    for_each_subtree(node->right.get(), nullptr, upper, f, policy);
+    group.wait();
+}
+
+template<typename T>
+template<typename R, typename Reduce, typename Map>
+std::optional<R> avl_tree<T>::reduce_subtree(avl_tree_node const* node, T const* lower, T const* upper,
+                                             Reduce& reduce, Map& map, avl_execution::parallel_policy const* policy)
+{
+    node = range_top(node, lower, upper);
+    if (node == nullptr) {
+        return std::nullopt;
+    }
+    std::optional<R> left;
+    std::optional<R> right;
+    R result = [&]() -> R
+    {
+        if (!split_subtree(node->height, policy)) {
+            left = reduce_subtree<R>(node->left.get(), lower, nullptr, reduce, map, policy);
+            right = reduce_subtree<R>(node->right.get(), nullptr, upper, reduce, map, policy);
+            return map(*node->value);
+        }
+        task_group group(policy->get_executor());
+        group.run([node, lower, &reduce, &map, &left, policy]
+        {
+            left = reduce_subtree<R>(node->left.get(), lower, nullptr, reduce, map, policy);
+        });
+        right = reduce_subtree<R>(node->right.get(), nullptr, upper, reduce, map, policy);
+        R mapped = map(*node->value);
+        group.wait();
+        return mapped;
+    }();
+    if (left) {
+        result = reduce(std::move(*left), std::move(result));
+    }
+    if (right) {
+        result = reduce(std::move(result), std::move(*right));
+    }
+    return result;
+}
+
+template<typename T>
+template<typename Policy, typename F>
+void avl_tree<T>::for_each(Policy const& policy, const_iterator first, const_iterator last, F f) const
+{
+    if (as_parallel(policy) == nullptr) {
+        for (; first != last; ++first) {
+            f(*first);
+        }
+        return;
+    }
+    if (first == last) {
+        return;
+    }
+    for_each_subtree(root.get(), &*first, last == end() ? nullptr : &*last, f, as_parallel(policy));
+}
+
+template<typename T>
+template<typename Policy, typename R, typename Reduce>
+R avl_tree<T>::reduce(Policy const& policy, const_iterator first, const_iterator last, R init, Reduce reduce) const
+{
+    return transform_reduce(policy, first, last, std::move(init), reduce, [](T const& value) -> T const&
+    {
+        return value;
+    });
+}
+
+template<typename T>
+template<typename Policy, typename R, typename Reduce, typename Map>
+R avl_tree<T>::transform_reduce(Policy const& policy, const_iterator first, const_iterator last, R init,
+                                Reduce reduce, Map map) const
+{
+    if (as_parallel(policy) == nullptr) {
+        for (; first != last; ++first) {
+            init = reduce(std::move(init), map(*first));
+        }
+        return init;
+    }
+    if (first == last) {
+        return init;
+    }
+    std::optional<R> result = reduce_subtree<R>(root.get(), &*first, last == end() ? nullptr : &*last,
+                                                reduce, map, as_parallel(policy));
+    return result ? reduce(std::move(init), std::move(*result)) : init;
+}
+
+template<typename T>
+template<typename InputIt>
+void avl_tree<T>::assign_sorted(InputIt first, InputIt last)
+{
+    assign_sorted(avl_execution::seq, first, last);
+}
+
+template<typename T>
+template<typename Policy, typename InputIt>
+void avl_tree<T>::assign_sorted(Policy const& policy, InputIt first, InputIt last)
+{
+    avl_tree built;
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag,
+                                    typename std::iterator_traits<InputIt>::iterator_category>) {
+        built.root = build_sorted(first, static_cast<size_t>(last - first), &built.fake_end_node,
+                                  as_parallel(policy));
+    }
+    else {
+        std::vector<T> values(first, last);
+        built.root = build_sorted(values.begin(), values.size(), &built.fake_end_node, as_parallel(policy));
+    }
+    built.min = built.root ? minimum(built.root).get() : nullptr;
+    swap(built);
+}
+
+// Restores the balance above a node that was just linked in as a leaf,
+// stopping at the first subtree that keeps its height.
+template<typename T>
+void avl_tree<T>::rebalance_upwards(avl_tree_node* leaf) noexcept
+{
+    for (avl_tree_node* up = leaf->parent; up != &fake_end_node;) {
+        avl_tree_node* above = up->parent;
+        // fake_end_node holds the root on the left like any other child
+        node_ptr& owner = above->left.get() == up ? above->left : above->right;
+        ptrdiff_t before = up->height;
+        balance(owner);
+        if (owner->height == before) {
+            break;
+        }
+        up = above;
+    }
+}
+
+// Hangs value off last, the rightmost node. For ascending input the
+// rebalancing stops after O(1) steps amortized, so n appends build the
+// tree in O(n).
+template<typename T>
+void avl_tree<T>::append_maximum(avl_tree_node*& last, T const& value)
+{
+    node_ptr node(new avl_tree_node(value, last ? last : &fake_end_node));
+    (last ? last->right : root) = node;
+    last = node.get();
+    rebalance_upwards(last);
+}
+
+template<typename T>
+template<typename InputIt>
+void avl_tree<T>::assign_merged(std::vector<std::pair<InputIt, InputIt>> sources)
+{
+    auto later = [&sources](size_t a, size_t b)
+    {
+        return *sources[b].first < *sources[a].first;
+    };
+    std::vector<size_t> heads;
+    heads.reserve(sources.size());
+    for (size_t i = 0; i != sources.size(); ++i) {
+        if (sources[i].first != sources[i].second) {
+            heads.push_back(i);
+        }
+    }
+    std::make_heap(heads.begin(), heads.end(), later);
+
+    avl_tree built;
+    avl_tree_node* last = nullptr;
+    while (!heads.empty()) {
+        std::pop_heap(heads.begin(), heads.end(), later);
+        auto& source = sources[heads.back()];
+        if (last == nullptr || *last->value < *source.first) {
+            built.append_maximum(last, *source.first);
+            if (built.min == nullptr) {
+                built.min = last;
+            }
+        }
+        if (++source.first != source.second) {
+            std::push_heap(heads.begin(), heads.end(), later);
+        }
+        else {
+            heads.pop_back();
+        }
+    }
+    swap(built);
+}
+
+template<typename T>
+void avl_tree<T>::save(std::ostream& out) const
+{
+    avl_tree_snapshot_header header{};
+    std::copy(std::begin(header.expected_magic), std::end(header.expected_magic), header.magic);
+    header.version = avl_tree_snapshot_header::current_version;
+    header.count = static_cast<uint64_t>(std::distance(begin(), end()));
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    for (T const& value : *this) {
+        avl_tree_serializer<T>::write(out, value);
+    }
+    if (!out) {
+        throw avl_tree_snapshot_error("avl_tree: snapshot write failed");
+    }
+}
+
+template<typename T>
+void avl_tree<T>::load(std::istream& in)
+{
+    load(avl_execution::seq, in);
+}
+
+template<typename T>
+template<typename Policy>
+void avl_tree<T>::load(Policy const& policy, std::istream& in)
+{
+    avl_tree_snapshot_header header{};
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+        throw avl_tree_snapshot_error("avl_tree: not a snapshot");
+    }
+    bool packed = std::equal(std::begin(header.magic), std::end(header.magic), header.packed_magic);
+    if (!packed && !std::equal(std::begin(header.magic), std::end(header.magic), header.expected_magic)) {
+        throw avl_tree_snapshot_error("avl_tree: not a snapshot");
+    }
+    if (header.version != avl_tree_snapshot_header::current_version) {
+        throw avl_tree_snapshot_error("avl_tree: unsupported snapshot version");
+    }
+    if (packed) {
+        if constexpr (std::is_integral_v<T>) {
+            load_packed(policy, in, header.count);
+            return;
+        }
+        throw avl_tree_snapshot_error("avl_tree: packed snapshots hold integral keys");
+    }
+    std::vector<T> values;
+    // a damaged count must not turn into one huge allocation up front
+    values.reserve(static_cast<size_t>(std::min<uint64_t>(header.count, 1 << 16)));
+    for (uint64_t i = 0; i != header.count; ++i) {
+        values.push_back(avl_tree_serializer<T>::read(in));
+        if (!in) {
+            throw avl_tree_snapshot_error("avl_tree: snapshot is truncated");
+        }
+    }
+    assign_sorted(policy, values.begin(), values.end());
+}
+
+template<typename T>
+void avl_tree<T>::save_packed(std::ostream& out) const
+{
+    static_assert(std::is_integral_v<T> && !std::is_same_v<T, bool> && sizeof(T) <= sizeof(uint64_t),
+                  "packed snapshots hold integral keys");
+    std::vector<uint64_t> keys;
+    for (T const& value : *this) {
+        keys.push_back(avl_tree_packed::to_ordered(value));
+    }
+    std::vector<char> payload;
+    avl_tree_packed::encode(keys.data(), keys.size(), payload);
+
+    avl_tree_snapshot_header header{};
+    std::copy(std::begin(header.packed_magic), std::end(header.packed_magic), header.magic);
+    header.version = avl_tree_snapshot_header::current_version;
+    header.count = keys.size();
+    uint64_t payload_size = payload.size();
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const*>(&payload_size), sizeof(payload_size));
+    out.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+    if (!out) {
+        throw avl_tree_snapshot_error("avl_tree: snapshot write failed");
+    }
+}
+
+// The payload is read in one piece, its blocks are decoded by tasks of
+// about a grain of keys each and the result goes to the bulk build.
+template<typename T>
+template<typename Policy>
+void avl_tree<T>::load_packed(Policy const& policy, std::istream& in, uint64_t count)
+{
+    uint64_t payload_size = 0;
+    if (!in.read(reinterpret_cast<char*>(&payload_size), sizeof(payload_size))) {
+        throw avl_tree_snapshot_error("avl_tree: snapshot is truncated");
+    }
+    std::vector<char> data;
+    // grown as the bytes arrive rather than trusting the size up front
+    while (data.size() != payload_size) {
+        size_t at = data.size();
+        data.resize(at + static_cast<size_t>(std::min<uint64_t>(payload_size - at, 1 << 20)));
+        if (!in.read(data.data() + at, static_cast<std::streamsize>(data.size() - at))) {
+            throw avl_tree_snapshot_error("avl_tree: snapshot is truncated");
+        }
+    }
+    std::vector<size_t> offsets;
+    if (!avl_tree_packed::locate_blocks(data.data(), data.size(), static_cast<size_t>(count), offsets)) {
+        throw avl_tree_snapshot_error("avl_tree: snapshot is corrupt");
+    }
+    data.resize(data.size() + 16);
+
+    std::vector<T> values(static_cast<size_t>(count));
+    std::atomic<bool> ordered{true};
+    auto decode = [&data, &offsets, &values, &ordered](size_t first, size_t last)
+    {
+        uint64_t keys[avl_tree_packed::block_size];
+        for (size_t block = first; block != last; ++block) {
+            size_t begin = block * avl_tree_packed::block_size;
+            size_t size = std::min(values.size() - begin, avl_tree_packed::block_size);
+            avl_tree_packed::decode_block(data.data() + offsets[block], size, keys);
+            for (size_t i = 0; i != size; ++i) {
+                if ((i != 0 && keys[i] <= keys[i - 1]) || !avl_tree_packed::in_range<T>(keys[i])) {
+                    ordered.store(false, std::memory_order_relaxed);
+                }
+                values[begin + i] = avl_tree_packed::from_ordered<T>(keys[i]);
+            }
+        }
+    };
+    parallel tasks = as_parallel(policy);
+    size_t blocks_per_task = tasks ? std::max<size_t>(1, tasks->grain / avl_tree_packed::block_size) : 0;
+    if (!tasks || offsets.size() <= blocks_per_task) {
+        decode(0, offsets.size());
+    }
+    else {
+        task_group group(tasks->get_executor());
+        for (size_t first = 0; first < offsets.size(); first += blocks_per_task) {
+            group.run([&decode, first, last = std::min(offsets.size(), first + blocks_per_task)]
+            {
+                decode(first, last);
+            });
+        }
+        group.wait();
+    }
+    for (size_t block = 1; block < offsets.size(); ++block) {
+        size_t begin = block * avl_tree_packed::block_size;
+        if (avl_tree_packed::to_ordered(values[begin]) <= avl_tree_packed::to_ordered(values[begin - 1])) {
+            ordered = false;
+        }
+    }
+    if (!ordered) {
+        throw avl_tree_snapshot_error("avl_tree: snapshot is corrupt");
+    }
+    assign_sorted(policy, values.begin(), values.end());
+}
+
+template<typename T>
+avl_tree<T>::avl_tree(avl_tree const& other) : avl_tree(other, avl_execution::seq) { }
+
+template<typename T>
+template<typename Policy>
+avl_tree<T>::avl_tree(avl_tree const& other, Policy const& policy) {
+    root = copy_subtree(other.root, &fake_end_node, as_parallel(policy));
     min = root ? minimum(root).get() : nullptr;
 }
 
+template<typename T>
+avl_tree<T>::avl_tree(avl_tree&& other) noexcept {
+    swap(other);
+}
+
 template<typename T>
 avl_tree<T>& avl_tree<T>::operator=(avl_tree const& other)
 {
@@ -418,6 +1221,14 @@ avl_tree<T>& avl_tree<T>::operator=(avl_tree const& other)
     return *this;
 }
 
+template<typename T>
+avl_tree<T>& avl_tree<T>::operator=(avl_tree&& other) noexcept
+{
+    avl_tree moved(std::move(other));
+    swap(moved);
+    return *this;
+}
+
 template<typename T>
 typename avl_tree<T>::iterator avl_tree<T>::begin() noexcept {
     return min ? iterator(min) : end();
@@ -483,14 +1294,3 @@ void swap(avl_tree<T>& lhs, avl_tree<T>& rhs) noexcept
 {
     lhs.swap(rhs);
 }
-
-template<typename T>
-int avl_tree<T>::cmp(std::optional<T> const& lhs, std::optional<T> const& rhs) {
-    if (!lhs.has_value()) {
-        return 1;
-    }
-    if (!rhs.has_value()) {
-        return -1;
-    }
-    return lhs.value() > rhs.value() ? 1 : (lhs.value() < rhs.value() ? -1 : 0);
-}
\ No newline at end of file
@@ -0,0 +1,595 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "avl_tree.h"
+#ifdef AVL_TREE_BENCH_COUNTERS
+#include "counted.h"
+#include "fault_injection.h"
+#endif
+
+// Microbenchmarks of the avl_tree operations against std::set, for int,
+// a 64-byte POD and std::string keys at sizes from 1K up to --max_size
+// (at most 100M). Each case repeats the timed part until --min_time has
+// passed and reports the time per operation; setup and teardown between
+// repetitions are not timed. --json writes the results in the layout of
+// Google Benchmark's JSON output, so they can be tracked by the same tools.
+//
+// avl_tree_counting_bench, built from this file with
+// AVL_TREE_BENCH_COUNTERS, runs every case once instead and reports, per
+// operation, the comparisons, allocations and allocated bytes that the
+// hooks of counted and fault_injection see. Those hooks replace the global
+// operator new, which is why they are kept out of the timing build.
+// Comparisons are only seen for counted keys, which are added there; their
+// allocations include one per counted copy for its instance bookkeeping,
+// so read allocations off the other keys.
+//
+// On Linux both builds also count cycles, instructions, L1d, last-level
+// cache, branch and dTLB misses per operation with perf_event_open, in user
+// space only. Events the kernel cannot count, as in most VMs, are left
+// out; with none of them the results are wall-clock only.
+//
+// usage: avl_tree_bench [--filter=substring] [--max_size=N] [--min_time=seconds] [--json=path]
+
+namespace
+{
+struct pod64
+{
+    uint64_t key;
+    char payload[56];
+};
+
+bool operator<(pod64 const& a, pod64 const& b) { return a.key < b.key; }
+bool operator>(pod64 const& a, pod64 const& b) { return a.key > b.key; }
+bool operator>=(pod64 const& a, pod64 const& b) { return a.key >= b.key; }
+bool operator==(pod64 const& a, pod64 const& b) { return a.key == b.key; }
+
+// Keys compare like their ranks. Trees hold the even ranks, so odd ones miss.
+template <typename T>
+T make_key(uint64_t rank);
+
+template <>
+int make_key<int>(uint64_t rank)
+{
+    return static_cast<int>(rank);
+}
+
+template <>
+pod64 make_key<pod64>(uint64_t rank)
+{
+    pod64 key{rank, {}};
+    std::memset(key.payload, static_cast<int>(rank & 0x7F), sizeof(key.payload));
+    return key;
+}
+
+template <>
+std::string make_key<std::string>(uint64_t rank)
+{
+    // zero-padded so that the order is numeric, and too long for the
+    // small-string buffer, as most real string keys are
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "key-%020llu", static_cast<unsigned long long>(rank));
+    return buffer;
+}
+
+uint64_t digest(int value) { return static_cast<uint64_t>(value); }
+uint64_t digest(pod64 const& value) { return value.key; }
+uint64_t digest(std::string const& value) { return value.size(); }
+
+template <typename T>
+char const* key_name();
+template <> char const* key_name<int>() { return "int"; }
+template <> char const* key_name<pod64>() { return "pod64"; }
+template <> char const* key_name<std::string>() { return "string"; }
+
+template <typename C>
+char const* container_name();
+template <> char const* container_name<avl_tree<int>>() { return "avl_tree"; }
+template <> char const* container_name<avl_tree<pod64>>() { return "avl_tree"; }
+template <> char const* container_name<avl_tree<std::string>>() { return "avl_tree"; }
+template <> char const* container_name<std::set<int>>() { return "std::set"; }
+template <> char const* container_name<std::set<pod64>>() { return "std::set"; }
+template <> char const* container_name<std::set<std::string>>() { return "std::set"; }
+
+#ifdef AVL_TREE_BENCH_COUNTERS
+constexpr bool counting = true;
+
+template <>
+counted make_key<counted>(uint64_t rank)
+{
+    return counted(static_cast<int>(rank));
+}
+
+uint64_t digest(counted const& value) { return static_cast<uint64_t>(static_cast<int>(value)); }
+template <> char const* key_name<counted>() { return "counted"; }
+template <> char const* container_name<avl_tree<counted>>() { return "avl_tree"; }
+template <> char const* container_name<std::set<counted>>() { return "std::set"; }
+#else
+constexpr bool counting = false;
+#endif
+
+// Hardware events, counted by one counter each so that an event the PMU
+// lacks leaves the others, and scaled up when the kernel multiplexes them.
+constexpr size_t pmu_events = 6;
+char const* const pmu_names[pmu_events] = {"cycles", "instructions", "l1d_misses", "llc_misses",
+                                           "branch_misses", "dtlb_misses"};
+char const* const pmu_units[pmu_events] = {"cyc", "ins", "L1d", "LLC", "br", "dTLB"};
+
+struct pmu_reading
+{
+    uint64_t value = 0;
+    uint64_t enabled = 0;
+    uint64_t running = 0;
+};
+
+struct pmu
+{
+    // -1 for the events that did not open
+    int fds[pmu_events];
+    int error = 0;
+
+    pmu()
+    {
+        std::fill(std::begin(fds), std::end(fds), -1);
+#ifdef __linux__
+        auto cache_miss = [](uint64_t cache)
+        {
+            return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 | PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+        };
+        uint32_t const types[pmu_events] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+                                            PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE};
+        uint64_t const configs[pmu_events] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                              cache_miss(PERF_COUNT_HW_CACHE_L1D), PERF_COUNT_HW_CACHE_MISSES,
+                                              PERF_COUNT_HW_BRANCH_MISSES, cache_miss(PERF_COUNT_HW_CACHE_DTLB)};
+        for (size_t i = 0; i != pmu_events; ++i)
+        {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = types[i];
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            fds[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if (fds[i] == -1)
+                error = errno;
+        }
+#else
+        error = ENOSYS;
+#endif
+    }
+
+    pmu(pmu const&) = delete;
+    pmu& operator=(pmu const&) = delete;
+
+    ~pmu()
+    {
+#ifdef __linux__
+        for (int fd : fds)
+            if (fd != -1)
+                close(fd);
+#endif
+    }
+
+    bool available() const
+    {
+        return std::any_of(std::begin(fds), std::end(fds), [](int fd) { return fd != -1; });
+    }
+
+    void read(pmu_reading (&readings)[pmu_events]) const
+    {
+#ifdef __linux__
+        for (size_t i = 0; i != pmu_events; ++i)
+            if (fds[i] != -1 && ::read(fds[i], &readings[i], sizeof(pmu_reading)) != sizeof(pmu_reading))
+                readings[i] = pmu_reading();
+#else
+        (void)readings;
+#endif
+    }
+};
+
+// Single-threaded copies, so that both containers are measured alike.
+template <typename T>
+avl_tree<T> copy_of(avl_tree<T> const& c)
+{
+    return avl_tree<T>(c, avl_execution::seq);
+}
+
+template <typename T>
+std::set<T> copy_of(std::set<T> const& c)
+{
+    return c;
+}
+
+struct options
+{
+    std::string filter;
+    size_t max_size = 1000000;
+    double min_time = 0.2;
+    std::string json;
+    pmu const* hardware = nullptr;
+};
+
+struct result
+{
+    std::string name;
+    size_t iterations;
+    double real_ns;
+    double cpu_ns;
+    // std::set's time over this one, for the avl_tree results
+    double speedup = 0;
+    // per operation, when counting
+    double comparisons = 0;
+    double allocations = 0;
+    double allocated_bytes = 0;
+    // per operation, negative for the events that were not counted
+    double events[pmu_events];
+};
+
+// Accumulates the timed sections of a case, and what counter and hardware
+// saw in them when there are any.
+struct stopwatch
+{
+    std::chrono::steady_clock::time_point started;
+    std::clock_t cpu_started = 0;
+    double real_ns = 0;
+    double cpu_ns = 0;
+    size_t operations = 0;
+
+#ifdef AVL_TREE_BENCH_COUNTERS
+    operation_counter const* counter = nullptr;
+    size_t comparisons_at_start = 0;
+    size_t allocations_at_start = 0;
+    size_t allocated_bytes_at_start = 0;
+#endif
+    size_t comparisons = 0;
+    size_t allocations = 0;
+    size_t allocated_bytes = 0;
+
+    pmu const* hardware = nullptr;
+    pmu_reading events_at_start[pmu_events];
+    double events[pmu_events] = {};
+    // false once an event was never scheduled during a section
+    bool events_counted[pmu_events];
+
+    void start()
+    {
+        if (hardware)
+            hardware->read(events_at_start);
+#ifdef AVL_TREE_BENCH_COUNTERS
+        if (counter)
+        {
+            comparisons_at_start = counter->comparisons;
+            allocations_at_start = counter->allocations;
+            allocated_bytes_at_start = counter->allocated_bytes;
+        }
+#endif
+        cpu_started = std::clock();
+        started = std::chrono::steady_clock::now();
+    }
+
+    void stop(size_t count)
+    {
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - started;
+        real_ns += elapsed.count();
+        cpu_ns += 1e9 * static_cast<double>(std::clock() - cpu_started) / CLOCKS_PER_SEC;
+        operations += count;
+        if (hardware)
+        {
+            pmu_reading now[pmu_events];
+            hardware->read(now);
+            for (size_t i = 0; i != pmu_events; ++i)
+            {
+                uint64_t running = now[i].running - events_at_start[i].running;
+                if (running == 0)
+                {
+                    events_counted[i] = false;
+                    continue;
+                }
+                double enabled = static_cast<double>(now[i].enabled - events_at_start[i].enabled);
+                events[i] += static_cast<double>(now[i].value - events_at_start[i].value) * enabled /
+                             static_cast<double>(running);
+            }
+        }
+#ifdef AVL_TREE_BENCH_COUNTERS
+        if (counter)
+        {
+            comparisons += counter->comparisons - comparisons_at_start;
+            allocations += counter->allocations - allocations_at_start;
+            allocated_bytes += counter->allocated_bytes - allocated_bytes_at_start;
+        }
+#endif
+    }
+};
+
+// Keeps the compiler from dropping lookups whose results are unused.
+volatile uint64_t sink;
+
+template <typename T>
+struct key_set
+{
+    std::vector<T> ascending;
+    std::vector<T> shuffled;
+    // at most 1M lookups of keys that are there and keys that are not,
+    // cycled through by the lookup cases
+    std::vector<T> hits;
+    std::vector<T> misses;
+
+    explicit key_set(size_t size)
+    {
+        std::mt19937_64 rng(size);
+        ascending.reserve(size);
+        for (uint64_t i = 0; i != size; ++i)
+            ascending.push_back(make_key<T>(2 * i));
+        shuffled = ascending;
+        std::shuffle(shuffled.begin(), shuffled.end(), rng);
+        size_t lookups = std::min<size_t>(size, 1 << 20);
+        for (size_t i = 0; i != lookups; ++i)
+        {
+            uint64_t rank = rng() % size;
+            hits.push_back(make_key<T>(2 * rank));
+            misses.push_back(make_key<T>(2 * rank + 1));
+        }
+    }
+};
+
+struct suite
+{
+    options const& opts;
+    std::vector<result> results;
+
+    template <typename C, typename T, typename F>
+    void run(char const* operation, size_t size, F body)
+    {
+        std::string name = std::string(operation) + "/" + container_name<C>() + "/" + key_name<T>() + "/" +
+                           std::to_string(size);
+        if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+            return;
+        stopwatch watch;
+        watch.hardware = opts.hardware;
+        for (size_t i = 0; i != pmu_events; ++i)
+            watch.events_counted[i] = opts.hardware && opts.hardware->fds[i] != -1;
+#ifdef AVL_TREE_BENCH_COUNTERS
+        operation_counter counter;
+        watch.counter = &counter;
+        body(watch);
+        watch.counter = nullptr;
+#else
+        do
+            body(watch);
+        while (watch.real_ns < opts.min_time * 1e9);
+#endif
+        double ops = static_cast<double>(watch.operations);
+        results.push_back({name, watch.operations, watch.real_ns / ops, watch.cpu_ns / ops});
+        result& r = results.back();
+        if (counting)
+        {
+            r.comparisons = static_cast<double>(watch.comparisons) / ops;
+            r.allocations = static_cast<double>(watch.allocations) / ops;
+            r.allocated_bytes = static_cast<double>(watch.allocated_bytes) / ops;
+            std::printf("%-44s %10.2f cmp/op %8.2f allocs/op %10.1f bytes/op", name.c_str(), r.comparisons,
+                        r.allocations, r.allocated_bytes);
+        }
+        else
+            std::printf("%-44s %12.2f ns/op %14zu ops", name.c_str(), r.real_ns, watch.operations);
+        for (size_t i = 0; i != pmu_events; ++i)
+        {
+            r.events[i] = watch.events_counted[i] ? watch.events[i] / ops : -1;
+            if (r.events[i] >= 0)
+                std::printf(" %9.2f %s", r.events[i], pmu_units[i]);
+        }
+        std::printf("\n");
+        std::fflush(stdout);
+    }
+
+    template <typename C, typename T>
+    void run_all(size_t size, key_set<T> const& keys)
+    {
+        auto inserting = [&](char const* operation, std::vector<T> const& order)
+        {
+            run<C, T>(operation, size, [&order](stopwatch& watch)
+            {
+                C c;
+                watch.start();
+                for (T const& key : order)
+                    c.insert(key);
+                watch.stop(order.size());
+            });
+        };
+        inserting("insert_random", keys.shuffled);
+        inserting("insert_sorted", keys.ascending);
+        std::vector<T> descending(keys.ascending.rbegin(), keys.ascending.rend());
+        inserting("insert_reverse", descending);
+
+        C built;
+        for (T const& key : keys.shuffled)
+            built.insert(key);
+
+        auto looking_up = [&](char const* operation, std::vector<T> const& queries, auto lookup)
+        {
+            run<C, T>(operation, size, [&built, &queries, &lookup](stopwatch& watch)
+            {
+                uint64_t found = 0;
+                watch.start();
+                for (T const& key : queries)
+                    found += lookup(built, key);
+                watch.stop(queries.size());
+                sink = found;
+            });
+        };
+        looking_up("find_hit", keys.hits, [](C const& c, T const& key) { return c.find(key) != c.end(); });
+        looking_up("find_miss", keys.misses, [](C const& c, T const& key) { return c.find(key) != c.end(); });
+        looking_up("lower_bound", keys.misses, [](C const& c, T const& key)
+        {
+            auto it = c.lower_bound(key);
+            return it != c.end() ? digest(*it) : 0;
+        });
+
+        run<C, T>("erase", size, [&built, &keys](stopwatch& watch)
+        {
+            C c = copy_of(built);
+            watch.start();
+            for (T const& key : keys.shuffled)
+                c.erase(c.find(key));
+            watch.stop(keys.shuffled.size());
+        });
+        run<C, T>("iterate", size, [&built, size](stopwatch& watch)
+        {
+            uint64_t sum = 0;
+            watch.start();
+            for (T const& value : built)
+                sum += digest(value);
+            watch.stop(size);
+            sink = sum;
+        });
+        run<C, T>("copy", size, [&built, size](stopwatch& watch)
+        {
+            watch.start();
+            C c = copy_of(built);
+            watch.stop(size);
+        });
+        run<C, T>("clear", size, [&built, size](stopwatch& watch)
+        {
+            C c = copy_of(built);
+            watch.start();
+            c.clear();
+            watch.stop(size);
+        });
+    }
+
+    template <typename T>
+    void run_key(size_t size)
+    {
+        key_set<T> keys(size);
+        size_t first = results.size();
+        run_all<avl_tree<T>, T>(size, keys);
+        size_t middle = results.size();
+        run_all<std::set<T>, T>(size, keys);
+        if (counting)
+            return;
+        // both halves ran the same cases in the same order
+        for (size_t i = first; i != middle; ++i)
+            results[i].speedup = results[middle + i - first].real_ns / results[i].real_ns;
+    }
+};
+
+void write_json(std::vector<result> const& results, std::string const& path)
+{
+    std::ofstream out(path);
+    char date[64];
+    std::time_t now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+    out << "{\n  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+#ifdef NDEBUG
+        << "    \"library_build_type\": \"release\"\n"
+#else
+        << "    \"library_build_type\": \"debug\"\n"
+#endif
+        << "  },\n  \"benchmarks\": [";
+    for (size_t i = 0; i != results.size(); ++i)
+    {
+        result const& r = results[i];
+        out << (i == 0 ? "\n" : ",\n")
+            << "    {\n"
+            << "      \"name\": \"" << r.name << "\",\n"
+            << "      \"run_name\": \"" << r.name << "\",\n"
+            << "      \"run_type\": \"iteration\",\n"
+            << "      \"iterations\": " << r.iterations << ",\n"
+            << "      \"real_time\": " << r.real_ns << ",\n"
+            << "      \"cpu_time\": " << r.cpu_ns << ",\n"
+            << "      \"time_unit\": \"ns\"";
+        if (r.speedup != 0)
+            out << ",\n      \"speedup_vs_std_set\": " << r.speedup;
+        if (counting)
+            out << ",\n      \"comparisons_per_op\": " << r.comparisons
+                << ",\n      \"allocations_per_op\": " << r.allocations
+                << ",\n      \"bytes_per_op\": " << r.allocated_bytes;
+        for (size_t e = 0; e != pmu_events; ++e)
+            if (r.events[e] >= 0)
+                out << ",\n      \"" << pmu_names[e] << "_per_op\": " << r.events[e];
+        out << "\n    }";
+    }
+    out << "\n  ]\n}\n";
+    if (!out)
+    {
+        std::fprintf(stderr, "cannot write %s\n", path.c_str());
+        std::exit(1);
+    }
+}
+
+bool parse(int argc, char** argv, options& opts)
+{
+    for (int i = 1; i != argc; ++i)
+    {
+        std::string arg = argv[i];
+        auto value = [&arg](char const* flag) -> char const*
+        {
+            size_t length = std::strlen(flag);
+            return arg.compare(0, length, flag) == 0 ? arg.c_str() + length : nullptr;
+        };
+        if (char const* v = value("--filter="))
+            opts.filter = v;
+        else if (char const* v = value("--max_size="))
+            opts.max_size = std::min<size_t>(std::strtoull(v, nullptr, 10), 100000000);
+        else if (char const* v = value("--min_time="))
+            opts.min_time = std::strtod(v, nullptr);
+        else if (char const* v = value("--json="))
+            opts.json = v;
+        else
+            return false;
+    }
+    return true;
+}
+}
+
+int main(int argc, char** argv)
+{
+    options opts;
+    if (!parse(argc, argv, opts))
+    {
+        std::fprintf(stderr, "usage: %s [--filter=substring] [--max_size=N] [--min_time=seconds] [--json=path]\n",
+                     argv[0]);
+        return 2;
+    }
+    pmu hardware;
+    if (hardware.available())
+        opts.hardware = &hardware;
+    else
+        std::fprintf(stderr, "hardware counters unavailable (%s), reporting wall-clock time only\n",
+                     std::strerror(hardware.error));
+    suite s{opts, {}};
+    for (size_t size = 1000; size <= opts.max_size; size *= 10)
+    {
+        s.run_key<int>(size);
+        s.run_key<pod64>(size);
+        s.run_key<std::string>(size);
+#ifdef AVL_TREE_BENCH_COUNTERS
+        s.run_key<counted>(size);
+#endif
+    }
+    for (result const& r : s.results)
+        if (r.speedup != 0)
+            std::printf("%-44s %6.2fx std::set\n", r.name.c_str(), r.speedup);
+    if (!opts.json.empty())
+        write_json(s.results, opts.json);
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+// Frame-of-reference coding for the sorted keys of integral snapshots.
+// Keys are mapped to unsigned 64-bit values in the same order and cut
+// into blocks of block_size. A block stores its first key in full, one
+// byte for the width, and the gaps to the following keys minus one,
+// bit-packed at that width. Dense key sets pack to a few bits per key.
+// Blocks are independent, so they can be decoded in parallel.
+namespace avl_tree_packed
+{
+constexpr size_t block_size = 128;
+constexpr size_t block_header_size = sizeof(uint64_t) + 1;
+
+template<typename T>
+uint64_t to_ordered(T value) noexcept
+{
+    if constexpr (std::is_signed_v<T>) {
+        return static_cast<uint64_t>(static_cast<int64_t>(value)) ^ (uint64_t(1) << 63);
+    }
+    else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+template<typename T>
+T from_ordered(uint64_t value) noexcept
+{
+    if constexpr (std::is_signed_v<T>) {
+        return static_cast<T>(static_cast<int64_t>(value ^ (uint64_t(1) << 63)));
+    }
+    else {
+        return static_cast<T>(value);
+    }
+}
+
+// Whether value is to_ordered of some T. Keys read from a damaged
+// snapshot need not be, and from_ordered would not keep their order.
+template<typename T>
+bool in_range(uint64_t value) noexcept
+{
+    return value >= to_ordered(std::numeric_limits<T>::min()) && value <= to_ordered(std::numeric_limits<T>::max());
+}
+
+inline unsigned width(uint64_t value) noexcept
+{
+    unsigned result = 0;
+    for (; value != 0; value >>= 1) {
+        ++result;
+    }
+    return result;
+}
+
+inline size_t packed_bytes(size_t gaps, unsigned width) noexcept
+{
+    return (gaps * width + 7) / 8;
+}
+
+// Appends the blocks for keys[0, count), which must be strictly increasing.
+inline void encode(uint64_t const* keys, size_t count, std::vector<char>& out)
+{
+    for (size_t first = 0; first < count; first += block_size) {
+        size_t last = std::min(count, first + block_size);
+        unsigned bits = 0;
+        for (size_t i = first + 1; i != last; ++i) {
+            bits = std::max(bits, width(keys[i] - keys[i - 1] - 1));
+        }
+        size_t at = out.size();
+        out.resize(at + block_header_size + packed_bytes(last - first - 1, bits));
+        std::memcpy(&out[at], &keys[first], sizeof(uint64_t));
+        out[at + sizeof(uint64_t)] = static_cast<char>(bits);
+
+        // a block of consecutive keys or of one key packs no bytes, so the
+        // pointer may be one past the end
+        unsigned char* packed = reinterpret_cast<unsigned char*>(out.data() + at + block_header_size);
+        size_t position = 0;
+        for (size_t i = first + 1; i != last; ++i) {
+            uint64_t gap = keys[i] - keys[i - 1] - 1;
+            for (unsigned written = 0; written < bits;) {
+                unsigned offset = position % 8;
+                unsigned chunk = std::min(8 - offset, bits - written);
+                packed[position / 8] |= static_cast<unsigned char>(((gap >> written) & ((1u << chunk) - 1)) << offset);
+                written += chunk;
+                position += chunk;
+            }
+        }
+    }
+}
+
+// Byte offset of every block in data, or false if data is cut short.
+inline bool locate_blocks(char const* data, size_t size, size_t count, std::vector<size_t>& offsets)
+{
+    size_t at = 0;
+    for (size_t first = 0; first < count; first += block_size) {
+        if (size - at < block_header_size) {
+            return false;
+        }
+        unsigned bits = static_cast<unsigned char>(data[at + sizeof(uint64_t)]);
+        size_t bytes = packed_bytes(std::min(count - first, block_size) - 1, bits);
+        if (bits > 64 || size - at - block_header_size < bytes) {
+            return false;
+        }
+        offsets.push_back(at);
+        at += block_header_size + bytes;
+    }
+    return at == size;
+}
+
+// Decodes the block at data into keys. data must stay readable for 8
+// bytes past the block: gaps are read a 64-bit word at a time.
+inline void decode_block(char const* data, size_t keys_count, uint64_t* keys) noexcept
+{
+    uint64_t key;
+    std::memcpy(&key, data, sizeof(key));
+    unsigned bits = static_cast<unsigned char>(data[sizeof(uint64_t)]);
+    unsigned char const* packed = reinterpret_cast<unsigned char const*>(data + block_header_size);
+    uint64_t mask = bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1;
+    keys[0] = key;
+    size_t position = 0;
+    for (size_t i = 1; i != keys_count; ++i, position += bits) {
+        uint64_t word;
+        std::memcpy(&word, packed + position / 8, sizeof(word));
+        unsigned offset = position % 8;
+        uint64_t gap = word >> offset;
+        if (offset + bits > 64) {
+            gap |= static_cast<uint64_t>(packed[position / 8 + 8]) << (64 - offset);
+        }
+        key += (gap & mask) + 1;
+        keys[i] = key;
+    }
+}
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <iterator>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+
+// How avl_tree::save and load encode one value. Trivially copyable types
+// are stored as their bytes in native byte order; specialize this for
+// anything else, read must consume exactly what write produced.
+template<typename T>
+struct avl_tree_serializer
+{
+    static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>,
+                  "specialize avl_tree_serializer for this type");
+
+    static void write(std::ostream& out, T const& value)
+    {
+        out.write(reinterpret_cast<char const*>(&value), sizeof(T));
+    }
+
+    static T read(std::istream& in)
+    {
+        T value;
+        in.read(reinterpret_cast<char*>(&value), sizeof(T));
+        return value;
+    }
+};
+
+// Thrown by load for input that is not a snapshot of this version, or is
+// cut short, and by save when the stream fails.
+struct avl_tree_snapshot_error : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+// Every snapshot starts with this. Plain snapshots follow it with count
+// values in ascending order, packed ones with the size of the blocks
+// described in avl_tree_packed.h and the blocks.
+struct avl_tree_snapshot_header
+{
+    static constexpr char expected_magic[4] = {'A', 'V', 'L', 'T'};
+    static constexpr char packed_magic[4] = {'A', 'V', 'L', 'P'};
+    static constexpr uint32_t current_version = 1;
+
+    char magic[4];
+    uint32_t version;
+    uint64_t count;
+};
+
+// Reads the values of a plain snapshot one at a time, so a snapshot can be
+// streamed into avl_tree::assign_merged without loading it first. The
+// header is checked on construction; begin() may be called once.
+template<typename T>
+struct avl_tree_snapshot_reader
+{
+    struct iterator
+    {
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+        iterator() noexcept = default;
+
+        reference operator*() const noexcept
+        {
+            return reader->current;
+        }
+
+        pointer operator->() const noexcept
+        {
+            return &reader->current;
+        }
+
+        iterator& operator++()
+        {
+            if (!reader->advance()) {
+                reader = nullptr;
+            }
+            return *this;
+        }
+
+        bool operator==(iterator const& other) const noexcept
+        {
+            return reader == other.reader;
+        }
+
+        bool operator!=(iterator const& other) const noexcept
+        {
+            return reader != other.reader;
+        }
+
+    private:
+        avl_tree_snapshot_reader* reader = nullptr;
+
+        explicit iterator(avl_tree_snapshot_reader* reader) noexcept : reader(reader) { }
+
+        friend struct avl_tree_snapshot_reader;
+    };
+
+    explicit avl_tree_snapshot_reader(std::istream& in) : in(in)
+    {
+        avl_tree_snapshot_header header{};
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            !std::equal(std::begin(header.magic), std::end(header.magic), header.expected_magic)) {
+            throw avl_tree_snapshot_error("avl_tree_snapshot_reader: not a plain snapshot");
+        }
+        if (header.version != avl_tree_snapshot_header::current_version) {
+            throw avl_tree_snapshot_error("avl_tree_snapshot_reader: unsupported snapshot version");
+        }
+        remaining = header.count;
+    }
+
+    avl_tree_snapshot_reader(avl_tree_snapshot_reader const&) = delete;
+    avl_tree_snapshot_reader& operator=(avl_tree_snapshot_reader const&) = delete;
+
+    iterator begin()
+    {
+        return advance() ? iterator(this) : iterator();
+    }
+
+    iterator end() noexcept
+    {
+        return iterator();
+    }
+
+private:
+    std::istream& in;
+    uint64_t remaining = 0;
+    T current{};
+
+    bool advance()
+    {
+        if (remaining == 0) {
+            return false;
+        }
+        current = avl_tree_serializer<T>::read(in);
+        if (!in) {
+            throw avl_tree_snapshot_error("avl_tree_snapshot_reader: snapshot is truncated");
+        }
+        --remaining;
+        return true;
+    }
+};
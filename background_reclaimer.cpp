@@ -0,0 +1,65 @@
+#include "background_reclaimer.h"
+#include <cassert>
+
+background_reclaimer::background_reclaimer(size_t capacity)
+    : queue(capacity)
+{
+    assert(capacity != 0);
+    worker = std::thread([this] { run(); });
+}
+
+background_reclaimer::~background_reclaimer()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    not_empty.notify_all();
+    worker.join();
+}
+
+void background_reclaimer::retire(std::shared_ptr<void> object)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    not_full.wait(guard, [this] { return count != queue.size(); });
+    queue[(head + count) % queue.size()] = std::move(object);
+    ++count;
+    guard.unlock();
+    not_empty.notify_one();
+}
+
+void background_reclaimer::drain()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this] { return count == 0 && !busy; });
+}
+
+background_reclaimer& background_reclaimer::global()
+{
+    static background_reclaimer instance;
+    return instance;
+}
+
+void background_reclaimer::run()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        not_empty.wait(guard, [this] { return count != 0 || stopping; });
+        if (count == 0)
+            return;
+        std::shared_ptr<void> object = std::move(queue[head]);
+        head = (head + 1) % queue.size();
+        --count;
+        busy = true;
+        guard.unlock();
+        not_full.notify_one();
+
+        object.reset();
+
+        guard.lock();
+        busy = false;
+        if (count == 0)
+            idle.notify_all();
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Destroys objects on a thread of its own, so that tearing down a large
+// node graph does not stall the thread that let go of it. The queue is
+// bounded: retire waits while it is full.
+struct background_reclaimer
+{
+    explicit background_reclaimer(size_t capacity = 64);
+    background_reclaimer(background_reclaimer const&) = delete;
+    background_reclaimer& operator=(background_reclaimer const&) = delete;
+    // Destroys everything still queued before returning.
+    ~background_reclaimer();
+
+    void retire(std::shared_ptr<void> object);
+    // Waits until everything retired so far has been destroyed.
+    void drain();
+
+    // Shared instance, drained when the program exits.
+    static background_reclaimer& global();
+
+private:
+    void run();
+
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::condition_variable idle;
+    std::vector<std::shared_ptr<void>> queue;
+    size_t head = 0;
+    size_t count = 0;
+    bool busy = false;
+    bool stopping = false;
+    std::thread worker;
+};
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+
+#include "avl_tree.h"
+#include "background_reclaimer.h"
+#include "counted.h"
+
+namespace
+{
+struct tracked
+{
+    static std::atomic<int> alive;
+    int value;
+
+    tracked(int value) : value(value) // NOLINT
+    {
+        ++alive;
+    }
+
+    tracked(tracked const& other) : value(other.value)
+    {
+        ++alive;
+    }
+
+    ~tracked()
+    {
+        --alive;
+    }
+
+    friend bool operator<(tracked const& a, tracked const& b)
+    {
+        return a.value < b.value;
+    }
+
+    friend bool operator==(tracked const& a, tracked const& b)
+    {
+        return a.value == b.value;
+    }
+};
+
+std::atomic<int> tracked::alive{0};
+}
+
+TEST(background_reclaimer, clear_async_leaves_tree_usable)
+{
+    background_reclaimer reclaimer;
+    avl_tree<tracked> c;
+    for (int i = 0; i != 10000; ++i) {
+        c.insert(i);
+    }
+    c.clear_async(reclaimer);
+    EXPECT_TRUE(c.empty());
+    EXPECT_TRUE(c.begin() == c.end());
+
+    c.insert(5);
+    c.insert(3);
+    EXPECT_EQ(3, c.begin()->value);
+    reclaimer.drain();
+    EXPECT_EQ(2, tracked::alive.load());
+    c.clear();
+    EXPECT_EQ(0, tracked::alive.load());
+}
+
+TEST(background_reclaimer, bounded_queue)
+{
+    background_reclaimer reclaimer(1);
+    for (int round = 0; round != 50; ++round) {
+        avl_tree<tracked> c;
+        for (int i = 0; i != 100; ++i) {
+            c.insert(i);
+        }
+        c.clear_async(reclaimer);
+    }
+    reclaimer.drain();
+    EXPECT_EQ(0, tracked::alive.load());
+}
+
+TEST(background_reclaimer, destructor_drains)
+{
+    {
+        background_reclaimer reclaimer;
+        for (int round = 0; round != 10; ++round) {
+            avl_tree<tracked> c;
+            c.insert(round);
+            c.clear_async(reclaimer);
+        }
+    }
+    EXPECT_EQ(0, tracked::alive.load());
+}
+
+TEST(background_reclaimer, global_instance)
+{
+    counted::no_new_instances_guard g;
+
+    avl_tree<counted> c;
+    c.insert(1);
+    c.insert(2);
+    c.clear_async(background_reclaimer::global());
+    background_reclaimer::global().drain();
+}
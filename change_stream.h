@@ -0,0 +1,119 @@
+#ifndef CHANGE_STREAM_H
+#define CHANGE_STREAM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include <avl_tree.h>
+
+// Single-producer single-consumer queue of trivially copyable entries laid
+// out in memory the caller provides, so it can sit in a shared mapping and
+// connect two processes. Each side keeps its own handle; the indices are
+// address-free atomics on separate cache lines, and each handle caches
+// the other side's index, so it only reads the shared one when the ring
+// looks full or empty.
+template<typename E>
+struct spsc_ring {
+    static_assert(std::is_trivially_copyable_v<E>, "entries are copied between processes as raw bytes");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "indices must be address-free atomics");
+
+private:
+    struct ring_header {
+        uint64_t capacity;
+        // next entry to pop, written by the consumer
+        alignas(64) std::atomic<uint64_t> head;
+        // next entry to push, written by the producer
+        alignas(64) std::atomic<uint64_t> tail;
+    };
+
+    ring_header* header = nullptr;
+    E* slots = nullptr;
+    uint64_t mask = 0;
+    uint64_t cached_head = 0;
+    uint64_t cached_tail = 0;
+
+    explicit spsc_ring(void*) noexcept;
+    static size_t slots_offset() noexcept;
+
+public:
+    spsc_ring() noexcept = default;
+
+    // Bytes needed for capacity entries; capacity is a power of two.
+    static size_t bytes(size_t capacity) noexcept;
+    // Lays out an empty ring in memory, which must be aligned to 64.
+    static spsc_ring create(void* memory, size_t capacity);
+    // Another handle to a ring that create laid out, possibly in another
+    // process and at another address.
+    static spsc_ring attach(void* memory) noexcept;
+
+    // Producer only: false while the ring is full.
+    bool try_push(E const&) noexcept;
+    // Consumer only: copies up to max entries into out, returns how many.
+    // peek leaves them in the ring until consume(count) drops the first
+    // count of them; pop does both.
+    size_t peek(E* out, size_t max) noexcept;
+    void consume(size_t count) noexcept;
+    size_t pop(E* out, size_t max) noexcept;
+    size_t capacity() const noexcept;
+};
+
+enum class change_kind : uint8_t {
+    insert, erase
+};
+
+// One change made by a replicated_avl_tree; sequence counts from 1.
+template<typename T>
+struct tree_change {
+    uint64_t sequence;
+    change_kind kind;
+    T value;
+};
+
+// Thrown by apply_changes when a sequence number is missing, which means
+// the follower did not start from the leader's initial state.
+struct change_stream_error : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+// Leader side: an avl_tree whose insert and erase publish every change
+// that took effect to a ring, in order. Publishing spins while the ring
+// is full, so changes are never dropped and the leader is at most the
+// ring's capacity ahead of its follower. Not thread-safe.
+template<typename T>
+struct replicated_avl_tree {
+private:
+    avl_tree<T> tree;
+    spsc_ring<tree_change<T>> ring;
+    uint64_t sequence = 0;
+
+    void publish(change_kind, T const&) noexcept;
+
+public:
+    explicit replicated_avl_tree(spsc_ring<tree_change<T>> ring) noexcept;
+
+    bool insert(T const&);
+    bool erase(T const&);
+
+    // The sequence number of the last change published.
+    uint64_t last_sequence() const noexcept;
+    avl_tree<T> const& get() const noexcept;
+};
+
+// Follower side: applies what the ring holds to tree in batches and
+// returns how many changes that was. Inserts are hinted with the position
+// after the previous change, so runs of neighbouring keys need neither a
+// search from the root nor more than two comparisons each. applied is the
+// sequence number of the last change applied, 0 for a fresh follower.
+// A change is only taken off the ring once applied, so after an exception
+// the call can simply be repeated. A missing sequence number or an erase
+// of a value the follower lacks means it has diverged from the leader and
+// throws change_stream_error.
+template<typename T>
+size_t apply_changes(avl_tree<T>&, spsc_ring<tree_change<T>>&, uint64_t& applied);
+
+#include <change_stream.tpp>
+#endif //CHANGE_STREAM_H
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <iterator>
+#include <new>
+#include <string>
+#include <thread>
+
+template<typename E>
+size_t spsc_ring<E>::slots_offset() noexcept
+{
+    size_t align = std::max(alignof(E), alignof(ring_header));
+    return (sizeof(ring_header) + align - 1) / align * align;
+}
+
+template<typename E>
+spsc_ring<E>::spsc_ring(void* memory) noexcept
+    : header(static_cast<ring_header*>(memory)),
+      slots(reinterpret_cast<E*>(static_cast<char*>(memory) + slots_offset())),
+      mask(header->capacity - 1),
+      cached_head(header->head.load(std::memory_order_acquire)),
+      cached_tail(header->tail.load(std::memory_order_acquire)) { }
+
+template<typename E>
+size_t spsc_ring<E>::bytes(size_t capacity) noexcept
+{
+    return slots_offset() + capacity * sizeof(E);
+}
+
+template<typename E>
+spsc_ring<E> spsc_ring<E>::create(void* memory, size_t capacity)
+{
+    if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        throw std::invalid_argument("spsc_ring: capacity must be a power of two");
+    }
+    ring_header* header = new(memory) ring_header;
+    header->capacity = capacity;
+    header->head.store(0, std::memory_order_relaxed);
+    header->tail.store(0, std::memory_order_release);
+    return spsc_ring(memory);
+}
+
+template<typename E>
+spsc_ring<E> spsc_ring<E>::attach(void* memory) noexcept
+{
+    return spsc_ring(memory);
+}
+
+template<typename E>
+bool spsc_ring<E>::try_push(E const& entry) noexcept
+{
+    uint64_t tail = header->tail.load(std::memory_order_relaxed);
+    if (tail - cached_head == header->capacity) {
+        cached_head = header->head.load(std::memory_order_acquire);
+        if (tail - cached_head == header->capacity) {
+            return false;
+        }
+    }
+    slots[tail & mask] = entry;
+    header->tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template<typename E>
+size_t spsc_ring<E>::peek(E* out, size_t max) noexcept
+{
+    uint64_t head = header->head.load(std::memory_order_relaxed);
+    if (cached_tail - head < max) {
+        cached_tail = header->tail.load(std::memory_order_acquire);
+    }
+    size_t count = static_cast<size_t>(std::min<uint64_t>(cached_tail - head, max));
+    for (size_t i = 0; i != count; ++i) {
+        out[i] = slots[(head + i) & mask];
+    }
+    return count;
+}
+
+template<typename E>
+void spsc_ring<E>::consume(size_t count) noexcept
+{
+    header->head.store(header->head.load(std::memory_order_relaxed) + count, std::memory_order_release);
+}
+
+template<typename E>
+size_t spsc_ring<E>::pop(E* out, size_t max) noexcept
+{
+    size_t count = peek(out, max);
+    consume(count);
+    return count;
+}
+
+template<typename E>
+size_t spsc_ring<E>::capacity() const noexcept
+{
+    return static_cast<size_t>(header->capacity);
+}
+
+template<typename T>
+replicated_avl_tree<T>::replicated_avl_tree(spsc_ring<tree_change<T>> ring) noexcept : ring(ring) { }
+
+template<typename T>
+void replicated_avl_tree<T>::publish(change_kind kind, T const& value) noexcept
+{
+    tree_change<T> change{++sequence, kind, value};
+    while (!ring.try_push(change)) {
+        std::this_thread::yield();
+    }
+}
+
+template<typename T>
+bool replicated_avl_tree<T>::insert(T const& value)
+{
+    if (!tree.insert(value).second) {
+        return false;
+    }
+    publish(change_kind::insert, value);
+    return true;
+}
+
+template<typename T>
+bool replicated_avl_tree<T>::erase(T const& value)
+{
+    auto it = tree.find(value);
+    if (it == tree.end()) {
+        return false;
+    }
+    tree.erase(it);
+    publish(change_kind::erase, value);
+    return true;
+}
+
+template<typename T>
+uint64_t replicated_avl_tree<T>::last_sequence() const noexcept
+{
+    return sequence;
+}
+
+template<typename T>
+avl_tree<T> const& replicated_avl_tree<T>::get() const noexcept
+{
+    return tree;
+}
+
+template<typename T>
+size_t apply_changes(avl_tree<T>& tree, spsc_ring<tree_change<T>>& ring, uint64_t& applied)
+{
+    constexpr size_t batch_size = 64;
+    tree_change<T> batch[batch_size];
+    size_t total = 0;
+    for (size_t count; (count = ring.peek(batch, batch_size)) != 0; total += count) {
+        auto hint = tree.end();
+        size_t i = 0;
+        // changes leave the ring only once applied, so the one that failed
+        // and those after it are read again by the next call
+        try {
+            for (; i != count; ++i) {
+                tree_change<T> const& change = batch[i];
+                if (change.sequence != applied + 1) {
+                    throw change_stream_error("apply_changes: change " + std::to_string(applied + 1) +
+                                              " is missing");
+                }
+                if (change.kind == change_kind::insert) {
+                    hint = std::next(tree.insert(hint, change.value));
+                }
+                else {
+                    auto it = hint != tree.end() && !(change.value < *hint) && !(*hint < change.value)
+                              ? hint : tree.find(change.value);
+                    if (it == tree.end()) {
+                        // the leader only publishes erases that took effect
+                        throw change_stream_error("apply_changes: change " + std::to_string(change.sequence) +
+                                                  " erases a value the follower does not have");
+                    }
+                    hint = tree.erase(it);
+                }
+                applied = change.sequence;
+            }
+        }
+        catch (...) {
+            ring.consume(i);
+            throw;
+        }
+        ring.consume(count);
+    }
+    return total;
+}
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "change_stream.h"
+#include "fault_injection.h"
+
+namespace
+{
+// Memory for a ring, aligned as spsc_ring::create needs.
+struct ring_memory
+{
+    std::vector<uint64_t> words;
+
+    explicit ring_memory(size_t bytes) : words(bytes / sizeof(uint64_t) + 8) {}
+
+    void* get()
+    {
+        return reinterpret_cast<void*>((reinterpret_cast<uintptr_t>(words.data()) + 63) / 64 * 64);
+    }
+};
+}
+
+TEST(change_stream, ring_wraps_around)
+{
+    ring_memory memory(spsc_ring<uint64_t>::bytes(8));
+    auto producer = spsc_ring<uint64_t>::create(memory.get(), 8);
+    auto consumer = spsc_ring<uint64_t>::attach(memory.get());
+    EXPECT_EQ(8u, consumer.capacity());
+    EXPECT_THROW(spsc_ring<uint64_t>::create(memory.get(), 6), std::invalid_argument);
+
+    uint64_t pushed = 0;
+    uint64_t popped = 0;
+    uint64_t out[5];
+    for (int round = 0; round != 100; ++round) {
+        while (producer.try_push(pushed)) {
+            ++pushed;
+        }
+        EXPECT_EQ(popped + 8, pushed);
+        size_t count = consumer.pop(out, 5);
+        EXPECT_EQ(5u, count);
+        for (size_t i = 0; i != count; ++i) {
+            EXPECT_EQ(popped++, out[i]);
+        }
+    }
+    while (size_t count = consumer.pop(out, 5)) {
+        for (size_t i = 0; i != count; ++i) {
+            EXPECT_EQ(popped++, out[i]);
+        }
+    }
+    EXPECT_EQ(pushed, popped);
+}
+
+TEST(change_stream, follower_catches_up)
+{
+    ring_memory memory(spsc_ring<tree_change<int>>::bytes(256));
+    replicated_avl_tree<int> leader(spsc_ring<tree_change<int>>::create(memory.get(), 256));
+    auto ring = spsc_ring<tree_change<int>>::attach(memory.get());
+    avl_tree<int> follower;
+    uint64_t applied = 0;
+
+    std::atomic<bool> done{false};
+    std::thread consumer([&]
+    {
+        while (!done.load() || applied != leader.last_sequence()) {
+            if (apply_changes(follower, ring, applied) == 0) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    std::mt19937 rng(46);
+    for (int i = 0; i != 40000; ++i) {
+        // runs of neighbouring keys, as a leader filling a range produces
+        int value = static_cast<int>(rng() % 5000) * 4 + i % 4;
+        if (rng() % 3 == 0) {
+            leader.erase(value);
+        }
+        else {
+            leader.insert(value);
+        }
+    }
+    done = true;
+    consumer.join();
+    EXPECT_TRUE(std::equal(leader.get().begin(), leader.get().end(), follower.begin(), follower.end()));
+}
+
+TEST(change_stream, gap_is_reported)
+{
+    ring_memory memory(spsc_ring<tree_change<int>>::bytes(4));
+    auto producer = spsc_ring<tree_change<int>>::create(memory.get(), 4);
+    auto consumer = spsc_ring<tree_change<int>>::attach(memory.get());
+    producer.try_push({1, change_kind::insert, 10});
+    producer.try_push({3, change_kind::insert, 30});
+    avl_tree<int> follower;
+    uint64_t applied = 0;
+    EXPECT_THROW(apply_changes(follower, consumer, applied), change_stream_error);
+    EXPECT_EQ(1u, applied);
+    EXPECT_EQ(10, *follower.begin());
+}
+
+TEST(change_stream, divergence_is_reported)
+{
+    ring_memory memory(spsc_ring<tree_change<int>>::bytes(4));
+    auto producer = spsc_ring<tree_change<int>>::create(memory.get(), 4);
+    auto consumer = spsc_ring<tree_change<int>>::attach(memory.get());
+    producer.try_push({1, change_kind::insert, 10});
+    producer.try_push({2, change_kind::erase, 20});
+    avl_tree<int> follower;
+    uint64_t applied = 0;
+    EXPECT_THROW(apply_changes(follower, consumer, applied), change_stream_error);
+    EXPECT_EQ(1u, applied);
+    // the change stays in the ring, so retrying reports it again
+    EXPECT_THROW(apply_changes(follower, consumer, applied), change_stream_error);
+    EXPECT_EQ(1u, applied);
+}
+
+TEST(fault_injection, apply_changes)
+{
+    faulty_run([]
+    {
+        ring_memory memory(spsc_ring<tree_change<int>>::bytes(8));
+        auto producer = spsc_ring<tree_change<int>>::create(memory.get(), 8);
+        auto consumer = spsc_ring<tree_change<int>>::attach(memory.get());
+        producer.try_push({1, change_kind::insert, 10});
+        producer.try_push({2, change_kind::insert, 20});
+        producer.try_push({3, change_kind::erase, 10});
+        producer.try_push({4, change_kind::insert, 30});
+        avl_tree<int> follower;
+        uint64_t applied = 0;
+        try {
+            apply_changes(follower, consumer, applied);
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            // the changes not applied are still there for the retry
+            apply_changes(follower, consumer, applied);
+            EXPECT_EQ(4u, applied);
+            EXPECT_EQ((std::vector<int>{20, 30}), std::vector<int>(follower.begin(), follower.end()));
+            throw;
+        }
+        fault_injection_disable dg;
+        EXPECT_EQ(4u, applied);
+        EXPECT_EQ((std::vector<int>{20, 30}), std::vector<int>(follower.begin(), follower.end()));
+    });
+}
+
+#ifndef _WIN32
+TEST(change_stream, follower_in_another_process)
+{
+    constexpr size_t capacity = 1024;
+    size_t const bytes = 64 + spsc_ring<tree_change<int>>::bytes(capacity);
+    void* shared = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    ASSERT_NE(MAP_FAILED, shared);
+    // the last sequence number once the leader is done, 0 before
+    auto* last = new(shared) std::atomic<uint64_t>(0);
+    void* ring_start = static_cast<char*>(shared) + 64;
+    auto ring = spsc_ring<tree_change<int>>::create(ring_start, capacity);
+
+    auto leader_changes = [](auto&& insert, auto&& erase)
+    {
+        std::mt19937 rng(146);
+        for (int i = 0; i != 50000; ++i) {
+            int value = static_cast<int>(rng() % 20000);
+            if (rng() % 4 == 0) {
+                erase(value);
+            }
+            else {
+                insert(value);
+            }
+        }
+    };
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        auto consumer = spsc_ring<tree_change<int>>::attach(ring_start);
+        avl_tree<int> follower;
+        uint64_t applied = 0;
+        while (last->load() == 0 || applied != last->load()) {
+            if (apply_changes(follower, consumer, applied) == 0) {
+                std::this_thread::yield();
+            }
+        }
+        std::set<int> expected;
+        leader_changes([&](int value) { expected.insert(value); }, [&](int value) { expected.erase(value); });
+        _exit(std::equal(expected.begin(), expected.end(), follower.begin(), follower.end()) ? 0 : 1);
+    }
+    replicated_avl_tree<int> leader(ring);
+    leader_changes([&](int value) { leader.insert(value); }, [&](int value) { leader.erase(value); });
+    last->store(leader.last_sequence());
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    EXPECT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(0, WEXITSTATUS(status));
+    munmap(shared, bytes);
+}
+#endif
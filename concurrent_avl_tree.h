@@ -0,0 +1,92 @@
+#ifndef CONCURRENT_AVL_TREE_H
+#define CONCURRENT_AVL_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+
+#include <epoch.h>
+
+// Thread-safe set in the style of Bronson et al., "A Practical Concurrent
+// Binary Search Tree". Lookups take no locks: they validate each step
+// against per-node version numbers and retry when a rotation shrank the
+// subtree they were in. Updates lock only the few nodes they change.
+// Removing a node with two children leaves it in place as a routing node,
+// it is unlinked later once it has at most one child. Unlinked nodes are
+// handed to epoch_retire, since a reader may still be on them.
+template<typename T>
+struct concurrent_avl_tree {
+private:
+    struct avl_tree_node : epoch_retired {
+        std::optional<T> const value{};
+        std::atomic<bool> present{false};
+        std::atomic<ptrdiff_t> height{0};
+        std::atomic<uint64_t> version{0};
+        std::atomic<avl_tree_node*> left{nullptr};
+        std::atomic<avl_tree_node*> right{nullptr};
+        std::atomic<avl_tree_node*> parent{nullptr};
+        std::mutex lock;
+
+        avl_tree_node() noexcept;
+        avl_tree_node(T const& value, avl_tree_node*);
+    };
+
+    enum class result {
+        unchanged, changed, retry
+    };
+
+    static constexpr uint64_t unlinked = 1;
+    static constexpr uint64_t shrinking = 2;
+    static constexpr uint64_t shrink_count_increment = 4;
+
+    static constexpr ptrdiff_t unlink_required = -1;
+    static constexpr ptrdiff_t rebalance_required = -2;
+    static constexpr ptrdiff_t nothing_required = -3;
+
+    mutable avl_tree_node holder{};
+
+    static int cmp(T const&, T const&);
+    static bool is_changing(uint64_t) noexcept;
+    static uint64_t begin_shrink(uint64_t) noexcept;
+    static uint64_t end_shrink(uint64_t) noexcept;
+    static void wait_until_not_changing(avl_tree_node*);
+    static std::atomic<avl_tree_node*>& child(avl_tree_node*, int) noexcept;
+    static ptrdiff_t height(avl_tree_node*) noexcept;
+    static void reclaim(epoch_retired*) noexcept;
+
+    result attempt_get(T const&, avl_tree_node*, int, uint64_t) const;
+    bool update(T const&, bool);
+    result attempt_update(T const&, bool, avl_tree_node*, avl_tree_node*, uint64_t);
+    result attempt_node_update(bool, avl_tree_node*, avl_tree_node*);
+    static bool attempt_unlink_nl(avl_tree_node*, avl_tree_node*) noexcept;
+
+    static ptrdiff_t node_condition(avl_tree_node*) noexcept;
+    void fix_height_and_rebalance(avl_tree_node*);
+    avl_tree_node* fix_height_nl(avl_tree_node*) noexcept;
+    avl_tree_node* rebalance_nl(avl_tree_node*, avl_tree_node*);
+    avl_tree_node* rebalance_to_right_nl(avl_tree_node*, avl_tree_node*, avl_tree_node*, ptrdiff_t);
+    avl_tree_node* rebalance_to_left_nl(avl_tree_node*, avl_tree_node*, avl_tree_node*, ptrdiff_t);
+    avl_tree_node* rotate_right_nl(avl_tree_node*, avl_tree_node*, avl_tree_node*, ptrdiff_t, ptrdiff_t,
+                                   avl_tree_node*, ptrdiff_t) noexcept;
+    avl_tree_node* rotate_left_nl(avl_tree_node*, avl_tree_node*, ptrdiff_t, avl_tree_node*, avl_tree_node*,
+                                  ptrdiff_t, ptrdiff_t) noexcept;
+    avl_tree_node* rotate_right_over_left_nl(avl_tree_node*, avl_tree_node*, avl_tree_node*, ptrdiff_t, ptrdiff_t,
+                                             avl_tree_node*, ptrdiff_t) noexcept;
+    avl_tree_node* rotate_left_over_right_nl(avl_tree_node*, avl_tree_node*, ptrdiff_t, avl_tree_node*,
+                                             avl_tree_node*, ptrdiff_t, ptrdiff_t) noexcept;
+
+public:
+    concurrent_avl_tree() noexcept;
+    concurrent_avl_tree(concurrent_avl_tree const&) = delete;
+    concurrent_avl_tree& operator=(concurrent_avl_tree const&) = delete;
+    ~concurrent_avl_tree();
+
+    bool contains(T const&) const;
+    bool insert(T const&);
+    bool erase(T const&);
+};
+
+#include <concurrent_avl_tree.tpp>
+#endif //CONCURRENT_AVL_TREE_H
@@ -0,0 +1,682 @@
+#include <algorithm>
+#include <vector>
+
+template<typename T>
+concurrent_avl_tree<T>::avl_tree_node::avl_tree_node() noexcept { }
+
+template<typename T>
+concurrent_avl_tree<T>::avl_tree_node::avl_tree_node(T const& value, avl_tree_node* parent) :
+        value(value), present(true), height(1), parent(parent) { }
+
+template<typename T>
+concurrent_avl_tree<T>::concurrent_avl_tree() noexcept { }
+
+template<typename T>
+concurrent_avl_tree<T>::~concurrent_avl_tree()
+{
+    std::vector<avl_tree_node*> stack;
+    if (avl_tree_node* root = holder.right.load()) {
+        stack.push_back(root);
+    }
+    while (!stack.empty()) {
+        avl_tree_node* node = stack.back();
+        stack.pop_back();
+        if (avl_tree_node* left = node->left.load()) {
+            stack.push_back(left);
+        }
+        if (avl_tree_node* right = node->right.load()) {
+            stack.push_back(right);
+        }
+        delete node;
+    }
+}
+
+template<typename T>
+int concurrent_avl_tree<T>::cmp(T const& lhs, T const& rhs) {
+    return lhs < rhs ? -1 : (rhs < lhs ? 1 : 0);
+}
+
+template<typename T>
+bool concurrent_avl_tree<T>::is_changing(uint64_t version) noexcept
+{
+    return (version & (shrinking | unlinked)) != 0;
+}
+
+template<typename T>
+uint64_t concurrent_avl_tree<T>::begin_shrink(uint64_t version) noexcept
+{
+    return version | shrinking;
+}
+
+template<typename T>
+uint64_t concurrent_avl_tree<T>::end_shrink(uint64_t version) noexcept
+{
+    return (version & ~shrinking) + shrink_count_increment;
+}
+
+// A shrink is done while holding the node's lock, so after a short spin we
+// can simply wait for that lock instead of burning the CPU.
+template<typename T>
+void concurrent_avl_tree<T>::wait_until_not_changing(avl_tree_node* node)
+{
+    uint64_t version = node->version.load();
+    if ((version & shrinking) == 0) {
+        return;
+    }
+    for (int i = 0; i != 100; ++i) {
+        if (node->version.load() != version) {
+            return;
+        }
+    }
+    std::lock_guard<std::mutex> lock(node->lock);
+}
+
+template<typename T>
+std::atomic<typename concurrent_avl_tree<T>::avl_tree_node*>& concurrent_avl_tree<T>::child(avl_tree_node* node, int direction) noexcept
+{
+    return direction < 0 ? node->left : node->right;
+}
+
+template<typename T>
+ptrdiff_t concurrent_avl_tree<T>::height(avl_tree_node* node) noexcept
+{
+    return node ? node->height.load() : 0;
+}
+
+template<typename T>
+void concurrent_avl_tree<T>::reclaim(epoch_retired* node) noexcept
+{
+    delete static_cast<avl_tree_node*>(node);
+}
+
+template<typename T>
+bool concurrent_avl_tree<T>::contains(T const& value) const
+{
+    epoch_guard guard;
+    for (;;) {
+        avl_tree_node* right = holder.right.load();
+        if (right == nullptr) {
+            return false;
+        }
+        int direction = cmp(value, *right->value);
+        if (direction == 0) {
+            return right->present.load();
+        }
+        uint64_t version = right->version.load();
+        if (is_changing(version)) {
+            wait_until_not_changing(right);
+        }
+        else if (right == holder.right.load()) {
+            result res = attempt_get(value, right, direction, version);
+            if (res != result::retry) {
+                return res == result::changed;
+            }
+        }
+    }
+}
+
+// Hand-over-hand optimistic descent: a child pointer read from node is only
+// trusted if node's version did not change meanwhile, otherwise the key may
+// have been moved out of this subtree and the caller retries one level up.
+template<typename T>
+typename concurrent_avl_tree<T>::result concurrent_avl_tree<T>::attempt_get(T const& value, avl_tree_node* node,
+                                                                            int direction, uint64_t node_version) const
+{
+    for (;;) {
+        avl_tree_node* next = child(node, direction).load();
+        if (next == nullptr) {
+            if (node->version.load() != node_version) {
+                return result::retry;
+            }
+            return result::unchanged;
+        }
+        int next_direction = cmp(value, *next->value);
+        if (next_direction == 0) {
+            return next->present.load() ? result::changed : result::unchanged;
+        }
+        uint64_t next_version = next->version.load();
+        if (is_changing(next_version)) {
+            wait_until_not_changing(next);
+            if (node->version.load() != node_version) {
+                return result::retry;
+            }
+        }
+        else if (next != child(node, direction).load()) {
+            if (node->version.load() != node_version) {
+                return result::retry;
+            }
+        }
+        else {
+            if (node->version.load() != node_version) {
+                return result::retry;
+            }
+            result res = attempt_get(value, next, next_direction, next_version);
+            if (res != result::retry) {
+                return res;
+            }
+        }
+    }
+}
+
+template<typename T>
+bool concurrent_avl_tree<T>::insert(T const& value)
+{
+    return update(value, true);
+}
+
+template<typename T>
+bool concurrent_avl_tree<T>::erase(T const& value)
+{
+    return update(value, false);
+}
+
+template<typename T>
+bool concurrent_avl_tree<T>::update(T const& value, bool insert)
+{
+    epoch_guard guard;
+    for (;;) {
+        avl_tree_node* right = holder.right.load();
+        if (right == nullptr) {
+            if (!insert) {
+                return false;
+            }
+            std::lock_guard<std::mutex> lock(holder.lock);
+            if (holder.right.load() == nullptr) {
+                holder.right.store(new avl_tree_node(value, &holder));
+                holder.height.store(2);
+                return true;
+            }
+        }
+        else {
+            uint64_t version = right->version.load();
+            if (is_changing(version)) {
+                wait_until_not_changing(right);
+            }
+            else if (right == holder.right.load()) {
+                result res = attempt_update(value, insert, &holder, right, version);
+                if (res != result::retry) {
+                    return res == result::changed;
+                }
+            }
+        }
+    }
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::result concurrent_avl_tree<T>::attempt_update(T const& value, bool insert,
+                                                                               avl_tree_node* parent, avl_tree_node* node,
+                                                                               uint64_t node_version)
+{
+    int direction = cmp(value, *node->value);
+    if (direction == 0) {
+        return attempt_node_update(insert, parent, node);
+    }
+    for (;;) {
+        avl_tree_node* next = child(node, direction).load();
+        if (node->version.load() != node_version) {
+            return result::retry;
+        }
+        if (next == nullptr) {
+            if (!insert) {
+                return result::unchanged;
+            }
+            avl_tree_node* damaged;
+            {
+                std::lock_guard<std::mutex> lock(node->lock);
+                if (node->version.load() != node_version) {
+                    return result::retry;
+                }
+                if (child(node, direction).load() != nullptr) {
+                    continue;
+                }
+                child(node, direction).store(new avl_tree_node(value, node));
+                damaged = fix_height_nl(node);
+            }
+            fix_height_and_rebalance(damaged);
+            return result::changed;
+        }
+        uint64_t next_version = next->version.load();
+        if (is_changing(next_version)) {
+            wait_until_not_changing(next);
+        }
+        else if (next == child(node, direction).load()) {
+            if (node->version.load() != node_version) {
+                return result::retry;
+            }
+            result res = attempt_update(value, insert, node, next, next_version);
+            if (res != result::retry) {
+                return res;
+            }
+        }
+    }
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::result concurrent_avl_tree<T>::attempt_node_update(bool insert, avl_tree_node* parent,
+                                                                                    avl_tree_node* node)
+{
+    if (!insert) {
+        if (!node->present.load()) {
+            return result::unchanged;
+        }
+        if (node->left.load() == nullptr || node->right.load() == nullptr) {
+            {
+                std::lock_guard<std::mutex> parent_lock(parent->lock);
+                if ((parent->version.load() & unlinked) != 0 || node->parent.load() != parent) {
+                    return result::retry;
+                }
+                std::lock_guard<std::mutex> node_lock(node->lock);
+                if (!node->present.load()) {
+                    return result::unchanged;
+                }
+                if (!attempt_unlink_nl(parent, node)) {
+                    return result::retry;
+                }
+            }
+            fix_height_and_rebalance(parent);
+            return result::changed;
+        }
+    }
+    std::lock_guard<std::mutex> lock(node->lock);
+    if ((node->version.load() & unlinked) != 0) {
+        return result::retry;
+    }
+    if (node->present.load() == insert) {
+        return result::unchanged;
+    }
+    if (!insert && (node->left.load() == nullptr || node->right.load() == nullptr)) {
+        return result::retry;
+    }
+    node->present.store(insert);
+    return result::changed;
+}
+
+template<typename T>
+bool concurrent_avl_tree<T>::attempt_unlink_nl(avl_tree_node* parent, avl_tree_node* node) noexcept
+{
+    avl_tree_node* parent_left = parent->left.load();
+    avl_tree_node* parent_right = parent->right.load();
+    if (parent_left != node && parent_right != node) {
+        return false;
+    }
+    avl_tree_node* left = node->left.load();
+    avl_tree_node* right = node->right.load();
+    if (left != nullptr && right != nullptr) {
+        return false;
+    }
+    avl_tree_node* splice = left != nullptr ? left : right;
+    if (parent_left == node) {
+        parent->left.store(splice);
+    }
+    else {
+        parent->right.store(splice);
+    }
+    if (splice != nullptr) {
+        splice->parent.store(parent);
+    }
+    node->version.store(unlinked);
+    node->present.store(false);
+    epoch_retire(node, reclaim);
+    return true;
+}
+
+template<typename T>
+ptrdiff_t concurrent_avl_tree<T>::node_condition(avl_tree_node* node) noexcept
+{
+    avl_tree_node* left = node->left.load();
+    avl_tree_node* right = node->right.load();
+    if ((left == nullptr || right == nullptr) && !node->present.load()) {
+        return unlink_required;
+    }
+    ptrdiff_t old_height = node->height.load();
+    ptrdiff_t left_height = height(left);
+    ptrdiff_t right_height = height(right);
+    ptrdiff_t new_height = std::max(left_height, right_height) + 1;
+    ptrdiff_t diff = left_height - right_height;
+    if (diff < -1 || diff > 1) {
+        return rebalance_required;
+    }
+    return old_height != new_height ? new_height : nothing_required;
+}
+
+template<typename T>
+void concurrent_avl_tree<T>::fix_height_and_rebalance(avl_tree_node* node)
+{
+    while (node != nullptr && node->parent.load() != nullptr) {
+        ptrdiff_t condition = node_condition(node);
+        if (condition == nothing_required || (node->version.load() & unlinked) != 0) {
+            return;
+        }
+        if (condition != unlink_required && condition != rebalance_required) {
+            std::lock_guard<std::mutex> lock(node->lock);
+            node = fix_height_nl(node);
+        }
+        else {
+            avl_tree_node* parent = node->parent.load();
+            std::lock_guard<std::mutex> parent_lock(parent->lock);
+            if ((parent->version.load() & unlinked) == 0 && node->parent.load() == parent) {
+                std::lock_guard<std::mutex> node_lock(node->lock);
+                node = rebalance_nl(parent, node);
+            }
+        }
+    }
+}
+
+// Returns the next node that needs attention, or nullptr when done.
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::fix_height_nl(avl_tree_node* node) noexcept
+{
+    ptrdiff_t condition = node_condition(node);
+    switch (condition) {
+        case rebalance_required:
+        case unlink_required:
+            return node;
+        case nothing_required:
+            return nullptr;
+        default:
+            node->height.store(condition);
+            return node->parent.load();
+    }
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::rebalance_nl(avl_tree_node* parent,
+                                                                                     avl_tree_node* node)
+{
+    avl_tree_node* left = node->left.load();
+    avl_tree_node* right = node->right.load();
+    if ((left == nullptr || right == nullptr) && !node->present.load()) {
+        if (attempt_unlink_nl(parent, node)) {
+            return fix_height_nl(parent);
+        }
+        return node;
+    }
+    ptrdiff_t old_height = node->height.load();
+    ptrdiff_t left_height = height(left);
+    ptrdiff_t right_height = height(right);
+    ptrdiff_t new_height = std::max(left_height, right_height) + 1;
+    ptrdiff_t diff = left_height - right_height;
+    if (diff > 1) {
+        return rebalance_to_right_nl(parent, node, left, right_height);
+    }
+    if (diff < -1) {
+        return rebalance_to_left_nl(parent, node, right, left_height);
+    }
+    if (new_height != old_height) {
+        node->height.store(new_height);
+        return fix_height_nl(parent);
+    }
+    return nullptr;
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::rebalance_to_right_nl(
+        avl_tree_node* parent, avl_tree_node* node, avl_tree_node* left, ptrdiff_t right_height)
+{
+    std::lock_guard<std::mutex> left_lock(left->lock);
+    ptrdiff_t left_height = left->height.load();
+    if (left_height - right_height <= 1) {
+        return node;
+    }
+    avl_tree_node* left_right = left->right.load();
+    ptrdiff_t left_left_height = height(left->left.load());
+    ptrdiff_t left_right_height = height(left_right);
+    if (left_left_height >= left_right_height) {
+        return rotate_right_nl(parent, node, left, right_height, left_left_height, left_right, left_right_height);
+    }
+    {
+        std::lock_guard<std::mutex> left_right_lock(left_right->lock);
+        left_right_height = left_right->height.load();
+        if (left_left_height >= left_right_height) {
+            return rotate_right_nl(parent, node, left, right_height, left_left_height, left_right, left_right_height);
+        }
+        ptrdiff_t left_right_left_height = height(left_right->left.load());
+        ptrdiff_t diff = left_left_height - left_right_left_height;
+        if (diff >= -1 && diff <= 1 && !((left_left_height == 0 || left_right_left_height == 0) && !left->present.load())) {
+            return rotate_right_over_left_nl(parent, node, left, right_height, left_left_height, left_right,
+                                             left_right_left_height);
+        }
+    }
+    return rebalance_to_left_nl(node, left, left_right, left_left_height);
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::rebalance_to_left_nl(
+        avl_tree_node* parent, avl_tree_node* node, avl_tree_node* right, ptrdiff_t left_height)
+{
+    std::lock_guard<std::mutex> right_lock(right->lock);
+    ptrdiff_t right_height = right->height.load();
+    if (left_height - right_height >= -1) {
+        return node;
+    }
+    avl_tree_node* right_left = right->left.load();
+    ptrdiff_t right_left_height = height(right_left);
+    ptrdiff_t right_right_height = height(right->right.load());
+    if (right_right_height >= right_left_height) {
+        return rotate_left_nl(parent, node, left_height, right, right_left, right_left_height, right_right_height);
+    }
+    {
+        std::lock_guard<std::mutex> right_left_lock(right_left->lock);
+        right_left_height = right_left->height.load();
+        if (right_right_height >= right_left_height) {
+            return rotate_left_nl(parent, node, left_height, right, right_left, right_left_height, right_right_height);
+        }
+        ptrdiff_t right_left_right_height = height(right_left->right.load());
+        ptrdiff_t diff = right_right_height - right_left_right_height;
+        if (diff >= -1 && diff <= 1 && !((right_right_height == 0 || right_left_right_height == 0) && !right->present.load())) {
+            return rotate_left_over_right_nl(parent, node, left_height, right, right_left, right_right_height,
+                                             right_left_right_height);
+        }
+    }
+    return rebalance_to_right_nl(node, right, right_left, right_right_height);
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::rotate_right_nl(
+        avl_tree_node* parent, avl_tree_node* node, avl_tree_node* left, ptrdiff_t right_height,
+        ptrdiff_t left_left_height, avl_tree_node* left_right, ptrdiff_t left_right_height) noexcept
+{
+    uint64_t node_version = node->version.load();
+    avl_tree_node* parent_left = parent->left.load();
+
+    node->version.store(begin_shrink(node_version));
+
+    node->left.store(left_right);
+    if (left_right != nullptr) {
+        left_right->parent.store(node);
+    }
+    left->right.store(node);
+    node->parent.store(left);
+    if (parent_left == node) {
+        parent->left.store(left);
+    }
+    else {
+        parent->right.store(left);
+    }
+    left->parent.store(parent);
+
+    ptrdiff_t node_height = std::max(left_right_height, right_height) + 1;
+    node->height.store(node_height);
+    left->height.store(std::max(left_left_height, node_height) + 1);
+
+    node->version.store(end_shrink(node_version));
+
+    ptrdiff_t node_diff = left_right_height - right_height;
+    if (node_diff < -1 || node_diff > 1) {
+        return node;
+    }
+    if ((left_right == nullptr || right_height == 0) && !node->present.load()) {
+        return node;
+    }
+    ptrdiff_t left_diff = left_left_height - node_height;
+    if (left_diff < -1 || left_diff > 1) {
+        return left;
+    }
+    if (left_left_height == 0 && !left->present.load()) {
+        return left;
+    }
+    return fix_height_nl(parent);
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::rotate_left_nl(
+        avl_tree_node* parent, avl_tree_node* node, ptrdiff_t left_height, avl_tree_node* right,
+        avl_tree_node* right_left, ptrdiff_t right_left_height, ptrdiff_t right_right_height) noexcept
+{
+    uint64_t node_version = node->version.load();
+    avl_tree_node* parent_left = parent->left.load();
+
+    node->version.store(begin_shrink(node_version));
+
+    node->right.store(right_left);
+    if (right_left != nullptr) {
+        right_left->parent.store(node);
+    }
+    right->left.store(node);
+    node->parent.store(right);
+    if (parent_left == node) {
+        parent->left.store(right);
+    }
+    else {
+        parent->right.store(right);
+    }
+    right->parent.store(parent);
+
+    ptrdiff_t node_height = std::max(left_height, right_left_height) + 1;
+    node->height.store(node_height);
+    right->height.store(std::max(node_height, right_right_height) + 1);
+
+    node->version.store(end_shrink(node_version));
+
+    ptrdiff_t node_diff = right_left_height - left_height;
+    if (node_diff < -1 || node_diff > 1) {
+        return node;
+    }
+    if ((right_left == nullptr || left_height == 0) && !node->present.load()) {
+        return node;
+    }
+    ptrdiff_t right_diff = right_right_height - node_height;
+    if (right_diff < -1 || right_diff > 1) {
+        return right;
+    }
+    if (right_right_height == 0 && !right->present.load()) {
+        return right;
+    }
+    return fix_height_nl(parent);
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::rotate_right_over_left_nl(
+        avl_tree_node* parent, avl_tree_node* node, avl_tree_node* left, ptrdiff_t right_height,
+        ptrdiff_t left_left_height, avl_tree_node* left_right, ptrdiff_t left_right_left_height) noexcept
+{
+    uint64_t node_version = node->version.load();
+    uint64_t left_version = left->version.load();
+    avl_tree_node* parent_left = parent->left.load();
+    avl_tree_node* left_right_left = left_right->left.load();
+    avl_tree_node* left_right_right = left_right->right.load();
+    ptrdiff_t left_right_right_height = height(left_right_right);
+
+    node->version.store(begin_shrink(node_version));
+    left->version.store(begin_shrink(left_version));
+
+    node->left.store(left_right_right);
+    if (left_right_right != nullptr) {
+        left_right_right->parent.store(node);
+    }
+    left->right.store(left_right_left);
+    if (left_right_left != nullptr) {
+        left_right_left->parent.store(left);
+    }
+    left_right->left.store(left);
+    left->parent.store(left_right);
+    left_right->right.store(node);
+    node->parent.store(left_right);
+    if (parent_left == node) {
+        parent->left.store(left_right);
+    }
+    else {
+        parent->right.store(left_right);
+    }
+    left_right->parent.store(parent);
+
+    ptrdiff_t node_height = std::max(left_right_right_height, right_height) + 1;
+    node->height.store(node_height);
+    ptrdiff_t left_new_height = std::max(left_left_height, left_right_left_height) + 1;
+    left->height.store(left_new_height);
+    left_right->height.store(std::max(left_new_height, node_height) + 1);
+
+    node->version.store(end_shrink(node_version));
+    left->version.store(end_shrink(left_version));
+
+    ptrdiff_t node_diff = left_right_right_height - right_height;
+    if (node_diff < -1 || node_diff > 1) {
+        return node;
+    }
+    if ((left_right_right == nullptr || right_height == 0) && !node->present.load()) {
+        return node;
+    }
+    ptrdiff_t top_diff = left_new_height - node_height;
+    if (top_diff < -1 || top_diff > 1) {
+        return left_right;
+    }
+    return fix_height_nl(parent);
+}
+
+template<typename T>
+typename concurrent_avl_tree<T>::avl_tree_node* concurrent_avl_tree<T>::rotate_left_over_right_nl(
+        avl_tree_node* parent, avl_tree_node* node, ptrdiff_t left_height, avl_tree_node* right,
+        avl_tree_node* right_left, ptrdiff_t right_right_height, ptrdiff_t right_left_right_height) noexcept
+{
+    uint64_t node_version = node->version.load();
+    uint64_t right_version = right->version.load();
+    avl_tree_node* parent_left = parent->left.load();
+    avl_tree_node* right_left_left = right_left->left.load();
+    avl_tree_node* right_left_right = right_left->right.load();
+    ptrdiff_t right_left_left_height = height(right_left_left);
+
+    node->version.store(begin_shrink(node_version));
+    right->version.store(begin_shrink(right_version));
+
+    node->right.store(right_left_left);
+    if (right_left_left != nullptr) {
+        right_left_left->parent.store(node);
+    }
+    right->left.store(right_left_right);
+    if (right_left_right != nullptr) {
+        right_left_right->parent.store(right);
+    }
+    right_left->right.store(right);
+    right->parent.store(right_left);
+    right_left->left.store(node);
+    node->parent.store(right_left);
+    if (parent_left == node) {
+        parent->left.store(right_left);
+    }
+    else {
+        parent->right.store(right_left);
+    }
+    right_left->parent.store(parent);
+
+    ptrdiff_t node_height = std::max(left_height, right_left_left_height) + 1;
+    node->height.store(node_height);
+    ptrdiff_t right_new_height = std::max(right_left_right_height, right_right_height) + 1;
+    right->height.store(right_new_height);
+    right_left->height.store(std::max(node_height, right_new_height) + 1);
+
+    node->version.store(end_shrink(node_version));
+    right->version.store(end_shrink(right_version));
+
+    ptrdiff_t node_diff = right_left_left_height - left_height;
+    if (node_diff < -1 || node_diff > 1) {
+        return node;
+    }
+    if ((right_left_left == nullptr || left_height == 0) && !node->present.load()) {
+        return node;
+    }
+    ptrdiff_t top_diff = right_new_height - node_height;
+    if (top_diff < -1 || top_diff > 1) {
+        return right_left;
+    }
+    return fix_height_nl(parent);
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "concurrent_avl_tree.h"
+#include "counted.h"
+
+TEST(concurrent, sequential_matches_std_set)
+{
+    counted::no_new_instances_guard g;
+    {
+        concurrent_avl_tree<counted> c;
+        std::set<int> expected;
+        std::mt19937 rng(42);
+        for (int i = 0; i != 4000; ++i) {
+            int value = static_cast<int>(rng() % 300);
+            switch (rng() % 3) {
+                case 0:
+                    EXPECT_EQ(expected.insert(value).second, c.insert(value));
+                    break;
+                case 1:
+                    EXPECT_EQ(expected.erase(value) == 1, c.erase(value));
+                    break;
+                default:
+                    EXPECT_EQ(expected.count(value) == 1, c.contains(value));
+            }
+        }
+        for (int value = 0; value != 300; ++value) {
+            EXPECT_EQ(expected.count(value) == 1, c.contains(value));
+        }
+    }
+    epoch_synchronize();
+}
+
+TEST(concurrent, erase_routing_nodes)
+{
+    concurrent_avl_tree<int> c;
+    for (int i = 0; i != 1000; ++i) {
+        EXPECT_TRUE(c.insert(i));
+    }
+    for (int i = 0; i != 1000; i += 2) {
+        EXPECT_TRUE(c.erase(i));
+    }
+    for (int i = 0; i != 1000; ++i) {
+        EXPECT_EQ(i % 2 == 1, c.contains(i));
+        EXPECT_EQ(i % 2 == 0, c.insert(i));
+    }
+}
+
+TEST(concurrent, disjoint_inserts_and_erases)
+{
+    concurrent_avl_tree<int> c;
+    size_t const threads_count = 8;
+    int const per_thread = 5000;
+
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t != threads_count; ++t) {
+        threads.emplace_back([&c, t]
+        {
+            for (int i = 0; i != per_thread; ++i) {
+                EXPECT_TRUE(c.insert(i * threads_count + t));
+            }
+            for (int i = 0; i != per_thread; i += 2) {
+                EXPECT_TRUE(c.erase(i * threads_count + t));
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (int i = 0; i != per_thread; ++i) {
+        for (size_t t = 0; t != threads_count; ++t) {
+            EXPECT_EQ(i % 2 == 1, c.contains(i * threads_count + t));
+        }
+    }
+}
+
+// 90% lookups, 10% updates on a small hot key range. Every successful insert
+// and erase is tallied per key; at the end each tally must match presence.
+TEST(concurrent, mixed_stress)
+{
+    concurrent_avl_tree<int> c;
+    size_t const threads_count = 8;
+    int const keys = 512;
+    int const operations = 100000;
+
+    std::vector<std::vector<int>> balance(threads_count, std::vector<int>(keys));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t != threads_count; ++t) {
+        threads.emplace_back([&c, &balance, t]
+        {
+            std::mt19937 rng(static_cast<unsigned>(t));
+            for (int i = 0; i != operations; ++i) {
+                int key = static_cast<int>(rng() % keys);
+                unsigned op = rng() % 20;
+                if (op == 0) {
+                    balance[t][key] += c.insert(key);
+                }
+                else if (op == 1) {
+                    balance[t][key] -= c.erase(key);
+                }
+                else {
+                    c.contains(key);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (int key = 0; key != keys; ++key) {
+        int total = 0;
+        for (size_t t = 0; t != threads_count; ++t) {
+            total += balance[t][key];
+        }
+        EXPECT_TRUE(total == 0 || total == 1);
+        EXPECT_EQ(total == 1, c.contains(key));
+    }
+}
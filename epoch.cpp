@@ -0,0 +1,162 @@
+#include "epoch.h"
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+struct thread_record
+{
+    // announced epoch shifted left by one, lowest bit set while in a guard
+    std::atomic<uint64_t> state{0};
+    std::atomic<bool> in_use{true};
+    thread_record* next = nullptr;
+};
+
+struct retired_list
+{
+    epoch_retired* oldest = nullptr;
+    epoch_retired* newest = nullptr;
+    size_t count = 0;
+
+    void push(epoch_retired* object) noexcept
+    {
+        object->next_retired = nullptr;
+        if (newest)
+            newest->next_retired = object;
+        else
+            oldest = object;
+        newest = object;
+        ++count;
+    }
+
+    void splice(retired_list& other) noexcept
+    {
+        if (!other.oldest)
+            return;
+        if (newest)
+            newest->next_retired = other.oldest;
+        else
+            oldest = other.oldest;
+        newest = other.newest;
+        count += other.count;
+        other = retired_list();
+    }
+
+    void reclaim_until(uint64_t epoch) noexcept
+    {
+        while (oldest && oldest->retire_epoch + 2 <= epoch)
+        {
+            epoch_retired* object = oldest;
+            oldest = object->next_retired;
+            --count;
+            object->reclaim(object);
+        }
+        if (!oldest)
+            newest = nullptr;
+    }
+};
+
+size_t const reclaim_threshold = 128;
+
+std::atomic<uint64_t> global_epoch{0};
+std::atomic<thread_record*> records{nullptr};
+
+std::mutex orphans_lock;
+retired_list orphans;
+
+thread_record* acquire_record()
+{
+    for (thread_record* record = records.load(); record; record = record->next)
+    {
+        bool expected = false;
+        if (!record->in_use.load() && record->in_use.compare_exchange_strong(expected, true))
+            return record;
+    }
+    thread_record* record = new thread_record;
+    record->next = records.load();
+    while (!records.compare_exchange_weak(record->next, record))
+    {}
+    return record;
+}
+
+struct thread_state
+{
+    thread_record* record = acquire_record();
+    size_t depth = 0;
+    retired_list retired;
+
+    ~thread_state()
+    {
+        std::lock_guard<std::mutex> lock(orphans_lock);
+        orphans.splice(retired);
+        record->state.store(0);
+        record->in_use.store(false);
+    }
+};
+
+thread_local thread_state local;
+
+void try_advance() noexcept
+{
+    uint64_t epoch = global_epoch.load();
+    for (thread_record* record = records.load(); record; record = record->next)
+    {
+        uint64_t state = record->state.load();
+        if ((state & 1) && (state >> 1) != epoch)
+            return;
+    }
+    global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+void reclaim_orphans() noexcept
+{
+    std::unique_lock<std::mutex> lock(orphans_lock, std::try_to_lock);
+    if (lock.owns_lock())
+        orphans.reclaim_until(global_epoch.load());
+}
+}
+
+epoch_guard::epoch_guard() noexcept
+{
+    if (local.depth++ == 0)
+    {
+        local.record->state.store((global_epoch.load() << 1) | 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+epoch_guard::~epoch_guard()
+{
+    if (--local.depth == 0)
+        local.record->state.store(0, std::memory_order_release);
+}
+
+void epoch_retire(epoch_retired* object, void (*reclaim)(epoch_retired*)) noexcept
+{
+    object->reclaim = reclaim;
+    object->retire_epoch = global_epoch.load();
+    local.retired.push(object);
+    if (local.retired.count >= reclaim_threshold)
+    {
+        try_advance();
+        local.retired.reclaim_until(global_epoch.load());
+        reclaim_orphans();
+    }
+}
+
+void epoch_synchronize()
+{
+    assert(local.depth == 0);
+    uint64_t target = global_epoch.load() + 2;
+    while (global_epoch.load() < target)
+    {
+        try_advance();
+        if (global_epoch.load() < target)
+            std::this_thread::yield();
+    }
+    local.retired.reclaim_until(global_epoch.load());
+    std::lock_guard<std::mutex> lock(orphans_lock);
+    orphans.reclaim_until(global_epoch.load());
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+// Epoch-based reclamation for lock-free readers. Readers wrap each access in
+// an epoch_guard; writers hand unlinked objects to epoch_retire, which frees
+// them only after every guard that could still see them has been left.
+// Retire lists are per thread, so neither side takes a lock on the fast path.
+
+struct epoch_retired
+{
+    epoch_retired* next_retired = nullptr;
+    uint64_t retire_epoch = 0;
+    void (*reclaim)(epoch_retired*) = nullptr;
+};
+
+struct epoch_guard
+{
+    epoch_guard() noexcept;
+    epoch_guard(epoch_guard const&) = delete;
+    epoch_guard& operator=(epoch_guard const&) = delete;
+    ~epoch_guard();
+};
+
+// The object must already be unreachable for readers entering from now on.
+void epoch_retire(epoch_retired* object, void (*reclaim)(epoch_retired*)) noexcept;
+
+// Waits for a full grace period and frees everything retired by the calling
+// thread and by threads that have exited. Must not be called under a guard.
+void epoch_synchronize();
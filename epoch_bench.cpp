@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "concurrent_avl_tree.h"
+#include "epoch.h"
+#include "seqlock_avl_tree.h"
+
+// Read-side cost of epoch_guard compared with the alternatives a reader
+// would otherwise pay, single threaded and with every thread reading.
+
+namespace
+{
+size_t const iterations = 10000000;
+
+template <typename F>
+double ns_per_op(size_t threads_count, F f)
+{
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t != threads_count; ++t)
+        threads.emplace_back([&f, t]
+        {
+            for (size_t i = 0; i != iterations; ++i)
+                f(t, i);
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void report(char const* name, size_t threads_count, double ns)
+{
+    std::printf("%-28s threads=%-3zu %8.2f ns/op\n", name, threads_count, ns);
+}
+}
+
+int main()
+{
+    std::mutex mutex;
+    concurrent_avl_tree<int> tree;
+    seqlock_avl_tree<int> seqlock_tree;
+    for (int i = 0; i != 1 << 16; ++i)
+    {
+        tree.insert(i * 2);
+        seqlock_tree.insert(i * 2);
+    }
+
+    size_t hw = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t threads_count = 1; threads_count <= hw; threads_count *= 2)
+    {
+        report("empty loop", threads_count, ns_per_op(threads_count, [](size_t, size_t i)
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+            (void) i;
+        }));
+        report("epoch_guard", threads_count, ns_per_op(threads_count, [](size_t, size_t)
+        {
+            epoch_guard guard;
+        }));
+        report("nested epoch_guard", threads_count, ns_per_op(threads_count, [](size_t, size_t)
+        {
+            epoch_guard outer;
+            epoch_guard inner;
+        }));
+        report("std::mutex", threads_count, ns_per_op(threads_count, [&mutex](size_t, size_t)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }));
+        report("concurrent_avl_tree find", threads_count, ns_per_op(threads_count, [&tree](size_t t, size_t i)
+        {
+            tree.contains(static_cast<int>((i * 2654435761u + t) & 0x1ffff));
+        }));
+        report("seqlock_avl_tree find", threads_count, ns_per_op(threads_count, [&seqlock_tree](size_t t, size_t i)
+        {
+            seqlock_tree.contains(static_cast<int>((i * 2654435761u + t) & 0x1ffff));
+        }));
+    }
+}
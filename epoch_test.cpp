@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <thread>
+
+#include "epoch.h"
+
+namespace
+{
+struct tracked : epoch_retired
+{
+    static std::atomic<int> alive;
+
+    tracked()
+    {
+        ++alive;
+    }
+
+    ~tracked()
+    {
+        --alive;
+    }
+
+    static void reclaim(epoch_retired* object) noexcept
+    {
+        delete static_cast<tracked*>(object);
+    }
+};
+
+std::atomic<int> tracked::alive{0};
+}
+
+TEST(epoch, synchronize_reclaims_retired)
+{
+    for (int i = 0; i != 10; ++i) {
+        epoch_retire(new tracked, tracked::reclaim);
+    }
+    epoch_synchronize();
+    EXPECT_EQ(0, tracked::alive.load());
+}
+
+TEST(epoch, nested_guards)
+{
+    {
+        epoch_guard outer;
+        {
+            epoch_guard inner;
+            epoch_retire(new tracked, tracked::reclaim);
+        }
+        EXPECT_EQ(1, tracked::alive.load());
+    }
+    epoch_synchronize();
+    EXPECT_EQ(0, tracked::alive.load());
+}
+
+TEST(epoch, active_reader_delays_reclamation)
+{
+    std::atomic<bool> entered{false};
+    std::atomic<bool> release{false};
+    std::thread reader([&]
+    {
+        epoch_guard guard;
+        entered.store(true);
+        while (!release.load()) {
+            std::this_thread::yield();
+        }
+    });
+    while (!entered.load()) {
+        std::this_thread::yield();
+    }
+
+    for (int i = 0; i != 1000; ++i) {
+        epoch_retire(new tracked, tracked::reclaim);
+    }
+    EXPECT_EQ(1000, tracked::alive.load());
+
+    release.store(true);
+    reader.join();
+    epoch_synchronize();
+    EXPECT_EQ(0, tracked::alive.load());
+}
+
+TEST(epoch, exited_threads_hand_over_their_lists)
+{
+    std::thread writer([]
+    {
+        for (int i = 0; i != 10; ++i) {
+            epoch_retire(new tracked, tracked::reclaim);
+        }
+    });
+    writer.join();
+    epoch_synchronize();
+    EXPECT_EQ(0, tracked::alive.load());
+}
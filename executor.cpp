@@ -0,0 +1,219 @@
+#include "executor.h"
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+thread_local thread_pool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+}
+
+void inline_executor::submit(std::function<void()> task)
+{
+    task();
+}
+
+bool inline_executor::try_run_one()
+{
+    return false;
+}
+
+size_t inline_executor::concurrency() const noexcept
+{
+    return 1;
+}
+
+thread_pool::thread_pool(size_t threads_count)
+{
+    threads_count = std::max<size_t>(threads_count, 1);
+    // the last queue is the shared one for tasks from outside the pool
+    for (size_t i = 0; i != threads_count + 1; ++i)
+        queues.push_back(std::make_unique<task_queue>());
+    try
+    {
+        for (size_t i = 0; i != threads_count; ++i)
+            threads.emplace_back([this, i] { run(i); });
+    }
+    catch (...)
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleep_lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+        throw;
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+    task_queue& queue = current_pool == this ? *queues[current_index] : *queues.back();
+    {
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    queued.fetch_add(1);
+    // a worker that saw nothing queued is either not yet waiting, and will
+    // see the new count, or already waiting and gets the notification
+    {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+    }
+    wake.notify_one();
+}
+
+bool thread_pool::take(std::function<void()>& task)
+{
+    bool is_worker = current_pool == this;
+    if (is_worker)
+    {
+        task_queue& own = *queues[current_index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    size_t start = is_worker ? current_index + 1 : queues.size() - 1;
+    for (size_t i = 0; i != queues.size(); ++i)
+    {
+        size_t index = (start + i) % queues.size();
+        if (is_worker && index == current_index)
+            continue;
+        task_queue& other = *queues[index];
+        std::lock_guard<std::mutex> guard(other.lock);
+        if (!other.tasks.empty())
+        {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            if (index != queues.size() - 1)
+                stolen.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool thread_pool::try_run_one()
+{
+    if (queued.load() == 0)
+        return false;
+    std::function<void()> task;
+    if (!take(task))
+        return false;
+    queued.fetch_sub(1);
+    task();
+    executed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+size_t thread_pool::concurrency() const noexcept
+{
+    return threads.size();
+}
+
+thread_pool::statistics thread_pool::stats() const noexcept
+{
+    statistics result;
+    result.executed = executed.load(std::memory_order_relaxed);
+    result.stolen = stolen.load(std::memory_order_relaxed);
+    result.idle = idle.load(std::memory_order_relaxed);
+    return result;
+}
+
+thread_pool& thread_pool::global()
+{
+    static thread_pool instance;
+    return instance;
+}
+
+void thread_pool::run(size_t index)
+{
+    current_pool = this;
+    current_index = index;
+    while (true)
+    {
+        if (try_run_one())
+            continue;
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        if (queued.load() != 0)
+            continue;
+        if (stopping)
+            return;
+        idle.fetch_add(1, std::memory_order_relaxed);
+        wake.wait(guard, [this] { return stopping || queued.load() != 0; });
+    }
+}
+
+task_group::task_group(executor& exec) noexcept
+    : exec(exec)
+{}
+
+task_group::~task_group()
+{
+    wait_idle();
+}
+
+void task_group::run(std::function<void()> task)
+{
+    pending.fetch_add(1);
+    try
+    {
+        exec.submit([this, task = std::move(task)]() mutable
+        {
+            try
+            {
+                task();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(error_lock);
+                if (!error)
+                    error = std::current_exception();
+            }
+            // whatever the task captured goes before the waiter may return
+            task = nullptr;
+            pending.fetch_sub(1, std::memory_order_release);
+        });
+    }
+    catch (...)
+    {
+        pending.fetch_sub(1);
+        throw;
+    }
+}
+
+void task_group::wait()
+{
+    wait_idle();
+    std::exception_ptr first;
+    {
+        std::lock_guard<std::mutex> guard(error_lock);
+        first = std::exchange(error, nullptr);
+    }
+    if (first)
+        std::rethrow_exception(first);
+}
+
+void task_group::wait_idle() noexcept
+{
+    while (pending.load(std::memory_order_acquire) != 0)
+    {
+        if (!exec.try_run_one())
+            std::this_thread::yield();
+    }
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Where the parallel tree algorithms run their tasks. Implement this to
+// put tree work on an existing scheduler; tasks passed to submit do not
+// throw. try_run_one lets a thread that waits for tasks help with them.
+struct executor
+{
+    virtual ~executor() = default;
+    virtual void submit(std::function<void()> task) = 0;
+    virtual bool try_run_one() = 0;
+    virtual size_t concurrency() const noexcept = 0;
+};
+
+// Runs every task on the calling thread as it is submitted.
+struct inline_executor : executor
+{
+    void submit(std::function<void()> task) override;
+    bool try_run_one() override;
+    size_t concurrency() const noexcept override;
+};
+
+// Every worker owns a deque: it pushes and pops its own tasks at the back
+// and steals from the front of the others' when it runs dry. Tasks from
+// outside the pool go to a shared deque.
+struct thread_pool : executor
+{
+    struct statistics
+    {
+        uint64_t executed = 0;
+        // tasks a worker took from another worker's deque
+        uint64_t stolen = 0;
+        // times a worker found nothing to do and went to sleep
+        uint64_t idle = 0;
+    };
+
+    explicit thread_pool(size_t threads_count = std::thread::hardware_concurrency());
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+    // Runs the tasks still queued, then joins the workers.
+    ~thread_pool() override;
+
+    void submit(std::function<void()> task) override;
+    bool try_run_one() override;
+    size_t concurrency() const noexcept override;
+    statistics stats() const noexcept;
+
+    static thread_pool& global();
+
+private:
+    struct task_queue
+    {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool take(std::function<void()>& task);
+    void run(size_t index);
+
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> queued{0};
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::atomic<uint64_t> executed{0};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> idle{0};
+};
+
+// Tasks that are waited for together. wait runs queued tasks of the
+// executor while it waits, so nested groups cannot starve the pool, and
+// rethrows the first exception a task threw.
+struct task_group
+{
+    explicit task_group(executor& exec) noexcept;
+    task_group(task_group const&) = delete;
+    task_group& operator=(task_group const&) = delete;
+    ~task_group();
+
+    void run(std::function<void()> task);
+    void wait();
+
+private:
+    void wait_idle() noexcept;
+
+    executor& exec;
+    std::atomic<size_t> pending{0};
+    std::mutex error_lock;
+    std::exception_ptr error;
+};
+
+// Execution policies for the tree algorithms. par runs on the global pool
+// unless given another executor; grain is roughly how many elements a task
+// should at least get before it is worth splitting off.
+namespace avl_execution
+{
+struct sequenced_policy
+{
+};
+
+struct parallel_policy
+{
+    executor* exec = nullptr;
+    size_t grain = 2048;
+
+    parallel_policy on(executor& other) const noexcept
+    {
+        parallel_policy result = *this;
+        result.exec = &other;
+        return result;
+    }
+
+    parallel_policy with_grain(size_t other) const noexcept
+    {
+        parallel_policy result = *this;
+        result.grain = other == 0 ? 1 : other;
+        return result;
+    }
+
+    executor& get_executor() const
+    {
+        return exec ? *exec : thread_pool::global();
+    }
+};
+
+inline constexpr sequenced_policy seq{};
+inline constexpr parallel_policy par{};
+}
@@ -0,0 +1,137 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "avl_tree.h"
+#include "executor.h"
+
+TEST(executor, pool_runs_every_task)
+{
+    thread_pool pool(4);
+    std::atomic<int> sum{0};
+    {
+        task_group group(pool);
+        for (int i = 1; i <= 1000; ++i) {
+            group.run([&sum, i] { sum += i; });
+        }
+        group.wait();
+    }
+    EXPECT_EQ(500500, sum.load());
+    EXPECT_EQ(1000u, pool.stats().executed);
+}
+
+TEST(executor, nested_groups_do_not_starve)
+{
+    // one worker, and every task waits for tasks of its own
+    thread_pool pool(1);
+    std::atomic<int> leaves{0};
+    task_group outer(pool);
+    for (int i = 0; i != 8; ++i) {
+        outer.run([&pool, &leaves]
+        {
+            task_group inner(pool);
+            for (int j = 0; j != 8; ++j) {
+                inner.run([&leaves] { ++leaves; });
+            }
+            inner.wait();
+        });
+    }
+    outer.wait();
+    EXPECT_EQ(64, leaves.load());
+}
+
+TEST(executor, wait_rethrows_first_error)
+{
+    thread_pool pool(2);
+    task_group group(pool);
+    std::atomic<int> ran{0};
+    for (int i = 0; i != 16; ++i) {
+        group.run([&ran, i]
+        {
+            ++ran;
+            if (i % 4 == 0) {
+                throw std::runtime_error("task");
+            }
+        });
+    }
+    EXPECT_THROW(group.wait(), std::runtime_error);
+    EXPECT_EQ(16, ran.load());
+    group.wait();
+}
+
+TEST(executor, idle_workers_steal)
+{
+    thread_pool pool(4);
+    std::atomic<int> done{0};
+    std::atomic<bool> finished{false};
+    // submitted directly, so that the test thread does not pick it up
+    // while waiting; the tasks it queues then go to a worker's own deque
+    pool.submit([&pool, &done, &finished]
+    {
+        task_group inner(pool);
+        for (int i = 0; i != 64; ++i) {
+            inner.run([&done]
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                ++done;
+            });
+        }
+        inner.wait();
+        finished = true;
+    });
+    while (!finished) {
+        std::this_thread::yield();
+    }
+    EXPECT_EQ(64, done.load());
+    EXPECT_GT(pool.stats().stolen, 0u);
+}
+
+TEST(executor, tree_algorithms_on_inline_executor)
+{
+    inline_executor exec;
+    auto policy = avl_execution::par.on(exec).with_grain(16);
+
+    std::vector<int> values(5000);
+    std::iota(values.begin(), values.end(), 0);
+    avl_tree<int> c;
+    c.assign_sorted(policy, values.begin(), values.end());
+    avl_tree<int> copy(c, policy);
+    EXPECT_EQ(12497500ll, copy.reduce(policy, copy.begin(), copy.end(), 0ll, std::plus<>()));
+
+    std::vector<int> odd;
+    for (int i = 1; i < 10000; i += 2) {
+        odd.push_back(i);
+    }
+    std::vector<bool> erased = c.erase_batch(policy, odd.data(), odd.data() + odd.size());
+    EXPECT_EQ(2500, std::count(erased.begin(), erased.end(), true));
+    std::vector<bool> inserted = c.insert_batch(policy, odd.data(), odd.data() + odd.size());
+    EXPECT_EQ(5000, std::count(inserted.begin(), inserted.end(), true));
+
+    std::vector<int> expected(values.begin(), values.end());
+    for (int i = 5001; i < 10000; i += 2) {
+        expected.push_back(i);
+    }
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+}
+
+TEST(executor, tree_algorithms_on_own_pool)
+{
+    thread_pool pool(3);
+    auto policy = avl_execution::par.on(pool).with_grain(64);
+
+    std::vector<int> values(20000);
+    std::iota(values.begin(), values.end(), 0);
+    avl_tree<int> c;
+    c.assign_sorted(policy, values.begin(), values.end());
+    avl_tree<int> copy(c, policy);
+    std::atomic<long long> sum{0};
+    copy.for_each(policy, copy.begin(), copy.end(), [&sum](int value) { sum += value; });
+    EXPECT_EQ(199990000ll, sum.load());
+    EXPECT_GT(pool.stats().executed, 0u);
+}
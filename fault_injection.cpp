@@ -41,6 +41,16 @@ struct fault_injection_context
 
 thread_local bool disabled = false;
 thread_local fault_injection_context* context = nullptr;
+thread_local operation_counter* counter = nullptr;
+
+void count_allocation(std::size_t count)
+{
+    if (counter)
+    {
+        ++counter->allocations;
+        counter->allocated_bytes += count;
+    }
+}
 
 void dump_state()
 {
@@ -90,6 +100,8 @@ bool should_inject_fault()
 
 void fault_injection_point()
 {
+    if (counter)
+        ++counter->comparisons;
     if (should_inject_fault())
         throw injected_fault("injected fault");
 }
@@ -134,8 +146,20 @@ fault_injection_disable::~fault_injection_disable()
     disabled = was_disabled;
 }
 
+operation_counter::operation_counter()
+        : outer(counter)
+{
+    counter = this;
+}
+
+operation_counter::~operation_counter()
+{
+    counter = outer;
+}
+
 void* operator new(std::size_t count)
 {
+    count_allocation(count);
     if (should_inject_fault())
         throw std::bad_alloc();
 
@@ -148,6 +172,7 @@ void* operator new(std::size_t count)
 
 void* operator new[](std::size_t count)
 {
+    count_allocation(count);
     if (should_inject_fault())
         throw std::bad_alloc();
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <functional>
 #include <stdexcept>
 
@@ -21,4 +22,23 @@ struct fault_injection_disable
 
 private:
     bool was_disabled;
-};
\ No newline at end of file
+};
+
+// Counts what passes through the hooks above on this thread while it is
+// alive: fault_injection_point calls, which counted makes once per
+// comparison, and operator new calls with the bytes they asked for. Only
+// the innermost of nested counters counts.
+struct operation_counter
+{
+    size_t comparisons = 0;
+    size_t allocations = 0;
+    size_t allocated_bytes = 0;
+
+    operation_counter();
+    operation_counter(operation_counter const&) = delete;
+    operation_counter& operator=(operation_counter const&) = delete;
+    ~operation_counter();
+
+private:
+    operation_counter* outer;
+};
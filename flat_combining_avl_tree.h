@@ -0,0 +1,63 @@
+#ifndef FLAT_COMBINING_AVL_TREE_H
+#define FLAT_COMBINING_AVL_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <vector>
+
+#include <avl_tree.h>
+
+// Thread-safe front end for avl_tree under heavy update contention. Each
+// thread posts its operation to a slot of its own and whoever gets the
+// combiner lock applies every posted operation, sorted by value. Runs of
+// inserts or erases in that order are applied with insert_batch and
+// erase_batch, which share one walk down the tree; lookups still search
+// one by one. Waiting threads spin on their own slot and only try to take
+// the combiner flag when it looks clear.
+template<typename T>
+struct flat_combining_avl_tree {
+private:
+    enum class operation {
+        contains, insert, erase
+    };
+
+    enum : int {
+        idle, claimed, posted, done
+    };
+
+    struct alignas(64) slot {
+        std::atomic<int> state{idle};
+        operation op = operation::contains;
+        T const* value = nullptr;
+        bool result = false;
+        std::exception_ptr error{};
+    };
+
+    static constexpr size_t slots_count = 64;
+
+    avl_tree<T> tree;
+    // copies of a run's values for the batch calls, kept to reuse its memory
+    std::vector<T> run_values;
+    alignas(64) std::atomic<bool> combining{false};
+    slot slots[slots_count];
+
+    static size_t preferred_slot() noexcept;
+    slot& claim() noexcept;
+    bool apply(operation, T const&);
+    void apply_run(operation, size_t const*, size_t) noexcept;
+    void combine() noexcept;
+    bool execute(operation, T const&);
+
+public:
+    flat_combining_avl_tree() noexcept;
+    flat_combining_avl_tree(flat_combining_avl_tree const&) = delete;
+    flat_combining_avl_tree& operator=(flat_combining_avl_tree const&) = delete;
+
+    bool contains(T const&);
+    bool insert(T const&);
+    bool erase(T const&);
+};
+
+#include <flat_combining_avl_tree.tpp>
+#endif //FLAT_COMBINING_AVL_TREE_H
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+template<typename T>
+flat_combining_avl_tree<T>::flat_combining_avl_tree() noexcept { }
+
+// Threads are numbered on first use, so up to slots_count threads each get
+// a slot nobody else tries first.
+template<typename T>
+size_t flat_combining_avl_tree<T>::preferred_slot() noexcept
+{
+    static std::atomic<size_t> next{0};
+    thread_local size_t const index = next.fetch_add(1, std::memory_order_relaxed) % slots_count;
+    return index;
+}
+
+template<typename T>
+typename flat_combining_avl_tree<T>::slot& flat_combining_avl_tree<T>::claim() noexcept
+{
+    for (size_t i = preferred_slot();; i = (i + 1) % slots_count) {
+        int expected = idle;
+        if (slots[i].state.load(std::memory_order_relaxed) == idle &&
+            slots[i].state.compare_exchange_strong(expected, claimed, std::memory_order_acquire)) {
+            return slots[i];
+        }
+    }
+}
+
+template<typename T>
+bool flat_combining_avl_tree<T>::apply(operation op, T const& value)
+{
+    switch (op) {
+        case operation::contains:
+            return tree.find(value) != tree.end();
+        case operation::insert:
+            return tree.insert(value).second;
+        case operation::erase: {
+            auto it = tree.find(value);
+            if (it == tree.end()) {
+                return false;
+            }
+            tree.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+// A run of inserts or erases goes to the tree as one batch, which walks
+// the tree once for the whole run. Repeated values in a run only take
+// effect the first time, in slot order, as they would one by one.
+template<typename T>
+void flat_combining_avl_tree<T>::apply_run(operation op, size_t const* run, size_t run_size) noexcept
+{
+    if (op == operation::contains || run_size == 1) {
+        for (size_t i = 0; i != run_size; ++i) {
+            slot& s = slots[run[i]];
+            try {
+                s.result = apply(op, *s.value);
+            }
+            catch (...) {
+                s.error = std::current_exception();
+            }
+        }
+        return;
+    }
+    try {
+        run_values.clear();
+        for (size_t i = 0; i != run_size; ++i) {
+            run_values.push_back(*slots[run[i]].value);
+        }
+        T const* first = run_values.data();
+        std::vector<bool> changed = op == operation::insert ? tree.insert_batch(first, first + run_size)
+                                                            : tree.erase_batch(first, first + run_size);
+        for (size_t i = 0; i != run_size; ++i) {
+            slots[run[i]].result = changed[i];
+        }
+    }
+    catch (...) {
+        // the batch left the tree unchanged, so every operation in it failed
+        for (size_t i = 0; i != run_size; ++i) {
+            slots[run[i]].error = std::current_exception();
+        }
+    }
+}
+
+template<typename T>
+void flat_combining_avl_tree<T>::combine() noexcept
+{
+    size_t batch[slots_count];
+    size_t batch_size = 0;
+    for (size_t i = 0; i != slots_count; ++i) {
+        if (slots[i].state.load(std::memory_order_acquire) == posted) {
+            batch[batch_size++] = i;
+        }
+    }
+    if (batch_size > 1) {
+        try {
+            std::sort(batch, batch + batch_size, [this](size_t a, size_t b)
+            {
+                return *slots[a].value < *slots[b].value || (!(*slots[b].value < *slots[a].value) && a < b);
+            });
+        }
+        catch (...) {
+            // any order is still a valid batch, it just shares fewer paths
+        }
+    }
+    for (size_t first = 0, last; first != batch_size; first = last) {
+        operation op = slots[batch[first]].op;
+        for (last = first + 1; last != batch_size && slots[batch[last]].op == op; ++last) {
+        }
+        apply_run(op, batch + first, last - first);
+        for (size_t i = first; i != last; ++i) {
+            slots[batch[i]].state.store(done, std::memory_order_release);
+        }
+    }
+}
+
+template<typename T>
+bool flat_combining_avl_tree<T>::execute(operation op, T const& value)
+{
+    slot& s = claim();
+    s.op = op;
+    s.value = &value;
+    s.state.store(posted, std::memory_order_release);
+    for (size_t spins = 0; s.state.load(std::memory_order_acquire) != done; ++spins) {
+        if (!combining.load(std::memory_order_relaxed) &&
+            !combining.exchange(true, std::memory_order_acquire)) {
+            combine();
+            combining.store(false, std::memory_order_release);
+        }
+        else if (spins % 64 == 63) {
+            std::this_thread::yield();
+        }
+    }
+    bool result = s.result;
+    std::exception_ptr error = std::move(s.error);
+    s.error = nullptr;
+    s.state.store(idle, std::memory_order_release);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return result;
+}
+
+template<typename T>
+bool flat_combining_avl_tree<T>::contains(T const& value)
+{
+    return execute(operation::contains, value);
+}
+
+template<typename T>
+bool flat_combining_avl_tree<T>::insert(T const& value)
+{
+    return execute(operation::insert, value);
+}
+
+template<typename T>
+bool flat_combining_avl_tree<T>::erase(T const& value)
+{
+    return execute(operation::erase, value);
+}
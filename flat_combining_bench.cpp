@@ -0,0 +1,80 @@
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "avl_tree.h"
+#include "flat_combining_avl_tree.h"
+
+// Update throughput of flat combining against one mutex around avl_tree,
+// every thread doing an even mix of inserts and erases on random keys.
+
+namespace
+{
+size_t const total_operations = 2000000;
+int const keys = 1 << 16;
+
+template <typename F>
+double ns_per_op(size_t threads_count, F f)
+{
+    size_t per_thread = total_operations / threads_count;
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t != threads_count; ++t)
+        threads.emplace_back([&f, t, per_thread]
+        {
+            std::mt19937 rng(static_cast<unsigned>(t));
+            for (size_t i = 0; i != per_thread; ++i)
+            {
+                int key = static_cast<int>(rng() % keys);
+                f(key, (rng() & 1) != 0);
+            }
+        });
+    for (std::thread& thread : threads)
+        thread.join();
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (per_thread * threads_count);
+}
+
+void report(char const* name, size_t threads_count, double ns)
+{
+    std::printf("%-28s threads=%-3zu %8.2f ns/op\n", name, threads_count, ns);
+}
+}
+
+int main()
+{
+    for (size_t threads_count = 1; threads_count <= 64; threads_count *= 2)
+    {
+        std::mutex mutex;
+        avl_tree<int> locked;
+        flat_combining_avl_tree<int> combined;
+        for (int i = 0; i < keys; i += 2)
+        {
+            locked.insert(i);
+            combined.insert(i);
+        }
+
+        report("std::mutex + avl_tree", threads_count, ns_per_op(threads_count, [&mutex, &locked](int key, bool insert)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (insert)
+                locked.insert(key);
+            else
+            {
+                auto it = locked.find(key);
+                if (it != locked.end())
+                    locked.erase(it);
+            }
+        }));
+        report("flat_combining_avl_tree", threads_count, ns_per_op(threads_count, [&combined](int key, bool insert)
+        {
+            if (insert)
+                combined.insert(key);
+            else
+                combined.erase(key);
+        }));
+    }
+}
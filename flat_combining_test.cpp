@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "counted.h"
+#include "fault_injection.h"
+#include "flat_combining_avl_tree.h"
+
+TEST(flat_combining, sequential_matches_std_set)
+{
+    counted::no_new_instances_guard g;
+
+    flat_combining_avl_tree<counted> c;
+    std::set<int> expected;
+    std::mt19937 rng(3);
+    for (int i = 0; i != 4000; ++i) {
+        int value = static_cast<int>(rng() % 300);
+        switch (rng() % 3) {
+            case 0:
+                EXPECT_EQ(expected.insert(value).second, c.insert(value));
+                break;
+            case 1:
+                EXPECT_EQ(expected.erase(value) == 1, c.erase(value));
+                break;
+            default:
+                EXPECT_EQ(expected.count(value) == 1, c.contains(value));
+        }
+    }
+}
+
+TEST(flat_combining, errors_reach_the_caller)
+{
+    faulty_run([]
+    {
+        flat_combining_avl_tree<counted> c;
+        c.insert(1);
+        c.insert(3);
+        try {
+            c.insert(2);
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            EXPECT_TRUE(c.contains(1));
+            EXPECT_FALSE(c.contains(2));
+            EXPECT_TRUE(c.contains(3));
+            throw;
+        }
+        fault_injection_disable dg;
+        EXPECT_TRUE(c.contains(2));
+    });
+}
+
+// More threads than slots, so some of them share a slot sequence.
+TEST(flat_combining, concurrent_updates)
+{
+    flat_combining_avl_tree<int> c;
+    size_t const threads_count = 72;
+    int const keys = 256;
+    int const operations = 5000;
+
+    std::vector<std::vector<int>> balance(threads_count, std::vector<int>(keys));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t != threads_count; ++t) {
+        threads.emplace_back([&c, &balance, t]
+        {
+            std::mt19937 rng(static_cast<unsigned>(t));
+            for (int i = 0; i != operations; ++i) {
+                int key = static_cast<int>(rng() % keys);
+                switch (rng() % 3) {
+                    case 0:
+                        balance[t][key] += c.insert(key);
+                        break;
+                    case 1:
+                        balance[t][key] -= c.erase(key);
+                        break;
+                    default:
+                        c.contains(key);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    for (int key = 0; key != keys; ++key) {
+        int total = 0;
+        for (size_t t = 0; t != threads_count; ++t) {
+            total += balance[t][key];
+        }
+        EXPECT_TRUE(total == 0 || total == 1);
+        EXPECT_EQ(total == 1, c.contains(key));
+    }
+}
@@ -0,0 +1,116 @@
+#ifndef FROZEN_AVL_TREE_H
+#define FROZEN_AVL_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <ostream>
+#include <type_traits>
+#include <vector>
+
+#include <avl_tree_serializer.h>
+
+// Read-only tree that is queried in place from a mapped file. Nodes are
+// stored in ascending order and link to their children by index, so opening
+// a file only maps it and checks the header, the OS pages nodes in as
+// lookups touch them, and iterating is a walk over consecutive nodes.
+// Values are stored as their bytes in native byte order.
+template<typename T>
+struct frozen_avl_tree {
+    static_assert(std::is_trivially_copyable_v<T>, "frozen_avl_tree stores values as raw bytes");
+
+private:
+    struct frozen_node {
+        T value;
+        // index + 1 of the child, 0 for none
+        uint64_t left;
+        uint64_t right;
+    };
+
+    struct file_header {
+        char magic[4];
+        uint32_t version;
+        uint32_t value_size;
+        uint32_t node_size;
+        uint64_t count;
+        uint64_t root;
+        uint64_t nodes_offset;
+    };
+
+    static constexpr char expected_magic[4] = {'A', 'V', 'L', 'F'};
+    static constexpr uint32_t current_version = 1;
+    // write splits every range at the middle, so no path from the root of
+    // a tree of 2^64 - 1 nodes or fewer is longer
+    static constexpr size_t max_depth = 64;
+
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    frozen_node const* nodes = nullptr;
+    size_t count = 0;
+    uint64_t root = 0;
+
+    static uint64_t nodes_offset() noexcept;
+    static uint64_t link(std::vector<frozen_node>&, size_t, size_t) noexcept;
+    frozen_node const* child(uint64_t, size_t&) const;
+    frozen_node const* lower_bound_node(T const&) const;
+    frozen_node const* upper_bound_node(T const&) const;
+    void unmap() noexcept;
+
+public:
+    struct const_iterator {
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+        const_iterator() noexcept = default;
+
+        reference operator*() const noexcept { return node->value; }
+        pointer operator->() const noexcept { return &node->value; }
+        const_iterator& operator++() noexcept { ++node; return *this; }
+        const_iterator operator++(int) noexcept { const_iterator old = *this; ++node; return old; }
+        const_iterator& operator--() noexcept { --node; return *this; }
+        const_iterator operator--(int) noexcept { const_iterator old = *this; --node; return old; }
+        friend bool operator==(const_iterator a, const_iterator b) noexcept { return a.node == b.node; }
+        friend bool operator!=(const_iterator a, const_iterator b) noexcept { return a.node != b.node; }
+
+    private:
+        friend struct frozen_avl_tree;
+        explicit const_iterator(frozen_node const* node) noexcept : node(node) { }
+
+        frozen_node const* node = nullptr;
+    };
+    using iterator = const_iterator;
+
+    // Writes a strictly increasing range as a file that can be opened.
+    template<typename InputIt>
+    static void write(std::ostream&, InputIt, InputIt);
+
+    frozen_avl_tree() noexcept;
+    // Maps the file; throws std::system_error if it cannot be read and
+    // avl_tree_snapshot_error if it was not written by write for this T.
+    // Only the header is checked here; lookups throw avl_tree_snapshot_error
+    // when they come across a damaged link.
+    explicit frozen_avl_tree(char const* path);
+    frozen_avl_tree(frozen_avl_tree const&) = delete;
+    frozen_avl_tree(frozen_avl_tree&&) noexcept;
+    frozen_avl_tree& operator=(frozen_avl_tree const&) = delete;
+    frozen_avl_tree& operator=(frozen_avl_tree&&) noexcept;
+    ~frozen_avl_tree();
+
+    const_iterator find(T const&) const;
+    const_iterator lower_bound(T const&) const;
+    const_iterator upper_bound(T const&) const;
+    const_iterator begin() const noexcept;
+    const_iterator end() const noexcept;
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+
+    // Lookups are expected to be scattered, so the mapping is opened with
+    // random-access advice; call this before a full scan to read it ahead.
+    void prefetch() const noexcept;
+};
+
+#include <frozen_avl_tree.tpp>
+#endif //FROZEN_AVL_TREE_H
@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <mman.h>
+
+template<typename T>
+uint64_t frozen_avl_tree<T>::nodes_offset() noexcept
+{
+    return (sizeof(file_header) + alignof(frozen_node) - 1) / alignof(frozen_node) * alignof(frozen_node);
+}
+
+// Same shape as avl_tree::build_sorted: the middle of every range is the
+// root of its subtree, so the heights on both sides differ by at most one.
+template<typename T>
+uint64_t frozen_avl_tree<T>::link(std::vector<frozen_node>& nodes, size_t lo, size_t hi) noexcept
+{
+    if (lo == hi) {
+        return 0;
+    }
+    size_t mid = lo + (hi - lo) / 2;
+    nodes[mid].left = link(nodes, lo, mid);
+    nodes[mid].right = link(nodes, mid + 1, hi);
+    return mid + 1;
+}
+
+template<typename T>
+template<typename InputIt>
+void frozen_avl_tree<T>::write(std::ostream& out, InputIt first, InputIt last)
+{
+    std::vector<frozen_node> nodes;
+    for (; first != last; ++first) {
+        nodes.push_back(frozen_node{*first, 0, 0});
+    }
+    file_header header{};
+    std::copy(std::begin(expected_magic), std::end(expected_magic), header.magic);
+    header.version = current_version;
+    header.value_size = sizeof(T);
+    header.node_size = sizeof(frozen_node);
+    header.count = nodes.size();
+    header.root = link(nodes, 0, nodes.size());
+    header.nodes_offset = nodes_offset();
+
+    char const padding[alignof(frozen_node)] = {};
+    out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    out.write(padding, nodes_offset() - sizeof(header));
+    out.write(reinterpret_cast<char const*>(nodes.data()), nodes.size() * sizeof(frozen_node));
+    if (!out) {
+        throw avl_tree_snapshot_error("frozen_avl_tree: write failed");
+    }
+}
+
+template<typename T>
+frozen_avl_tree<T>::frozen_avl_tree() noexcept { }
+
+template<typename T>
+frozen_avl_tree<T>::frozen_avl_tree(char const* path)
+{
+    int flags = O_RDONLY;
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
+    int fd = open(path, flags);
+    if (fd == -1) {
+        throw std::system_error(errno, std::generic_category(), "frozen_avl_tree: open");
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "frozen_avl_tree: stat");
+    }
+    mapping_size = static_cast<size_t>(info.st_size);
+    if (mapping_size < sizeof(file_header)) {
+        close(fd);
+        throw avl_tree_snapshot_error("frozen_avl_tree: file too short");
+    }
+    void* mapped = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    // the mapping keeps the file alive by itself
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), "frozen_avl_tree: mmap");
+    }
+    mapping = mapped;
+
+    file_header const& header = *static_cast<file_header const*>(mapping);
+    char const* failure = nullptr;
+    if (!std::equal(std::begin(header.magic), std::end(header.magic), expected_magic)) {
+        failure = "frozen_avl_tree: not a frozen tree";
+    }
+    else if (header.version != current_version) {
+        failure = "frozen_avl_tree: unsupported version";
+    }
+    else if (header.value_size != sizeof(T) || header.node_size != sizeof(frozen_node) ||
+             header.nodes_offset != nodes_offset()) {
+        failure = "frozen_avl_tree: written for another value type";
+    }
+    else if (header.count > (mapping_size - nodes_offset()) / sizeof(frozen_node) || header.root > header.count) {
+        failure = "frozen_avl_tree: file is truncated";
+    }
+    if (failure) {
+        unmap();
+        throw avl_tree_snapshot_error(failure);
+    }
+    nodes = reinterpret_cast<frozen_node const*>(static_cast<char const*>(mapping) + nodes_offset());
+    count = static_cast<size_t>(header.count);
+    root = header.root;
+    madvise(mapping, mapping_size, MADV_RANDOM);
+}
+
+template<typename T>
+frozen_avl_tree<T>::frozen_avl_tree(frozen_avl_tree&& other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)),
+      mapping_size(std::exchange(other.mapping_size, 0)),
+      nodes(std::exchange(other.nodes, nullptr)),
+      count(std::exchange(other.count, 0)),
+      root(std::exchange(other.root, 0)) { }
+
+template<typename T>
+frozen_avl_tree<T>& frozen_avl_tree<T>::operator=(frozen_avl_tree&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        mapping = std::exchange(other.mapping, nullptr);
+        mapping_size = std::exchange(other.mapping_size, 0);
+        nodes = std::exchange(other.nodes, nullptr);
+        count = std::exchange(other.count, 0);
+        root = std::exchange(other.root, 0);
+    }
+    return *this;
+}
+
+template<typename T>
+frozen_avl_tree<T>::~frozen_avl_tree()
+{
+    unmap();
+}
+
+template<typename T>
+void frozen_avl_tree<T>::unmap() noexcept
+{
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+    nodes = nullptr;
+    count = 0;
+    root = 0;
+}
+
+// Links are only checked as lookups follow them, so opening stays O(1).
+// A link past the last node or a path longer than write can produce
+// means the file is damaged, which also stops a cycle of links.
+template<typename T>
+typename frozen_avl_tree<T>::frozen_node const* frozen_avl_tree<T>::child(uint64_t index, size_t& depth) const
+{
+    if (index > count || ++depth > max_depth) {
+        throw avl_tree_snapshot_error("frozen_avl_tree: file is corrupt");
+    }
+    return nodes + (index - 1);
+}
+
+template<typename T>
+typename frozen_avl_tree<T>::frozen_node const* frozen_avl_tree<T>::lower_bound_node(T const& value) const
+{
+    frozen_node const* result = nodes + count;
+    size_t depth = 0;
+    for (uint64_t index = root; index != 0;) {
+        frozen_node const* node = child(index, depth);
+        if (node->value < value) {
+            index = node->right;
+        }
+        else {
+            result = node;
+            index = node->left;
+        }
+    }
+    return result;
+}
+
+template<typename T>
+typename frozen_avl_tree<T>::frozen_node const* frozen_avl_tree<T>::upper_bound_node(T const& value) const
+{
+    frozen_node const* result = nodes + count;
+    size_t depth = 0;
+    for (uint64_t index = root; index != 0;) {
+        frozen_node const* node = child(index, depth);
+        if (value < node->value) {
+            result = node;
+            index = node->left;
+        }
+        else {
+            index = node->right;
+        }
+    }
+    return result;
+}
+
+template<typename T>
+typename frozen_avl_tree<T>::const_iterator frozen_avl_tree<T>::find(T const& value) const
+{
+    frozen_node const* node = lower_bound_node(value);
+    if (node == nodes + count || value < node->value) {
+        return end();
+    }
+    return const_iterator(node);
+}
+
+template<typename T>
+typename frozen_avl_tree<T>::const_iterator frozen_avl_tree<T>::lower_bound(T const& value) const
+{
+    return const_iterator(lower_bound_node(value));
+}
+
+template<typename T>
+typename frozen_avl_tree<T>::const_iterator frozen_avl_tree<T>::upper_bound(T const& value) const
+{
+    return const_iterator(upper_bound_node(value));
+}
+
+template<typename T>
+typename frozen_avl_tree<T>::const_iterator frozen_avl_tree<T>::begin() const noexcept
+{
+    return const_iterator(nodes);
+}
+
+template<typename T>
+typename frozen_avl_tree<T>::const_iterator frozen_avl_tree<T>::end() const noexcept
+{
+    return const_iterator(nodes + count);
+}
+
+template<typename T>
+size_t frozen_avl_tree<T>::size() const noexcept
+{
+    return count;
+}
+
+template<typename T>
+bool frozen_avl_tree<T>::empty() const noexcept
+{
+    return count == 0;
+}
+
+template<typename T>
+void frozen_avl_tree<T>::prefetch() const noexcept
+{
+    if (mapping) {
+        madvise(mapping, mapping_size, MADV_WILLNEED);
+    }
+}
@@ -0,0 +1,150 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "avl_tree.h"
+#include "frozen_avl_tree.h"
+
+namespace
+{
+// A file in the working directory that is removed again at the end.
+struct scratch_file
+{
+    std::string path;
+
+    explicit scratch_file(char const* name) : path(name) {}
+
+    ~scratch_file()
+    {
+        std::remove(path.c_str());
+    }
+
+    template<typename T, typename Container>
+    void write_frozen(Container const& values) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        frozen_avl_tree<T>::write(out, values.begin(), values.end());
+    }
+
+    void write_bytes(std::string const& bytes) const
+    {
+        std::ofstream(path, std::ios::binary) << bytes;
+    }
+
+    std::string read_bytes() const
+    {
+        std::ifstream in(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+};
+}
+
+TEST(frozen, queries_match_std_set)
+{
+    std::set<int> expected;
+    std::mt19937 rng(39);
+    for (int i = 0; i != 20000; ++i) {
+        expected.insert(static_cast<int>(rng() % 100000));
+    }
+    scratch_file file("frozen_queries.bin");
+    file.write_frozen<int>(expected);
+    frozen_avl_tree<int> c(file.path.c_str());
+
+    EXPECT_EQ(expected.size(), c.size());
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+    for (int i = -1; i != 100001; i += 7) {
+        EXPECT_EQ(expected.count(i) != 0, c.find(i) != c.end());
+        auto lower = expected.lower_bound(i);
+        EXPECT_EQ(lower == expected.end() ? c.end() : c.find(*lower), c.lower_bound(i));
+        auto upper = expected.upper_bound(i);
+        EXPECT_EQ(upper == expected.end() ? c.end() : c.find(*upper), c.upper_bound(i));
+    }
+    c.prefetch();
+    EXPECT_EQ(*--expected.end(), *--c.end());
+}
+
+TEST(frozen, from_avl_tree_and_moved)
+{
+    avl_tree<double> tree;
+    for (int i = 0; i != 1000; ++i) {
+        tree.insert(i * 0.5);
+    }
+    scratch_file file("frozen_moved.bin");
+    file.write_frozen<double>(tree);
+
+    frozen_avl_tree<double> opened(file.path.c_str());
+    frozen_avl_tree<double> c(std::move(opened));
+    EXPECT_TRUE(opened.empty());
+    EXPECT_EQ(1000u, c.size());
+    EXPECT_EQ(10.5, *c.find(10.5));
+    EXPECT_TRUE(c.find(10.25) == c.end());
+
+    frozen_avl_tree<double> other;
+    other = std::move(c);
+    EXPECT_EQ(0.0, *other.begin());
+    EXPECT_TRUE(c.begin() == c.end());
+}
+
+TEST(frozen, empty_tree)
+{
+    scratch_file file("frozen_empty.bin");
+    file.write_frozen<int>(std::vector<int>());
+    frozen_avl_tree<int> c(file.path.c_str());
+    EXPECT_TRUE(c.empty());
+    EXPECT_TRUE(c.find(1) == c.end());
+    EXPECT_TRUE(c.lower_bound(1) == c.end());
+}
+
+TEST(frozen, rejects_damaged_files)
+{
+    EXPECT_THROW(frozen_avl_tree<int>("frozen_missing.bin"), std::system_error);
+
+    scratch_file file("frozen_damaged.bin");
+    file.write_frozen<int>(std::vector<int>{1, 2, 3});
+    std::string const bytes = file.read_bytes();
+    EXPECT_THROW(frozen_avl_tree<long long>(file.path.c_str()), avl_tree_snapshot_error);
+
+    file.write_bytes(bytes.substr(0, bytes.size() - 1));
+    EXPECT_THROW(frozen_avl_tree<int>(file.path.c_str()), avl_tree_snapshot_error);
+    file.write_bytes("AVLT" + bytes.substr(4));
+    EXPECT_THROW(frozen_avl_tree<int>(file.path.c_str()), avl_tree_snapshot_error);
+    file.write_bytes("AV");
+    EXPECT_THROW(frozen_avl_tree<int>(file.path.c_str()), avl_tree_snapshot_error);
+}
+
+TEST(frozen, rejects_damaged_links)
+{
+    scratch_file file("frozen_links.bin");
+    file.write_frozen<int>(std::vector<int>{1, 2, 3});
+    std::string const bytes = file.read_bytes();
+    // the root is the second of the 24-byte int nodes after the 40-byte
+    // header; its right link is the last field
+    size_t const root_right = 40 + 24 + 16;
+    auto with_root_right = [&bytes, &file](uint64_t link)
+    {
+        std::string damaged = bytes;
+        damaged.replace(root_right, sizeof(link), reinterpret_cast<char const*>(&link), sizeof(link));
+        file.write_bytes(damaged);
+    };
+
+    with_root_right(4);
+    {
+        frozen_avl_tree<int> past_end(file.path.c_str());
+        EXPECT_TRUE(past_end.find(1) != past_end.end());
+        EXPECT_THROW(past_end.find(3), avl_tree_snapshot_error);
+        EXPECT_THROW(past_end.upper_bound(2), avl_tree_snapshot_error);
+    }
+    // the root as its own right child
+    with_root_right(2);
+    {
+        frozen_avl_tree<int> cycle(file.path.c_str());
+        EXPECT_THROW(cycle.lower_bound(3), avl_tree_snapshot_error);
+        EXPECT_THROW(cycle.upper_bound(2), avl_tree_snapshot_error);
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef LAZY_AVL_TREE_H
+#define LAZY_AVL_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+
+#include <avl_tree_serializer.h>
+
+// Tree opened from a plain snapshot written by avl_tree::save without
+// reading it. The snapshot is mapped and only the top levels become nodes
+// on opening; below them a node stands for a range of the sorted values
+// in the file and creates its children the first time a lookup or an
+// iterator passes through it. Ranges are split at the middle as in
+// avl_tree::load, so the tree ends up with the same shape.
+//
+// Values are read as their bytes in native byte order, so the snapshot
+// has to use the default avl_tree_serializer. Lookups expand nodes, so
+// none of the members may be called concurrently.
+template<typename T>
+struct lazy_avl_tree {
+    static_assert(std::is_trivially_copyable_v<T>, "lazy_avl_tree reads values as raw bytes");
+
+private:
+    struct lazy_node {
+        T value;
+        // the node is values[index] and its subtree is values[lo, hi)
+        size_t index;
+        size_t lo;
+        size_t hi;
+        bool expanded = false;
+        std::unique_ptr<lazy_node> left;
+        std::unique_ptr<lazy_node> right;
+        lazy_node* parent;
+    };
+
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    char const* values = nullptr;
+    size_t count = 0;
+    size_t nodes = 0;
+    std::unique_ptr<lazy_node> root;
+
+    std::unique_ptr<lazy_node> make_node(size_t, size_t, lazy_node*);
+    void expand(lazy_node*);
+    void expand_levels(lazy_node*, size_t);
+    lazy_node* leftmost(lazy_node*);
+    lazy_node* rightmost(lazy_node*);
+    lazy_node* lower_bound_node(T const&);
+    lazy_node* upper_bound_node(T const&);
+    void unmap() noexcept;
+
+public:
+    struct const_iterator {
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+        const_iterator() noexcept = default;
+
+        reference operator*() const noexcept { return node->value; }
+        pointer operator->() const noexcept { return &node->value; }
+        const_iterator& operator++();
+        const_iterator operator++(int) { const_iterator old = *this; ++*this; return old; }
+        const_iterator& operator--();
+        const_iterator operator--(int) { const_iterator old = *this; --*this; return old; }
+        friend bool operator==(const_iterator a, const_iterator b) noexcept { return a.node == b.node; }
+        friend bool operator!=(const_iterator a, const_iterator b) noexcept { return a.node != b.node; }
+
+    private:
+        friend struct lazy_avl_tree;
+        const_iterator(lazy_avl_tree* tree, lazy_node* node) noexcept : tree(tree), node(node) { }
+
+        lazy_avl_tree* tree = nullptr;
+        // null at the end
+        lazy_node* node = nullptr;
+    };
+    using iterator = const_iterator;
+
+    lazy_avl_tree() noexcept;
+    // Maps the snapshot and expands eager_levels levels of nodes, each of
+    // which faults in a page of its own in a large file. Throws
+    // std::system_error if it cannot be read and avl_tree_snapshot_error
+    // if it is not a plain snapshot of this T.
+    explicit lazy_avl_tree(char const* path, size_t eager_levels = 6);
+    lazy_avl_tree(lazy_avl_tree const&) = delete;
+    lazy_avl_tree(lazy_avl_tree&&) noexcept;
+    lazy_avl_tree& operator=(lazy_avl_tree const&) = delete;
+    lazy_avl_tree& operator=(lazy_avl_tree&&) noexcept;
+    ~lazy_avl_tree();
+
+    const_iterator find(T const&);
+    const_iterator lower_bound(T const&);
+    const_iterator upper_bound(T const&);
+    const_iterator begin();
+    const_iterator end() noexcept;
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+    // How many values have become nodes so far.
+    size_t materialized() const noexcept;
+};
+
+#include <lazy_avl_tree.tpp>
+#endif //LAZY_AVL_TREE_H
@@ -0,0 +1,302 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <mman.h>
+
+// The middle of [lo, hi), as avl_tree::build_sorted picks it.
+template<typename T>
+std::unique_ptr<typename lazy_avl_tree<T>::lazy_node> lazy_avl_tree<T>::make_node(size_t lo, size_t hi,
+                                                                                  lazy_node* parent)
+{
+    size_t index = lo + (hi - lo) / 2;
+    std::unique_ptr<lazy_node> node(new lazy_node{T{}, index, lo, hi, false, nullptr, nullptr, parent});
+    // the values follow a 16-byte header, so they need not be aligned for T
+    std::memcpy(&node->value, values + index * sizeof(T), sizeof(T));
+    ++nodes;
+    return node;
+}
+
+template<typename T>
+void lazy_avl_tree<T>::expand(lazy_node* node)
+{
+    if (node->expanded) {
+        return;
+    }
+    if (!node->left && node->lo != node->index) {
+        node->left = make_node(node->lo, node->index, node);
+    }
+    if (!node->right && node->index + 1 != node->hi) {
+        node->right = make_node(node->index + 1, node->hi, node);
+    }
+    node->expanded = true;
+}
+
+template<typename T>
+void lazy_avl_tree<T>::expand_levels(lazy_node* node, size_t levels)
+{
+    if (node == nullptr || levels == 0) {
+        return;
+    }
+    expand(node);
+    expand_levels(node->left.get(), levels - 1);
+    expand_levels(node->right.get(), levels - 1);
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::lazy_node* lazy_avl_tree<T>::leftmost(lazy_node* node)
+{
+    for (expand(node); node->left; expand(node)) {
+        node = node->left.get();
+    }
+    return node;
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::lazy_node* lazy_avl_tree<T>::rightmost(lazy_node* node)
+{
+    for (expand(node); node->right; expand(node)) {
+        node = node->right.get();
+    }
+    return node;
+}
+
+template<typename T>
+lazy_avl_tree<T>::lazy_avl_tree() noexcept { }
+
+template<typename T>
+lazy_avl_tree<T>::lazy_avl_tree(char const* path, size_t eager_levels)
+{
+    int flags = O_RDONLY;
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
+    int fd = open(path, flags);
+    if (fd == -1) {
+        throw std::system_error(errno, std::generic_category(), "lazy_avl_tree: open");
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        int error = errno;
+        close(fd);
+        throw std::system_error(error, std::generic_category(), "lazy_avl_tree: stat");
+    }
+    mapping_size = static_cast<size_t>(info.st_size);
+    if (mapping_size < sizeof(avl_tree_snapshot_header)) {
+        close(fd);
+        throw avl_tree_snapshot_error("lazy_avl_tree: not a snapshot");
+    }
+    void* mapped = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    int error = errno;
+    // the mapping keeps the file alive by itself
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::system_error(error, std::generic_category(), "lazy_avl_tree: mmap");
+    }
+    mapping = mapped;
+
+    avl_tree_snapshot_header header;
+    std::memcpy(&header, mapping, sizeof(header));
+    char const* failure = nullptr;
+    if (!std::equal(std::begin(header.magic), std::end(header.magic), header.expected_magic)) {
+        failure = "lazy_avl_tree: not a plain snapshot";
+    }
+    else if (header.version != avl_tree_snapshot_header::current_version) {
+        failure = "lazy_avl_tree: unsupported snapshot version";
+    }
+    else if (header.count != (mapping_size - sizeof(header)) / sizeof(T) ||
+             (mapping_size - sizeof(header)) % sizeof(T) != 0) {
+        failure = "lazy_avl_tree: snapshot size does not match its count";
+    }
+    if (failure) {
+        unmap();
+        throw avl_tree_snapshot_error(failure);
+    }
+    values = static_cast<char const*>(mapping) + sizeof(header);
+    count = static_cast<size_t>(header.count);
+    madvise(mapping, mapping_size, MADV_RANDOM);
+    try {
+        if (count != 0) {
+            root = make_node(0, count, nullptr);
+            expand_levels(root.get(), eager_levels);
+        }
+    }
+    catch (...) {
+        unmap();
+        throw;
+    }
+}
+
+template<typename T>
+lazy_avl_tree<T>::lazy_avl_tree(lazy_avl_tree&& other) noexcept
+    : mapping(std::exchange(other.mapping, nullptr)),
+      mapping_size(std::exchange(other.mapping_size, 0)),
+      values(std::exchange(other.values, nullptr)),
+      count(std::exchange(other.count, 0)),
+      nodes(std::exchange(other.nodes, 0)),
+      root(std::move(other.root)) { }
+
+template<typename T>
+lazy_avl_tree<T>& lazy_avl_tree<T>::operator=(lazy_avl_tree&& other) noexcept
+{
+    if (this != &other) {
+        unmap();
+        mapping = std::exchange(other.mapping, nullptr);
+        mapping_size = std::exchange(other.mapping_size, 0);
+        values = std::exchange(other.values, nullptr);
+        count = std::exchange(other.count, 0);
+        nodes = std::exchange(other.nodes, 0);
+        root = std::move(other.root);
+    }
+    return *this;
+}
+
+template<typename T>
+lazy_avl_tree<T>::~lazy_avl_tree()
+{
+    unmap();
+}
+
+template<typename T>
+void lazy_avl_tree<T>::unmap() noexcept
+{
+    root.reset();
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+    mapping = nullptr;
+    mapping_size = 0;
+    values = nullptr;
+    count = 0;
+    nodes = 0;
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::lazy_node* lazy_avl_tree<T>::lower_bound_node(T const& value)
+{
+    lazy_node* result = nullptr;
+    for (lazy_node* node = root.get(); node;) {
+        expand(node);
+        if (node->value < value) {
+            node = node->right.get();
+        }
+        else {
+            result = node;
+            node = node->left.get();
+        }
+    }
+    return result;
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::lazy_node* lazy_avl_tree<T>::upper_bound_node(T const& value)
+{
+    lazy_node* result = nullptr;
+    for (lazy_node* node = root.get(); node;) {
+        expand(node);
+        if (value < node->value) {
+            result = node;
+            node = node->left.get();
+        }
+        else {
+            node = node->right.get();
+        }
+    }
+    return result;
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::const_iterator& lazy_avl_tree<T>::const_iterator::operator++()
+{
+    tree->expand(node);
+    if (node->right) {
+        node = tree->leftmost(node->right.get());
+        return *this;
+    }
+    while (node->parent && node == node->parent->right.get()) {
+        node = node->parent;
+    }
+    node = node->parent;
+    return *this;
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::const_iterator& lazy_avl_tree<T>::const_iterator::operator--()
+{
+    if (node == nullptr) {
+        node = tree->rightmost(tree->root.get());
+        return *this;
+    }
+    tree->expand(node);
+    if (node->left) {
+        node = tree->rightmost(node->left.get());
+        return *this;
+    }
+    while (node->parent && node == node->parent->left.get()) {
+        node = node->parent;
+    }
+    node = node->parent;
+    return *this;
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::const_iterator lazy_avl_tree<T>::find(T const& value)
+{
+    lazy_node* node = lower_bound_node(value);
+    if (node == nullptr || value < node->value) {
+        return end();
+    }
+    return const_iterator(this, node);
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::const_iterator lazy_avl_tree<T>::lower_bound(T const& value)
+{
+    return const_iterator(this, lower_bound_node(value));
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::const_iterator lazy_avl_tree<T>::upper_bound(T const& value)
+{
+    return const_iterator(this, upper_bound_node(value));
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::const_iterator lazy_avl_tree<T>::begin()
+{
+    return const_iterator(this, root ? leftmost(root.get()) : nullptr);
+}
+
+template<typename T>
+typename lazy_avl_tree<T>::const_iterator lazy_avl_tree<T>::end() noexcept
+{
+    return const_iterator(this, nullptr);
+}
+
+template<typename T>
+size_t lazy_avl_tree<T>::size() const noexcept
+{
+    return count;
+}
+
+template<typename T>
+bool lazy_avl_tree<T>::empty() const noexcept
+{
+    return count == 0;
+}
+
+template<typename T>
+size_t lazy_avl_tree<T>::materialized() const noexcept
+{
+    return nodes;
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "avl_tree.h"
+#include "lazy_avl_tree.h"
+
+namespace
+{
+// A file on tmpfs where there is one, removed again at the end.
+struct scratch_file
+{
+    std::string path;
+
+    explicit scratch_file(char const* name)
+        : path((std::ifstream("/dev/shm/.") ? std::string("/dev/shm/") : std::string()) + name)
+    {
+        std::remove(path.c_str());
+    }
+
+    ~scratch_file()
+    {
+        std::remove(path.c_str());
+    }
+
+    template<typename T>
+    void save(avl_tree<T> const& c) const
+    {
+        std::ofstream out(path, std::ios::binary);
+        c.save(out);
+    }
+
+    void write_bytes(std::string const& bytes) const
+    {
+        std::ofstream(path, std::ios::binary) << bytes;
+    }
+};
+}
+
+TEST(lazy, queries_match_std_set)
+{
+    std::set<int> expected;
+    std::mt19937 rng(45);
+    for (int i = 0; i != 20000; ++i) {
+        expected.insert(static_cast<int>(rng() % 100000));
+    }
+    avl_tree<int> saved;
+    saved.assign_sorted(expected.begin(), expected.end());
+    scratch_file file("lazy_queries.bin");
+    file.save(saved);
+    lazy_avl_tree<int> c(file.path.c_str());
+
+    EXPECT_EQ(expected.size(), c.size());
+    for (int i = 0; i != 2000; ++i) {
+        int value = static_cast<int>(rng() % 100010) - 5;
+        EXPECT_EQ(expected.count(value) != 0, c.find(value) != c.end());
+        auto lower = expected.lower_bound(value);
+        auto it = c.lower_bound(value);
+        EXPECT_EQ(lower == expected.end(), it == c.end());
+        if (lower != expected.end() && it != c.end()) {
+            EXPECT_EQ(*lower, *it);
+        }
+        auto upper = expected.upper_bound(value);
+        it = c.upper_bound(value);
+        EXPECT_EQ(upper == expected.end(), it == c.end());
+        if (upper != expected.end() && it != c.end()) {
+            EXPECT_EQ(*upper, *it);
+        }
+    }
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+    EXPECT_EQ(expected.size(), c.materialized());
+}
+
+TEST(lazy, expands_only_what_is_reached)
+{
+    std::vector<uint64_t> values(1 << 18);
+    for (size_t i = 0; i != values.size(); ++i) {
+        values[i] = i * 3;
+    }
+    avl_tree<uint64_t> saved;
+    saved.assign_sorted(values.begin(), values.end());
+    scratch_file file("lazy_expands.bin");
+    file.save(saved);
+
+    lazy_avl_tree<uint64_t> c(file.path.c_str(), 4);
+    // four expanded levels hold 15 nodes and create the 16 below them
+    EXPECT_EQ(31u, c.materialized());
+    EXPECT_EQ(300u, *c.find(300));
+    EXPECT_LE(c.materialized(), 31u + 2 * 21);
+
+    auto it = c.lower_bound(301);
+    for (uint64_t expected = 303; expected != 303 + 3 * 100; expected += 3) {
+        EXPECT_EQ(expected, *it++);
+    }
+    it = c.end();
+    for (size_t i = values.size(); i-- > values.size() - 100;) {
+        EXPECT_EQ(values[i], *--it);
+    }
+    EXPECT_LT(c.materialized(), 1000u);
+}
+
+TEST(lazy, empty_and_moved)
+{
+    scratch_file file("lazy_empty.bin");
+    file.save(avl_tree<int>());
+    lazy_avl_tree<int> c(file.path.c_str());
+    EXPECT_TRUE(c.empty());
+    EXPECT_TRUE(c.begin() == c.end());
+    EXPECT_TRUE(c.find(1) == c.end());
+
+    std::vector<int> const values{1, 2, 3};
+    avl_tree<int> saved;
+    saved.assign_sorted(values.begin(), values.end());
+    file.save(saved);
+    lazy_avl_tree<int> opened(file.path.c_str(), 0);
+    c = std::move(opened);
+    EXPECT_EQ((std::vector<int>{1, 2, 3}), std::vector<int>(c.begin(), c.end()));
+    EXPECT_TRUE(opened.empty());
+}
+
+TEST(lazy, rejects_damaged_input)
+{
+    avl_tree<int> saved;
+    for (int i = 0; i != 100; ++i) {
+        saved.insert(i);
+    }
+    std::ostringstream plain;
+    saved.save(plain);
+    std::string const bytes = plain.str();
+    std::ostringstream packed;
+    saved.save_packed(packed);
+
+    scratch_file file("lazy_damaged.bin");
+    for (std::string const& damaged : {std::string("AVLT"), "XVLT" + bytes.substr(4), bytes.substr(0, bytes.size() - 4),
+                                       bytes.substr(0, bytes.size() - 1), packed.str()}) {
+        file.write_bytes(damaged);
+        EXPECT_THROW(lazy_avl_tree<int>(file.path.c_str()), avl_tree_snapshot_error);
+    }
+    EXPECT_THROW(lazy_avl_tree<int>("no/such/file"), std::system_error);
+}
@@ -0,0 +1,92 @@
+#ifndef LOGGED_AVL_TREE_H
+#define LOGGED_AVL_TREE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <avl_tree.h>
+#include <executor.h>
+
+// avl_tree made durable by a write-ahead log. A directory holds numbered
+// generations: snapshot.N, written by avl_tree::save, and log.N, the
+// changes made after it as records of an operation byte, the value
+// through avl_tree_serializer<T> and a CRC-32. Opening the directory
+// loads the newest snapshot and replays the logs from its generation on,
+// grouping consecutive records of one kind into insert_batch/erase_batch;
+// a torn record at the end of a log is cut off.
+//
+// Changes are buffered. commit() makes everything changed so far durable
+// with group commit: one caller writes and fsyncs what all threads have
+// buffered while the others wait for it. compact() only starts a new
+// log; the executor rebuilds the tree as of that point from the newest
+// snapshot and the logs closed since, so writers never wait for a copy of
+// the tree, and saves it as the next snapshot. Once that is renamed into
+// place the older generations are removed.
+//
+// All members may be called from several threads.
+template<typename T>
+struct logged_avl_tree {
+private:
+    enum : char {
+        insert_record = 'I', erase_record = 'E'
+    };
+
+    std::string directory;
+    mutable std::mutex lock;
+    std::condition_variable flushed;
+    avl_tree<T> tree;
+    size_t count = 0;
+
+    int log_fd = -1;
+    uint64_t generation = 0;
+    std::string pending;
+    // records are numbered in the order they were buffered
+    uint64_t appended = 0;
+    uint64_t durable = 0;
+    bool flushing = false;
+    std::exception_ptr log_error;
+
+    std::mutex compacting;
+    task_group compaction;
+
+    static uint32_t checksum(char const*, size_t) noexcept;
+    std::string path(char const*, uint64_t) const;
+    void recover();
+    void replay(avl_tree<T>&, uint64_t) const;
+    void rebuild(avl_tree<T>&, uint64_t) const;
+    void open_log();
+    static std::string encode(char, T const&);
+    void flush_locked(std::unique_lock<std::mutex>&);
+    void write_snapshot(avl_tree<T> const&, uint64_t);
+
+public:
+    // Recovers from directory, creating it if needed. Snapshots from
+    // compact() are written on background.
+    explicit logged_avl_tree(std::string directory, executor& background = thread_pool::global());
+    logged_avl_tree(logged_avl_tree const&) = delete;
+    logged_avl_tree& operator=(logged_avl_tree const&) = delete;
+    // Waits for compaction and commits, errors are dropped.
+    ~logged_avl_tree();
+
+    bool insert(T const&);
+    bool erase(T const&);
+    void commit();
+
+    void compact();
+    // Rethrows what the last compaction failed with.
+    void wait_compaction();
+
+    bool contains(T const&) const;
+    size_t size() const;
+    // Calls f with the tree under the lock.
+    template<typename F>
+    auto read(F) const;
+};
+
+#include <logged_avl_tree.tpp>
+#endif //LOGGED_AVL_TREE_H
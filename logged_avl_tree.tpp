@@ -0,0 +1,470 @@
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace logged_avl_tree_detail
+{
+inline void sync_file(int fd)
+{
+#ifdef _WIN32
+    int result = _commit(fd);
+#else
+    int result = fsync(fd);
+#endif
+    if (result != 0) {
+        throw std::system_error(errno, std::generic_category(), "logged_avl_tree: fsync");
+    }
+}
+
+inline void sync_path(std::string const& path, bool directory)
+{
+#ifdef _WIN32
+    if (directory) {
+        // directory entries cannot be synced on their own here
+        return;
+    }
+#endif
+    int flags = O_RDONLY;
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
+    int fd = open(path.c_str(), flags);
+    if (fd == -1) {
+        throw std::system_error(errno, std::generic_category(), "logged_avl_tree: open");
+    }
+    try {
+        sync_file(fd);
+    }
+    catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+// The generation of a file called prefix.N, or false for anything else.
+inline bool parse_generation(std::string const& name, std::string const& prefix, uint64_t& generation)
+{
+    if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+        !std::all_of(name.begin() + prefix.size(), name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+    generation = std::stoull(name.substr(prefix.size()));
+    return true;
+}
+}
+
+template<typename T>
+uint32_t logged_avl_tree<T>::checksum(char const* data, size_t size) noexcept
+{
+    static std::array<uint32_t, 256> const table = []
+    {
+        std::array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i != 256; ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit != 8; ++bit) {
+                value = value & 1 ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+            }
+            result[i] = value;
+        }
+        return result;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i != size; ++i) {
+        crc = table[(crc ^ static_cast<unsigned char>(data[i])) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+template<typename T>
+std::string logged_avl_tree<T>::path(char const* kind, uint64_t number) const
+{
+    return directory + "/" + kind + "." + std::to_string(number);
+}
+
+template<typename T>
+std::string logged_avl_tree<T>::encode(char operation, T const& value)
+{
+    std::ostringstream out;
+    out.put(operation);
+    avl_tree_serializer<T>::write(out, value);
+    std::string record = out.str();
+    uint32_t crc = checksum(record.data(), record.size());
+    record.append(reinterpret_cast<char const*>(&crc), sizeof(crc));
+    return record;
+}
+
+template<typename T>
+logged_avl_tree<T>::logged_avl_tree(std::string directory, executor& background)
+    : directory(std::move(directory)), compaction(background)
+{
+    recover();
+}
+
+template<typename T>
+logged_avl_tree<T>::~logged_avl_tree()
+{
+    try {
+        wait_compaction();
+    }
+    catch (...) {
+    }
+    try {
+        commit();
+    }
+    catch (...) {
+    }
+    close(log_fd);
+}
+
+template<typename T>
+void logged_avl_tree<T>::recover()
+{
+    namespace fs = std::filesystem;
+    fs::create_directories(directory);
+    bool has_snapshot = false;
+    uint64_t base = 0;
+    for (fs::directory_entry const& entry : fs::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        uint64_t number = 0;
+        if (logged_avl_tree_detail::parse_generation(name, "snapshot.", number)) {
+            base = has_snapshot ? std::max(base, number) : number;
+            has_snapshot = true;
+        }
+        else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) {
+            // a snapshot that was never renamed into place
+            fs::remove(entry.path());
+        }
+    }
+    if (has_snapshot) {
+        std::ifstream in(path("snapshot", base), std::ios::binary);
+        tree.load(in);
+    }
+    generation = base;
+    for (uint64_t number = base; fs::exists(path("log", number)); ++number) {
+        replay(tree, number);
+        generation = number;
+    }
+    count = static_cast<size_t>(std::distance(tree.begin(), tree.end()));
+
+    for (fs::directory_entry const& entry : fs::directory_iterator(directory)) {
+        std::string name = entry.path().filename().string();
+        uint64_t number = 0;
+        if ((logged_avl_tree_detail::parse_generation(name, "snapshot.", number) ||
+             logged_avl_tree_detail::parse_generation(name, "log.", number)) && number < base) {
+            fs::remove(entry.path());
+        }
+    }
+    open_log();
+}
+
+template<typename T>
+void logged_avl_tree<T>::replay(avl_tree<T>& result, uint64_t number) const
+{
+    std::string const file = path("log", number);
+    std::string data;
+    {
+        std::ifstream in(file, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    std::istringstream in(data);
+    std::vector<T> run;
+    char run_operation = 0;
+    auto apply_run = [&result, &run, &run_operation]
+    {
+        if (run_operation == insert_record) {
+            result.insert_batch(run.data(), run.data() + run.size());
+        }
+        else if (run_operation == erase_record) {
+            result.erase_batch(run.data(), run.data() + run.size());
+        }
+        run.clear();
+    };
+
+    size_t valid = 0;
+    while (valid != data.size()) {
+        char operation = 0;
+        if (!in.get(operation) || (operation != insert_record && operation != erase_record)) {
+            break;
+        }
+        T value = avl_tree_serializer<T>::read(in);
+        if (!in) {
+            break;
+        }
+        size_t end = static_cast<size_t>(in.tellg());
+        uint32_t crc = 0;
+        if (!in.read(reinterpret_cast<char*>(&crc), sizeof(crc)) || crc != checksum(data.data() + valid, end - valid)) {
+            break;
+        }
+        if (operation != run_operation) {
+            apply_run();
+            run_operation = operation;
+        }
+        run.push_back(std::move(value));
+        valid = end + sizeof(crc);
+    }
+    apply_run();
+    if (valid != data.size()) {
+        // the tail was being written when the process stopped
+        std::filesystem::resize_file(file, valid);
+    }
+}
+
+// The tree as it was when log.number was started: the newest snapshot
+// with every log after it replayed. Older generations are only removed
+// once a newer snapshot is in place, so none of them is missing.
+template<typename T>
+void logged_avl_tree<T>::rebuild(avl_tree<T>& result, uint64_t number) const
+{
+    namespace fs = std::filesystem;
+    bool has_snapshot = false;
+    uint64_t base = 0;
+    for (fs::directory_entry const& entry : fs::directory_iterator(directory)) {
+        uint64_t older = 0;
+        if (logged_avl_tree_detail::parse_generation(entry.path().filename().string(), "snapshot.", older) &&
+            older < number) {
+            base = has_snapshot ? std::max(base, older) : older;
+            has_snapshot = true;
+        }
+    }
+    if (has_snapshot) {
+        std::ifstream in(path("snapshot", base), std::ios::binary);
+        result.load(in);
+    }
+    for (uint64_t older = base; older != number; ++older) {
+        replay(result, older);
+    }
+}
+
+template<typename T>
+void logged_avl_tree<T>::open_log()
+{
+    int flags = O_WRONLY | O_CREAT | O_APPEND;
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
+    int fd = open(path("log", generation).c_str(), flags, 0644);
+    if (fd == -1) {
+        throw std::system_error(errno, std::generic_category(), "logged_avl_tree: open");
+    }
+    log_fd = fd;
+}
+
+// Called with flushing clear. The write and fsync happen unlocked, so
+// threads keep buffering records for the next group meanwhile.
+template<typename T>
+void logged_avl_tree<T>::flush_locked(std::unique_lock<std::mutex>& guard)
+{
+    flushing = true;
+    std::string batch;
+    batch.swap(pending);
+    uint64_t upto = appended;
+    int fd = log_fd;
+    guard.unlock();
+
+    std::exception_ptr error;
+    try {
+        for (size_t written = 0; written != batch.size();) {
+            size_t chunk = std::min<size_t>(batch.size() - written, size_t(1) << 30);
+            auto result = write(fd, batch.data() + written, static_cast<unsigned>(chunk));
+            if (result < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::system_error(errno, std::generic_category(), "logged_avl_tree: write");
+            }
+            written += static_cast<size_t>(result);
+        }
+        logged_avl_tree_detail::sync_file(fd);
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    guard.lock();
+    flushing = false;
+    if (error) {
+        // what this batch held is lost, so nothing after it can be durable
+        log_error = error;
+    }
+    else {
+        durable = upto;
+    }
+    flushed.notify_all();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+template<typename T>
+bool logged_avl_tree<T>::insert(T const& value)
+{
+    std::string record = encode(insert_record, value);
+    std::lock_guard<std::mutex> guard(lock);
+    if (log_error) {
+        std::rethrow_exception(log_error);
+    }
+    // reserved first, so nothing can fail between changing the tree and
+    // buffering the record
+    pending.reserve(pending.size() + record.size());
+    if (!tree.insert(value).second) {
+        return false;
+    }
+    pending += record;
+    ++appended;
+    ++count;
+    return true;
+}
+
+template<typename T>
+bool logged_avl_tree<T>::erase(T const& value)
+{
+    std::string record = encode(erase_record, value);
+    std::lock_guard<std::mutex> guard(lock);
+    if (log_error) {
+        std::rethrow_exception(log_error);
+    }
+    auto it = tree.find(value);
+    if (it == tree.end()) {
+        return false;
+    }
+    pending.reserve(pending.size() + record.size());
+    tree.erase(it);
+    pending += record;
+    ++appended;
+    --count;
+    return true;
+}
+
+template<typename T>
+void logged_avl_tree<T>::commit()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    uint64_t target = appended;
+    while (durable < target) {
+        if (log_error) {
+            std::rethrow_exception(log_error);
+        }
+        if (flushing) {
+            flushed.wait(guard);
+        }
+        else {
+            flush_locked(guard);
+        }
+    }
+}
+
+template<typename T>
+void logged_avl_tree<T>::compact()
+{
+    std::lock_guard<std::mutex> serial(compacting);
+    compaction.wait();
+
+    std::unique_lock<std::mutex> guard(lock);
+    // everything buffered belongs to the old log
+    while (flushing || !pending.empty()) {
+        if (log_error) {
+            std::rethrow_exception(log_error);
+        }
+        if (flushing) {
+            flushed.wait(guard);
+        }
+        else {
+            flush_locked(guard);
+        }
+    }
+    int old_fd = log_fd;
+    ++generation;
+    try {
+        open_log();
+    }
+    catch (...) {
+        --generation;
+        throw;
+    }
+    close(old_fd);
+    uint64_t number = generation;
+    guard.unlock();
+
+    // the logs before number are complete and no longer written to
+    compaction.run([this, number]
+    {
+        avl_tree<T> snapshot;
+        rebuild(snapshot, number);
+        write_snapshot(snapshot, number);
+    });
+}
+
+template<typename T>
+void logged_avl_tree<T>::wait_compaction()
+{
+    std::lock_guard<std::mutex> serial(compacting);
+    compaction.wait();
+}
+
+// Written under a temporary name and renamed, so a snapshot file that
+// exists is always complete. Only then are the generations it covers
+// removed.
+template<typename T>
+void logged_avl_tree<T>::write_snapshot(avl_tree<T> const& snapshot, uint64_t number)
+{
+    namespace fs = std::filesystem;
+    std::string const file = path("snapshot", number);
+    std::string const temporary = file + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        snapshot.save(out);
+        out.close();
+        if (!out) {
+            throw avl_tree_snapshot_error("logged_avl_tree: snapshot write failed");
+        }
+    }
+    logged_avl_tree_detail::sync_path(temporary, false);
+    fs::rename(temporary, file);
+    logged_avl_tree_detail::sync_path(directory, true);
+
+    for (uint64_t older = number; older-- != 0;) {
+        bool removed = fs::remove(path("snapshot", older));
+        removed = fs::remove(path("log", older)) || removed;
+        if (!removed) {
+            break;
+        }
+    }
+}
+
+template<typename T>
+bool logged_avl_tree<T>::contains(T const& value) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return tree.find(value) != tree.end();
+}
+
+template<typename T>
+size_t logged_avl_tree<T>::size() const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return count;
+}
+
+template<typename T>
+template<typename F>
+auto logged_avl_tree<T>::read(F f) const
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return f(static_cast<avl_tree<T> const&>(tree));
+}
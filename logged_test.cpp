@@ -0,0 +1,262 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "fault_injection.h"
+#include "logged_avl_tree.h"
+
+namespace
+{
+// A directory on tmpfs where there is one, removed again at the end.
+struct scratch_directory
+{
+    std::string path;
+
+    explicit scratch_directory(char const* name)
+        : path((std::filesystem::is_directory("/dev/shm") ? std::string("/dev/shm/") : std::string()) + name)
+    {
+        std::filesystem::remove_all(path);
+    }
+
+    ~scratch_directory()
+    {
+        std::filesystem::remove_all(path);
+    }
+
+    size_t files() const
+    {
+        size_t result = 0;
+        for (auto const& entry : std::filesystem::directory_iterator(path)) {
+            static_cast<void>(entry);
+            ++result;
+        }
+        return result;
+    }
+};
+
+// Holds the tasks it is given until someone waiting for them runs them.
+struct deferred_executor : executor
+{
+    std::mutex lock;
+    std::vector<std::function<void()>> tasks;
+
+    void submit(std::function<void()> task) override
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        tasks.push_back(std::move(task));
+    }
+
+    bool try_run_one() override
+    {
+        std::function<void()> task;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (tasks.empty()) {
+                return false;
+            }
+            task = std::move(tasks.back());
+            tasks.pop_back();
+        }
+        task();
+        return true;
+    }
+
+    size_t concurrency() const noexcept override
+    {
+        return 1;
+    }
+};
+
+template<typename Tree>
+std::vector<int> contents(Tree const& c)
+{
+    return c.read([](avl_tree<int> const& tree) { return std::vector<int>(tree.begin(), tree.end()); });
+}
+}
+
+TEST(logged, recovers_committed_changes)
+{
+    scratch_directory directory("logged_recover");
+    std::set<int> expected;
+    {
+        logged_avl_tree<int> c(directory.path);
+        std::mt19937 rng(42);
+        for (int i = 0; i != 20000; ++i) {
+            int value = static_cast<int>(rng() % 5000);
+            if (rng() % 3 == 0) {
+                EXPECT_EQ(expected.erase(value) != 0, c.erase(value));
+            }
+            else {
+                EXPECT_EQ(expected.insert(value).second, c.insert(value));
+            }
+            if (i % 1000 == 0) {
+                c.commit();
+            }
+        }
+        c.commit();
+    }
+    logged_avl_tree<int> c(directory.path);
+    EXPECT_EQ(expected.size(), c.size());
+    EXPECT_EQ(std::vector<int>(expected.begin(), expected.end()), contents(c));
+}
+
+TEST(logged, torn_tail_is_cut_off)
+{
+    scratch_directory directory("logged_torn");
+    {
+        logged_avl_tree<int> c(directory.path);
+        c.insert(1);
+        c.insert(2);
+        c.erase(1);
+    }
+    std::string const log = directory.path + "/log.0";
+    auto size = std::filesystem::file_size(log);
+    {
+        // a record cut short, then one with a bad checksum
+        std::ofstream out(log, std::ios::binary | std::ios::app);
+        out.write("I\x03\x00", 3);
+    }
+    {
+        logged_avl_tree<int> c(directory.path);
+        EXPECT_EQ(std::vector<int>{2}, contents(c));
+        EXPECT_EQ(size, std::filesystem::file_size(log));
+        c.insert(3);
+    }
+    {
+        std::fstream out(log, std::ios::binary | std::ios::in | std::ios::out);
+        out.seekp(static_cast<std::streamoff>(size) + 2);
+        out.put('\x7f');
+    }
+    logged_avl_tree<int> c(directory.path);
+    EXPECT_EQ(std::vector<int>{2}, contents(c));
+}
+
+TEST(logged, compaction_replaces_old_generations)
+{
+    scratch_directory directory("logged_compact");
+    std::set<int> expected;
+    {
+        logged_avl_tree<int> c(directory.path);
+        for (int round = 0; round != 3; ++round) {
+            for (int i = 0; i != 3000; ++i) {
+                int value = round * 1000 + i;
+                if (i % 4 == 3) {
+                    c.erase(value - 1);
+                    expected.erase(value - 1);
+                }
+                else {
+                    c.insert(value);
+                    expected.insert(value);
+                }
+            }
+            c.compact();
+        }
+        c.insert(-1);
+        expected.insert(-1);
+        c.wait_compaction();
+        // the newest snapshot and the log written since
+        EXPECT_EQ(2u, directory.files());
+    }
+    logged_avl_tree<int> c(directory.path);
+    EXPECT_EQ(std::vector<int>(expected.begin(), expected.end()), contents(c));
+}
+
+TEST(logged, group_commit_from_many_threads)
+{
+    scratch_directory directory("logged_threads");
+    {
+        inline_executor background;
+        logged_avl_tree<int> c(directory.path, background);
+        std::vector<std::thread> threads;
+        for (int t = 0; t != 4; ++t) {
+            threads.emplace_back([&c, t]
+            {
+                for (int i = 0; i != 500; ++i) {
+                    c.insert(t * 1000 + i);
+                    c.commit();
+                }
+            });
+        }
+        c.compact();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        EXPECT_EQ(2000u, c.size());
+    }
+    logged_avl_tree<int> c(directory.path);
+    EXPECT_EQ(2000u, c.size());
+    EXPECT_TRUE(c.contains(3499));
+    EXPECT_FALSE(c.contains(3500));
+}
+
+// compact() itself only starts a new log, however large the tree; the
+// snapshot is built on the executor while writers go on committing.
+TEST(logged, writers_progress_during_compaction)
+{
+    scratch_directory directory("logged_large_compaction");
+    int const n = 100000;
+    {
+        deferred_executor background;
+        logged_avl_tree<int> c(directory.path, background);
+        for (int i = 0; i != n; ++i) {
+            c.insert(2 * i);
+        }
+        c.commit();
+        {
+            operation_counter count;
+            c.compact();
+            EXPECT_LT(count.allocations, 100u);
+        }
+        std::thread compactor([&c] { c.wait_compaction(); });
+        for (int i = 0; i != 1000; ++i) {
+            c.insert(2 * i + 1);
+            c.erase(2 * (n - 1 - i));
+            c.commit();
+        }
+        compactor.join();
+        EXPECT_EQ(static_cast<size_t>(n), c.size());
+        EXPECT_EQ(2u, directory.files());
+    }
+    logged_avl_tree<int> c(directory.path);
+    std::vector<int> values = contents(c);
+    ASSERT_EQ(static_cast<size_t>(n), values.size());
+    EXPECT_EQ(1999, values[1000 + 999]);
+    EXPECT_EQ(2 * (n - 1001), values.back());
+}
+
+#ifndef _WIN32
+// Without commit nothing reaches the log; a process that dies loses it,
+// but keeps everything committed before.
+TEST(logged, uncommitted_changes_do_not_survive_a_crash)
+{
+    scratch_directory directory("logged_crash");
+    pid_t pid = fork();
+    if (pid == 0) {
+        logged_avl_tree<int> c(directory.path);
+        c.insert(1);
+        c.insert(2);
+        c.commit();
+        c.insert(3);
+        c.erase(1);
+        _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFEXITED(status));
+    logged_avl_tree<int> c(directory.path);
+    EXPECT_EQ((std::vector<int>{1, 2}), contents(c));
+}
+#endif
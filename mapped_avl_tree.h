@@ -0,0 +1,166 @@
+#ifndef MAPPED_AVL_TREE_H
+#define MAPPED_AVL_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+#include <avl_tree_serializer.h>
+
+// Mutable tree whose nodes live in a memory-mapped file, so it is there
+// again after a restart without being rebuilt. Links are byte offsets into
+// the file rather than pointers, which keeps them valid when the file is
+// grown and mapped at another address. Freed nodes go to a free list kept
+// in the file and are reused before the file grows.
+//
+// Changes never write over what the last sync() saved: a node written
+// since then is changed in place, any other is copied along with the path
+// to it, and the nodes that copies replace are only reused after the next
+// sync. The header holds two slots with the root, the free list and a
+// checksum; sync() writes the older one once the nodes are on disk, so a
+// crash at any point leaves the file as the last sync left it. Opening
+// takes the newest intact slot and, unless the file was closed cleanly,
+// rebuilds the free list from the nodes the tree does not reach.
+template<typename T>
+struct mapped_avl_tree {
+    static_assert(std::is_trivially_copyable_v<T>, "mapped_avl_tree stores values as raw bytes");
+
+private:
+    struct mapped_node {
+        T value;
+        // offsets of the children, 0 for none
+        uint64_t left;
+        uint64_t right;
+        // links the free list and the nodes waiting for the next sync
+        uint64_t next;
+        // the sync that saves this node first
+        uint64_t generation;
+        int32_t height;
+    };
+
+    struct header_slot {
+        uint64_t generation;
+        uint64_t root;
+        uint64_t free_list;
+        // bytes of the file handed out so far
+        uint64_t used;
+        uint64_t size;
+        // set by the destructor; only then does free_list hold every free node
+        uint64_t closed;
+        uint64_t checksum;
+    };
+
+    struct file_header {
+        char magic[4];
+        uint32_t version;
+        uint32_t value_size;
+        uint32_t node_size;
+        header_slot slots[2];
+    };
+
+    static constexpr char expected_magic[4] = {'A', 'V', 'L', 'M'};
+    static constexpr uint32_t current_version = 2;
+    static constexpr size_t initial_file_size = 1 << 16;
+
+    int fd = -1;
+    char* base = nullptr;
+    size_t mapping_size = 0;
+    // what the next sync writes; its generation marks the nodes it saves first
+    header_slot live{};
+    // the slot the last sync wrote
+    size_t newest = 1;
+    bool changed = false;
+    // nodes the last sync saved that the tree no longer uses
+    uint64_t retired = 0;
+    uint64_t retired_tail = 0;
+    size_t retired_count = 0;
+
+    static uint64_t nodes_offset() noexcept;
+    static uint64_t checksum(header_slot const&) noexcept;
+    file_header& header() const noexcept;
+    mapped_node& node(uint64_t) const noexcept;
+    int32_t height(uint64_t) const noexcept;
+    void fix_height(uint64_t) const noexcept;
+    uint64_t writable(uint64_t) noexcept;
+    uint64_t rotate_left(uint64_t) noexcept;
+    uint64_t rotate_right(uint64_t) noexcept;
+    uint64_t balance(uint64_t) noexcept;
+    uint64_t insert(uint64_t, uint64_t, bool&);
+    uint64_t remove_minimum(uint64_t, uint64_t&) noexcept;
+    uint64_t remove(uint64_t, T const&, uint64_t&);
+    uint64_t lower_bound_node(T const&) const;
+    uint64_t upper_bound_node(T const&) const;
+    uint64_t maximum_before(T const*) const;
+
+    void map(size_t);
+    void grow();
+    void reserve(size_t);
+    uint64_t allocate() noexcept;
+    void deallocate(uint64_t) noexcept;
+    bool intact(header_slot const&) const noexcept;
+    void rebuild_free_list();
+    void write_slot(bool);
+    void mark_changed();
+    void close_file() noexcept;
+
+public:
+    // Iterators and references are invalidated by insert, erase and clear,
+    // which move nodes and may remap the file. ++ and -- search from the
+    // root, there are no parent links.
+    struct const_iterator {
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+        const_iterator() noexcept = default;
+
+        reference operator*() const noexcept;
+        pointer operator->() const noexcept;
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+        friend bool operator==(const_iterator a, const_iterator b) noexcept { return a.offset == b.offset; }
+        friend bool operator!=(const_iterator a, const_iterator b) noexcept { return a.offset != b.offset; }
+
+    private:
+        friend struct mapped_avl_tree;
+        const_iterator(mapped_avl_tree const* tree, uint64_t offset) noexcept : tree(tree), offset(offset) { }
+
+        mapped_avl_tree const* tree = nullptr;
+        uint64_t offset = 0;
+    };
+    using iterator = const_iterator;
+
+    // Opens the file, creating it if it does not exist or is empty. Throws
+    // std::system_error on I/O errors and avl_tree_snapshot_error if the
+    // file holds something else or neither header slot is intact.
+    explicit mapped_avl_tree(char const* path);
+    mapped_avl_tree(mapped_avl_tree const&) = delete;
+    mapped_avl_tree& operator=(mapped_avl_tree const&) = delete;
+    // Syncs, marks the file closed cleanly and unmaps.
+    ~mapped_avl_tree();
+
+    bool insert(T const&);
+    bool erase(T const&);
+    void clear();
+    // Blocks until every change so far is on disk; a crash after it
+    // returns leaves the file as it is now.
+    void sync();
+
+    const_iterator find(T const&) const;
+    const_iterator lower_bound(T const&) const;
+    const_iterator upper_bound(T const&) const;
+    const_iterator begin() const;
+    const_iterator end() const noexcept;
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+    // Size of the backing file in bytes.
+    size_t file_size() const noexcept;
+};
+
+#include <mapped_avl_tree.tpp>
+#endif //MAPPED_AVL_TREE_H
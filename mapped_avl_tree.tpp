@@ -0,0 +1,700 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <new>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <mman.h>
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::nodes_offset() noexcept
+{
+    return (sizeof(file_header) + alignof(mapped_node) - 1) / alignof(mapped_node) * alignof(mapped_node);
+}
+
+// FNV-1a over the slot up to the checksum, enough to tell a torn write.
+template<typename T>
+uint64_t mapped_avl_tree<T>::checksum(header_slot const& slot) noexcept
+{
+    unsigned char const* bytes = reinterpret_cast<unsigned char const*>(&slot);
+    uint64_t hash = 0xCBF29CE484222325u;
+    for (size_t i = 0; i != offsetof(header_slot, checksum); ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3u;
+    }
+    return hash;
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::file_header& mapped_avl_tree<T>::header() const noexcept
+{
+    return *reinterpret_cast<file_header*>(base);
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::mapped_node& mapped_avl_tree<T>::node(uint64_t offset) const noexcept
+{
+    return *reinterpret_cast<mapped_node*>(base + offset);
+}
+
+template<typename T>
+int32_t mapped_avl_tree<T>::height(uint64_t offset) const noexcept
+{
+    return offset ? node(offset).height : 0;
+}
+
+template<typename T>
+void mapped_avl_tree<T>::fix_height(uint64_t offset) const noexcept
+{
+    node(offset).height = std::max(height(node(offset).left), height(node(offset).right)) + 1;
+}
+
+// The node itself if no sync has saved it yet, otherwise a copy to change
+// instead. The caller links the result in place of offset.
+template<typename T>
+uint64_t mapped_avl_tree<T>::writable(uint64_t offset) noexcept
+{
+    if (node(offset).generation == live.generation) {
+        return offset;
+    }
+    uint64_t copy = allocate();
+    mapped_node& original = node(offset);
+    mapped_node& fresh = node(copy);
+    fresh.value = original.value;
+    fresh.left = original.left;
+    fresh.right = original.right;
+    fresh.height = original.height;
+    deallocate(offset);
+    return copy;
+}
+
+// Takes and returns a writable node.
+template<typename T>
+uint64_t mapped_avl_tree<T>::rotate_left(uint64_t offset) noexcept
+{
+    uint64_t right = writable(node(offset).right);
+    node(offset).right = node(right).left;
+    node(right).left = offset;
+    fix_height(offset);
+    fix_height(right);
+    return right;
+}
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::rotate_right(uint64_t offset) noexcept
+{
+    uint64_t left = writable(node(offset).left);
+    node(offset).left = node(left).right;
+    node(left).right = offset;
+    fix_height(offset);
+    fix_height(left);
+    return left;
+}
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::balance(uint64_t offset) noexcept
+{
+    fix_height(offset);
+    int32_t difference = height(node(offset).left) - height(node(offset).right);
+    if (difference == 2) {
+        uint64_t left = node(offset).left;
+        if (height(node(left).left) < height(node(left).right)) {
+            node(offset).left = rotate_left(writable(left));
+        }
+        return rotate_right(offset);
+    }
+    if (difference == -2) {
+        uint64_t right = node(offset).right;
+        if (height(node(right).right) < height(node(right).left)) {
+            node(offset).right = rotate_right(writable(right));
+        }
+        return rotate_left(offset);
+    }
+    return offset;
+}
+
+// Every comparison is made on the way down and links are only written on
+// the way back up, so a throwing comparison leaves the tree as it was.
+template<typename T>
+uint64_t mapped_avl_tree<T>::insert(uint64_t offset, uint64_t fresh, bool& inserted)
+{
+    if (offset == 0) {
+        inserted = true;
+        return fresh;
+    }
+    T const& value = node(fresh).value;
+    if (value < node(offset).value) {
+        uint64_t left = insert(node(offset).left, fresh, inserted);
+        if (!inserted) {
+            return offset;
+        }
+        offset = writable(offset);
+        node(offset).left = left;
+    }
+    else if (node(offset).value < value) {
+        uint64_t right = insert(node(offset).right, fresh, inserted);
+        if (!inserted) {
+            return offset;
+        }
+        offset = writable(offset);
+        node(offset).right = right;
+    }
+    else {
+        return offset;
+    }
+    return balance(offset);
+}
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::remove_minimum(uint64_t offset, uint64_t& minimum) noexcept
+{
+    if (node(offset).left == 0) {
+        minimum = offset;
+        return node(offset).right;
+    }
+    uint64_t left = remove_minimum(node(offset).left, minimum);
+    offset = writable(offset);
+    node(offset).left = left;
+    return balance(offset);
+}
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::remove(uint64_t offset, T const& value, uint64_t& removed)
+{
+    if (offset == 0) {
+        return 0;
+    }
+    if (value < node(offset).value) {
+        uint64_t left = remove(node(offset).left, value, removed);
+        if (removed == 0) {
+            return offset;
+        }
+        offset = writable(offset);
+        node(offset).left = left;
+    }
+    else if (node(offset).value < value) {
+        uint64_t right = remove(node(offset).right, value, removed);
+        if (removed == 0) {
+            return offset;
+        }
+        offset = writable(offset);
+        node(offset).right = right;
+    }
+    else {
+        removed = offset;
+        uint64_t left = node(offset).left;
+        uint64_t right = node(offset).right;
+        if (right == 0) {
+            return left;
+        }
+        uint64_t minimum = 0;
+        right = remove_minimum(right, minimum);
+        minimum = writable(minimum);
+        node(minimum).left = left;
+        node(minimum).right = right;
+        return balance(minimum);
+    }
+    return balance(offset);
+}
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::lower_bound_node(T const& value) const
+{
+    uint64_t result = 0;
+    for (uint64_t offset = live.root; offset != 0;) {
+        if (node(offset).value < value) {
+            offset = node(offset).right;
+        }
+        else {
+            result = offset;
+            offset = node(offset).left;
+        }
+    }
+    return result;
+}
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::upper_bound_node(T const& value) const
+{
+    uint64_t result = 0;
+    for (uint64_t offset = live.root; offset != 0;) {
+        if (value < node(offset).value) {
+            result = offset;
+            offset = node(offset).left;
+        }
+        else {
+            offset = node(offset).right;
+        }
+    }
+    return result;
+}
+
+// The greatest node less than bound, or the greatest of all without one.
+template<typename T>
+uint64_t mapped_avl_tree<T>::maximum_before(T const* bound) const
+{
+    uint64_t result = 0;
+    for (uint64_t offset = live.root; offset != 0;) {
+        if (bound == nullptr || node(offset).value < *bound) {
+            result = offset;
+            offset = node(offset).right;
+        }
+        else {
+            offset = node(offset).left;
+        }
+    }
+    return result;
+}
+
+template<typename T>
+void mapped_avl_tree<T>::map(size_t size)
+{
+    void* mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "mapped_avl_tree: mmap");
+    }
+    // the old mapping goes only after the new one is in place
+    if (base) {
+        munmap(base, mapping_size);
+    }
+    base = static_cast<char*>(mapped);
+    mapping_size = size;
+}
+
+template<typename T>
+void mapped_avl_tree<T>::grow()
+{
+    size_t size = mapping_size * 2;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        throw std::system_error(errno, std::generic_category(), "mapped_avl_tree: ftruncate");
+    }
+    map(size);
+}
+
+// Grows the file up front, so a change that has started writing links
+// cannot fail halfway for want of nodes.
+template<typename T>
+void mapped_avl_tree<T>::reserve(size_t count)
+{
+    size_t handed_out = static_cast<size_t>((live.used - nodes_offset()) / sizeof(mapped_node));
+    size_t free_nodes = handed_out - static_cast<size_t>(live.size) - retired_count;
+    while (free_nodes + (mapping_size - live.used) / sizeof(mapped_node) < count) {
+        grow();
+    }
+}
+
+template<typename T>
+uint64_t mapped_avl_tree<T>::allocate() noexcept
+{
+    uint64_t offset = live.free_list;
+    if (offset) {
+        live.free_list = node(offset).next;
+    }
+    else {
+        offset = live.used;
+        live.used += sizeof(mapped_node);
+    }
+    node(offset).generation = live.generation;
+    return offset;
+}
+
+// A node the last sync saved may still be in the tree a crash goes back
+// to, so it waits for the next sync before it is reused.
+template<typename T>
+void mapped_avl_tree<T>::deallocate(uint64_t offset) noexcept
+{
+    if (node(offset).generation == live.generation) {
+        node(offset).next = live.free_list;
+        live.free_list = offset;
+        return;
+    }
+    node(offset).next = retired;
+    retired = offset;
+    if (retired_tail == 0) {
+        retired_tail = offset;
+    }
+    ++retired_count;
+}
+
+template<typename T>
+bool mapped_avl_tree<T>::intact(header_slot const& slot) const noexcept
+{
+    auto is_node = [&slot](uint64_t offset)
+    {
+        return offset == 0 || (offset >= nodes_offset() && offset < slot.used &&
+                               (offset - nodes_offset()) % sizeof(mapped_node) == 0);
+    };
+    return slot.generation != 0 && slot.checksum == checksum(slot) && slot.used >= nodes_offset() &&
+           slot.used <= mapping_size && (slot.used - nodes_offset()) % sizeof(mapped_node) == 0 &&
+           is_node(slot.root) && is_node(slot.free_list);
+}
+
+// After a crash the free list may have been taken apart by the changes
+// made since the slot was written; every node the tree does not reach is
+// free.
+template<typename T>
+void mapped_avl_tree<T>::rebuild_free_list()
+{
+    size_t count = static_cast<size_t>((live.used - nodes_offset()) / sizeof(mapped_node));
+    std::vector<bool> reached(count);
+    std::vector<uint64_t> pending;
+    if (live.root) {
+        pending.push_back(live.root);
+    }
+    uint64_t reached_count = 0;
+    while (!pending.empty()) {
+        uint64_t offset = pending.back();
+        pending.pop_back();
+        size_t index = static_cast<size_t>((offset - nodes_offset()) / sizeof(mapped_node));
+        if (offset < nodes_offset() || offset >= live.used || (offset - nodes_offset()) % sizeof(mapped_node) != 0 ||
+            reached[index]) {
+            throw avl_tree_snapshot_error("mapped_avl_tree: damaged links");
+        }
+        reached[index] = true;
+        ++reached_count;
+        for (uint64_t child : {node(offset).left, node(offset).right}) {
+            if (child) {
+                pending.push_back(child);
+            }
+        }
+    }
+    if (reached_count != live.size) {
+        throw avl_tree_snapshot_error("mapped_avl_tree: size does not match the tree");
+    }
+    live.free_list = 0;
+    for (size_t index = count; index-- != 0;) {
+        if (!reached[index]) {
+            uint64_t offset = nodes_offset() + index * sizeof(mapped_node);
+            node(offset).next = live.free_list;
+            live.free_list = offset;
+        }
+    }
+}
+
+// The nodes go to disk first, then the older slot, so the newer one stays
+// intact until its replacement is complete.
+template<typename T>
+void mapped_avl_tree<T>::write_slot(bool closed)
+{
+    if (msync(base, mapping_size, MS_SYNC) != 0) {
+        throw std::system_error(errno, std::generic_category(), "mapped_avl_tree: msync");
+    }
+    size_t next = 1 - newest;
+    header_slot& slot = header().slots[next];
+    slot = live;
+    slot.closed = closed;
+    slot.checksum = checksum(slot);
+    if (msync(base, sizeof(file_header), MS_SYNC) != 0) {
+        throw std::system_error(errno, std::generic_category(), "mapped_avl_tree: msync");
+    }
+    newest = next;
+    ++live.generation;
+}
+
+// A slot written on close vouches for its free list, and the first change
+// takes that list apart; a crash from then on must rebuild it.
+template<typename T>
+void mapped_avl_tree<T>::mark_changed()
+{
+    if (!changed && header().slots[newest].closed) {
+        write_slot(false);
+    }
+    changed = true;
+}
+
+template<typename T>
+void mapped_avl_tree<T>::close_file() noexcept
+{
+    if (base) {
+        munmap(base, mapping_size);
+        base = nullptr;
+    }
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+template<typename T>
+mapped_avl_tree<T>::mapped_avl_tree(char const* path)
+{
+    int flags = O_RDWR | O_CREAT;
+#ifdef O_BINARY
+    flags |= O_BINARY;
+#endif
+    fd = open(path, flags, 0644);
+    if (fd == -1) {
+        throw std::system_error(errno, std::generic_category(), "mapped_avl_tree: open");
+    }
+    try {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            throw std::system_error(errno, std::generic_category(), "mapped_avl_tree: stat");
+        }
+        if (info.st_size == 0) {
+            if (ftruncate(fd, static_cast<off_t>(initial_file_size)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "mapped_avl_tree: ftruncate");
+            }
+            map(initial_file_size);
+            file_header& h = header();
+            std::copy(std::begin(expected_magic), std::end(expected_magic), h.magic);
+            h.version = current_version;
+            h.value_size = sizeof(T);
+            h.node_size = sizeof(mapped_node);
+            live.generation = 1;
+            live.used = nodes_offset();
+            write_slot(true);
+            return;
+        }
+        if (static_cast<uint64_t>(info.st_size) < sizeof(file_header)) {
+            throw avl_tree_snapshot_error("mapped_avl_tree: file too short");
+        }
+        map(static_cast<size_t>(info.st_size));
+        file_header const& h = header();
+        if (!std::equal(std::begin(h.magic), std::end(h.magic), expected_magic)) {
+            throw avl_tree_snapshot_error("mapped_avl_tree: not a mapped tree");
+        }
+        if (h.version != current_version) {
+            throw avl_tree_snapshot_error("mapped_avl_tree: unsupported version");
+        }
+        if (h.value_size != sizeof(T) || h.node_size != sizeof(mapped_node)) {
+            throw avl_tree_snapshot_error("mapped_avl_tree: written for another value type");
+        }
+        bool first = intact(h.slots[0]);
+        bool second = intact(h.slots[1]);
+        if (!first && !second) {
+            throw avl_tree_snapshot_error("mapped_avl_tree: no intact header slot");
+        }
+        newest = !first || (second && h.slots[1].generation > h.slots[0].generation) ? 1 : 0;
+        live = h.slots[newest];
+        ++live.generation;
+        if (!h.slots[newest].closed) {
+            rebuild_free_list();
+        }
+    }
+    catch (...) {
+        close_file();
+        throw;
+    }
+}
+
+template<typename T>
+mapped_avl_tree<T>::~mapped_avl_tree()
+{
+    try {
+        sync();
+        if (!header().slots[newest].closed) {
+            write_slot(true);
+        }
+    }
+    catch (...) {
+        // the last slot written is still intact and is reopened
+    }
+    close_file();
+}
+
+template<typename T>
+bool mapped_avl_tree<T>::insert(T const& value)
+{
+    // a value that is already there changes nothing, not even the header
+    if (find(value) != end()) {
+        return false;
+    }
+    // value may live in the mapping, which reserve can move
+    T const copy = value;
+    mark_changed();
+    // the new node, the path to it and the nodes rotations move
+    reserve(3 * static_cast<size_t>(height(live.root) + 2));
+    uint64_t fresh = allocate();
+    mapped_node& n = node(fresh);
+    n.value = copy;
+    n.left = 0;
+    n.right = 0;
+    n.height = 1;
+    bool inserted = false;
+    uint64_t root = 0;
+    try {
+        root = insert(live.root, fresh, inserted);
+    }
+    catch (...) {
+        deallocate(fresh);
+        throw;
+    }
+    if (!inserted) {
+        deallocate(fresh);
+        return false;
+    }
+    live.root = root;
+    ++live.size;
+    return true;
+}
+
+template<typename T>
+bool mapped_avl_tree<T>::erase(T const& value)
+{
+    if (find(value) == end()) {
+        return false;
+    }
+    T const copy = value;
+    mark_changed();
+    reserve(3 * static_cast<size_t>(height(live.root) + 2));
+    uint64_t removed = 0;
+    uint64_t root = remove(live.root, copy, removed);
+    if (removed == 0) {
+        return false;
+    }
+    live.root = root;
+    deallocate(removed);
+    --live.size;
+    return true;
+}
+
+template<typename T>
+void mapped_avl_tree<T>::clear()
+{
+    if (live.root == 0) {
+        return;
+    }
+    mark_changed();
+    // next is free to use as the stack, the walk only reads the links
+    uint64_t stack = live.root;
+    node(stack).next = 0;
+    while (stack) {
+        uint64_t offset = stack;
+        stack = node(offset).next;
+        for (uint64_t child : {node(offset).left, node(offset).right}) {
+            if (child) {
+                node(child).next = stack;
+                stack = child;
+            }
+        }
+        deallocate(offset);
+    }
+    live.root = 0;
+    live.size = 0;
+}
+
+// The nodes waiting for this sync are in no tree it leaves to go back to,
+// so they join the free list once the slot is written.
+template<typename T>
+void mapped_avl_tree<T>::sync()
+{
+    if (!changed) {
+        return;
+    }
+    write_slot(false);
+    changed = false;
+    if (retired) {
+        node(retired_tail).next = live.free_list;
+        live.free_list = retired;
+        retired = 0;
+        retired_tail = 0;
+        retired_count = 0;
+    }
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator mapped_avl_tree<T>::find(T const& value) const
+{
+    uint64_t offset = lower_bound_node(value);
+    if (offset == 0 || value < node(offset).value) {
+        return end();
+    }
+    return const_iterator(this, offset);
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator mapped_avl_tree<T>::lower_bound(T const& value) const
+{
+    return const_iterator(this, lower_bound_node(value));
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator mapped_avl_tree<T>::upper_bound(T const& value) const
+{
+    return const_iterator(this, upper_bound_node(value));
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator mapped_avl_tree<T>::begin() const
+{
+    uint64_t offset = live.root;
+    while (offset && node(offset).left) {
+        offset = node(offset).left;
+    }
+    return const_iterator(this, offset);
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator mapped_avl_tree<T>::end() const noexcept
+{
+    return const_iterator(this, 0);
+}
+
+template<typename T>
+size_t mapped_avl_tree<T>::size() const noexcept
+{
+    return static_cast<size_t>(live.size);
+}
+
+template<typename T>
+bool mapped_avl_tree<T>::empty() const noexcept
+{
+    return live.size == 0;
+}
+
+template<typename T>
+size_t mapped_avl_tree<T>::file_size() const noexcept
+{
+    return mapping_size;
+}
+
+template<typename T>
+T const& mapped_avl_tree<T>::const_iterator::operator*() const noexcept
+{
+    return tree->node(offset).value;
+}
+
+template<typename T>
+T const* mapped_avl_tree<T>::const_iterator::operator->() const noexcept
+{
+    return &tree->node(offset).value;
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator& mapped_avl_tree<T>::const_iterator::operator++()
+{
+    offset = tree->upper_bound_node(tree->node(offset).value);
+    return *this;
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator mapped_avl_tree<T>::const_iterator::operator++(int)
+{
+    const_iterator old = *this;
+    ++*this;
+    return old;
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator& mapped_avl_tree<T>::const_iterator::operator--()
+{
+    offset = tree->maximum_before(offset ? &tree->node(offset).value : nullptr);
+    return *this;
+}
+
+template<typename T>
+typename mapped_avl_tree<T>::const_iterator mapped_avl_tree<T>::const_iterator::operator--(int)
+{
+    const_iterator old = *this;
+    --*this;
+    return old;
+}
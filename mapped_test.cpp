@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <csignal>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_avl_tree.h"
+
+namespace
+{
+// A file on tmpfs where there is one, removed again at the end.
+struct scratch_file
+{
+    std::string path;
+
+    explicit scratch_file(char const* name)
+        : path((std::ifstream("/dev/shm/.") ? std::string("/dev/shm/") : std::string()) + name)
+    {
+        std::remove(path.c_str());
+    }
+
+    ~scratch_file()
+    {
+        std::remove(path.c_str());
+    }
+
+    void copy_to(scratch_file const& other) const
+    {
+        std::ifstream in(path, std::ios::binary);
+        std::ofstream(other.path, std::ios::binary) << in.rdbuf();
+    }
+};
+}
+
+TEST(mapped, survives_reopen)
+{
+    scratch_file file("mapped_reopen.bin");
+    std::set<int> expected;
+    std::mt19937 rng(40);
+    {
+        mapped_avl_tree<int> c(file.path.c_str());
+        for (int i = 0; i != 30000; ++i) {
+            int value = static_cast<int>(rng() % 20000);
+            if (rng() % 3 == 0) {
+                EXPECT_EQ(expected.erase(value) != 0, c.erase(value));
+            }
+            else {
+                EXPECT_EQ(expected.insert(value).second, c.insert(value));
+            }
+        }
+        EXPECT_EQ(expected.size(), c.size());
+    }
+    mapped_avl_tree<int> c(file.path.c_str());
+    EXPECT_EQ(expected.size(), c.size());
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+    EXPECT_EQ(*expected.rbegin(), *--c.end());
+    for (int i = -1; i < 20001; i += 13) {
+        EXPECT_EQ(expected.count(i) != 0, c.find(i) != c.end());
+        auto upper = expected.upper_bound(i);
+        EXPECT_EQ(upper == expected.end() ? c.end() : c.find(*upper), c.upper_bound(i));
+    }
+    c.insert(-5);
+    EXPECT_EQ(-5, *c.begin());
+}
+
+TEST(mapped, reuses_freed_nodes)
+{
+    scratch_file file("mapped_free_list.bin");
+    mapped_avl_tree<long long> c(file.path.c_str());
+    for (long long i = 0; i != 20000; ++i) {
+        c.insert(i);
+    }
+    size_t grown = c.file_size();
+    for (long long i = 0; i != 20000; ++i) {
+        EXPECT_TRUE(c.erase(i));
+    }
+    EXPECT_TRUE(c.empty());
+    EXPECT_TRUE(c.begin() == c.end());
+    for (long long i = 0; i != 20000; ++i) {
+        c.insert(-i);
+    }
+    EXPECT_EQ(grown, c.file_size());
+    EXPECT_EQ(-19999, *c.begin());
+}
+
+// A copy taken at any point is what a crash would leave behind.
+TEST(mapped, copy_between_syncs_opens_at_last_sync)
+{
+    scratch_file file("mapped_between_syncs.bin");
+    scratch_file copy("mapped_between_syncs_copy.bin");
+    mapped_avl_tree<int> c(file.path.c_str());
+    for (int i = 0; i != 1000; ++i) {
+        c.insert(i);
+    }
+    c.sync();
+    for (int i = 0; i != 1000; i += 2) {
+        c.erase(i);
+    }
+    for (int i = 1000; i != 20000; ++i) {
+        c.insert(i);
+    }
+    file.copy_to(copy);
+    {
+        mapped_avl_tree<int> synced(copy.path.c_str());
+        EXPECT_EQ(1000u, synced.size());
+        EXPECT_EQ(0, *synced.begin());
+        EXPECT_EQ(999, *--synced.end());
+    }
+
+    c.sync();
+    c.clear();
+    file.copy_to(copy);
+    mapped_avl_tree<int> synced(copy.path.c_str());
+    EXPECT_EQ(19500u, synced.size());
+    EXPECT_EQ(1, *synced.begin());
+    // the free list was rebuilt, so what the crash left behind is reused
+    size_t file_size = synced.file_size();
+    for (int i = 0; i != 1000; ++i) {
+        synced.erase(2 * i + 1);
+        synced.insert(-i);
+    }
+    EXPECT_EQ(file_size, synced.file_size());
+}
+
+TEST(mapped, changes_that_change_nothing_keep_file_clean)
+{
+    scratch_file file("mapped_no_op.bin");
+    scratch_file copy("mapped_no_op_copy.bin");
+    mapped_avl_tree<int> c(file.path.c_str());
+    for (int i = 0; i != 5000; ++i) {
+        c.insert(i);
+    }
+    c.sync();
+    size_t file_size = c.file_size();
+    EXPECT_FALSE(c.insert(*c.begin()));
+    EXPECT_FALSE(c.insert(4999));
+    EXPECT_FALSE(c.erase(-1));
+    EXPECT_EQ(file_size, c.file_size());
+    file.copy_to(copy);
+    mapped_avl_tree<int> clean(copy.path.c_str());
+    EXPECT_EQ(5000u, clean.size());
+}
+
+#ifndef _WIN32
+TEST(mapped, crash_keeps_synced_contents)
+{
+    scratch_file file("mapped_crash.bin");
+    auto change = [](std::mt19937& rng, auto& tree)
+    {
+        int value = static_cast<int>(rng() % 20000);
+        if (rng() % 3 == 0) {
+            tree.erase(value);
+        }
+        else {
+            tree.insert(value);
+        }
+    };
+    pid_t pid = fork();
+    if (pid == 0) {
+        mapped_avl_tree<int> c(file.path.c_str());
+        std::mt19937 rng(41);
+        for (int round = 0; round != 4; ++round) {
+            for (int i = 0; i != 10000; ++i) {
+                change(rng, c);
+            }
+            c.sync();
+        }
+        for (int i = 0; i != 50000; ++i) {
+            change(rng, c);
+        }
+        raise(SIGKILL);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    ASSERT_TRUE(WIFSIGNALED(status));
+
+    std::set<int> expected;
+    std::mt19937 rng(41);
+    for (int i = 0; i != 4 * 10000; ++i) {
+        change(rng, expected);
+    }
+    {
+        mapped_avl_tree<int> c(file.path.c_str());
+        EXPECT_EQ(expected.size(), c.size());
+        EXPECT_TRUE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+        std::mt19937 same = rng;
+        for (int i = 0; i != 10000; ++i) {
+            change(rng, c);
+            change(same, expected);
+        }
+    }
+    mapped_avl_tree<int> c(file.path.c_str());
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+}
+#endif
+
+TEST(mapped, rejects_foreign_files)
+{
+    scratch_file file("mapped_foreign.bin");
+    {
+        mapped_avl_tree<int> c(file.path.c_str());
+        c.insert(1);
+    }
+    EXPECT_THROW(mapped_avl_tree<double>(file.path.c_str()), avl_tree_snapshot_error);
+    std::ofstream(file.path, std::ios::binary) << "not a tree, but long enough to hold a header";
+    EXPECT_THROW(mapped_avl_tree<int>(file.path.c_str()), avl_tree_snapshot_error);
+}
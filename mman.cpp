@@ -177,3 +177,8 @@ int munlock(const void *addr, size_t len)
 
     return -1;
 }
+
+int madvise(void *addr, size_t len, int advice)
+{
+    return 0;
+}
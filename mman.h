@@ -3,6 +3,10 @@
  * mman-win32
  */
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#else
+
 #ifndef _SYS_MMAN_H_
 #define _SYS_MMAN_H_
 
@@ -41,15 +45,25 @@ extern "C" {
 #define MS_SYNC         2
 #define MS_INVALIDATE   4
 
+/* Advice for madvise, accepted and ignored. */
+#define MADV_NORMAL     0
+#define MADV_RANDOM     1
+#define MADV_SEQUENTIAL 2
+#define MADV_WILLNEED   3
+#define MADV_DONTNEED   4
+
 void*   mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off);
 int     munmap(void *addr, size_t len);
 int     mprotect(void *addr, size_t len, int prot);
 int     msync(void *addr, size_t len, int flags);
 int     mlock(const void *addr, size_t len);
 int     munlock(const void *addr, size_t len);
+int     madvise(void *addr, size_t len, int advice);
 
 #ifdef __cplusplus
 };
 #endif
 
 #endif /*  _SYS_MMAN_H_ */
+
+#endif /* _WIN32 */
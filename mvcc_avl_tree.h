@@ -0,0 +1,67 @@
+#ifndef MVCC_AVL_TREE_H
+#define MVCC_AVL_TREE_H
+
+#include <atomic>
+#include <cstddef>
+
+#include <persistent_avl_tree.h>
+
+// Single writer, many readers. The writer mutates a private draft and
+// publishes it as an immutable persistent_avl_tree version; readers pin the
+// current version without locks and never wait for the writer. A version is
+// released by the writer once it is neither current nor pinned; nodes it
+// shares with newer versions stay alive through their reference counts.
+template<typename T>
+struct mvcc_avl_tree {
+private:
+    static constexpr size_t slots_count = 8;
+
+    struct alignas(64) slot {
+        mutable std::atomic<size_t> readers{0};
+        persistent_avl_tree<T> version{};
+    };
+
+    slot slots[slots_count];
+    std::atomic<size_t> current{0};
+    persistent_avl_tree<T> draft{};
+
+    size_t pin() const noexcept;
+    void unpin(size_t) const noexcept;
+
+public:
+    struct read_guard {
+    private:
+        mvcc_avl_tree const* tree;
+        size_t index;
+
+        read_guard(mvcc_avl_tree const*, size_t) noexcept;
+
+        friend struct mvcc_avl_tree;
+    public:
+        read_guard(read_guard&&) noexcept;
+        read_guard(read_guard const&) = delete;
+        read_guard& operator=(read_guard&&) noexcept;
+        read_guard& operator=(read_guard const&) = delete;
+        ~read_guard();
+
+        persistent_avl_tree<T> const& operator* () const noexcept;
+        persistent_avl_tree<T> const* operator-> () const noexcept;
+    };
+
+    mvcc_avl_tree() noexcept;
+    mvcc_avl_tree(mvcc_avl_tree const&) = delete;
+    mvcc_avl_tree& operator=(mvcc_avl_tree const&) = delete;
+
+    // reader side, any number of threads
+    read_guard read() const noexcept;
+    persistent_avl_tree<T> snapshot() const noexcept;
+
+    // writer side, one thread at a time
+    bool insert(T const&);
+    bool erase(T const&);
+    void clear() noexcept;
+    void publish();
+};
+
+#include <mvcc_avl_tree.tpp>
+#endif //MVCC_AVL_TREE_H
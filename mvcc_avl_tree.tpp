@@ -0,0 +1,129 @@
+#include <thread>
+
+template<typename T>
+mvcc_avl_tree<T>::mvcc_avl_tree() noexcept { }
+
+// A reader announces itself on the slot it is about to use and only then
+// checks that the slot is still current. The writer only overwrites slots
+// that are not current and have no readers, so a reader either sees the
+// version it pinned or backs off before touching it.
+template<typename T>
+size_t mvcc_avl_tree<T>::pin() const noexcept
+{
+    for (;;) {
+        size_t index = current.load();
+        slots[index].readers.fetch_add(1);
+        if (current.load() == index) {
+            return index;
+        }
+        slots[index].readers.fetch_sub(1);
+    }
+}
+
+template<typename T>
+void mvcc_avl_tree<T>::unpin(size_t index) const noexcept
+{
+    slots[index].readers.fetch_sub(1);
+}
+
+template<typename T>
+mvcc_avl_tree<T>::read_guard::read_guard(mvcc_avl_tree const* tree, size_t index) noexcept : tree(tree), index(index) { }
+
+template<typename T>
+mvcc_avl_tree<T>::read_guard::read_guard(read_guard&& other) noexcept : tree(other.tree), index(other.index)
+{
+    other.tree = nullptr;
+}
+
+template<typename T>
+typename mvcc_avl_tree<T>::read_guard& mvcc_avl_tree<T>::read_guard::operator=(read_guard&& other) noexcept
+{
+    if (this != &other) {
+        if (tree) {
+            tree->unpin(index);
+        }
+        tree = other.tree;
+        index = other.index;
+        other.tree = nullptr;
+    }
+    return *this;
+}
+
+template<typename T>
+mvcc_avl_tree<T>::read_guard::~read_guard()
+{
+    if (tree) {
+        tree->unpin(index);
+    }
+}
+
+template<typename T>
+persistent_avl_tree<T> const& mvcc_avl_tree<T>::read_guard::operator*() const noexcept
+{
+    return tree->slots[index].version;
+}
+
+template<typename T>
+persistent_avl_tree<T> const* mvcc_avl_tree<T>::read_guard::operator->() const noexcept
+{
+    return &tree->slots[index].version;
+}
+
+template<typename T>
+typename mvcc_avl_tree<T>::read_guard mvcc_avl_tree<T>::read() const noexcept
+{
+    return read_guard(this, pin());
+}
+
+template<typename T>
+persistent_avl_tree<T> mvcc_avl_tree<T>::snapshot() const noexcept
+{
+    read_guard guard = read();
+    return *guard;
+}
+
+template<typename T>
+bool mvcc_avl_tree<T>::insert(T const& value)
+{
+    return draft.insert(value).second;
+}
+
+template<typename T>
+bool mvcc_avl_tree<T>::erase(T const& value)
+{
+    auto it = draft.find(value);
+    if (it == draft.end()) {
+        return false;
+    }
+    draft.erase(it);
+    return true;
+}
+
+template<typename T>
+void mvcc_avl_tree<T>::clear() noexcept
+{
+    draft.clear();
+}
+
+// Spins only while every spare slot is pinned by a reader. Idle stale slots
+// are dropped right away so old versions do not outlive their readers.
+template<typename T>
+void mvcc_avl_tree<T>::publish()
+{
+    size_t old = current.load();
+    size_t index = (old + 1) % slots_count;
+    while (slots[index].readers.load() != 0) {
+        index = (index + 1) % slots_count;
+        if (index == old) {
+            std::this_thread::yield();
+            index = (old + 1) % slots_count;
+        }
+    }
+    slots[index].version = draft;
+    current.store(index);
+    for (size_t i = 0; i != slots_count; ++i) {
+        if (i != index && slots[i].readers.load() == 0) {
+            slots[i].version.clear();
+        }
+    }
+}
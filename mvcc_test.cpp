@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+#include "mvcc_avl_tree.h"
+#include "counted.h"
+
+TEST(mvcc, publish_makes_changes_visible)
+{
+    counted::no_new_instances_guard g;
+
+    mvcc_avl_tree<counted> t;
+    EXPECT_TRUE(t.read()->empty());
+    EXPECT_TRUE(t.insert(2));
+    EXPECT_TRUE(t.insert(1));
+    EXPECT_FALSE(t.insert(2));
+    EXPECT_TRUE(t.read()->empty());
+    t.publish();
+    {
+        auto guard = t.read();
+        EXPECT_EQ(1, *guard->begin());
+        EXPECT_EQ(2, *std::next(guard->begin()));
+    }
+    EXPECT_TRUE(t.erase(1));
+    EXPECT_FALSE(t.erase(1));
+    t.publish();
+    EXPECT_EQ(t.read()->end(), t.read()->find(1));
+}
+
+TEST(mvcc, snapshot_survives_later_versions)
+{
+    counted::no_new_instances_guard g;
+
+    mvcc_avl_tree<counted> t;
+    t.insert(1);
+    t.publish();
+    persistent_avl_tree<counted> old = t.snapshot();
+    for (int i = 2; i != 40; ++i) {
+        t.insert(i);
+        t.erase(i - 1);
+        t.publish();
+    }
+    EXPECT_EQ(1, *old.begin());
+    EXPECT_EQ(39, *t.snapshot().begin());
+}
+
+TEST(mvcc, pinned_readers_do_not_block_writer)
+{
+    mvcc_avl_tree<int> t;
+    std::vector<mvcc_avl_tree<int>::read_guard> pinned;
+    for (int i = 0; i != 20; ++i) {
+        t.insert(i);
+        t.publish();
+        if (i % 3 == 0) {
+            pinned.push_back(t.read());
+        }
+        if (pinned.size() > 4) {
+            pinned.erase(pinned.begin());
+        }
+    }
+    EXPECT_EQ(19, *std::prev(t.read()->end()));
+}
+
+TEST(mvcc, concurrent_readers_see_consistent_versions)
+{
+    mvcc_avl_tree<int> t;
+    std::atomic<bool> done{false};
+    std::atomic<size_t> failures{0};
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r != 4; ++r) {
+        readers.emplace_back([&]
+        {
+            int last = -1;
+            while (!done.load()) {
+                auto guard = t.read();
+                // every published version holds exactly 0..k
+                int expected = 0;
+                for (int value : *guard) {
+                    if (value != expected++) {
+                        ++failures;
+                    }
+                }
+                if (expected - 1 < last) {
+                    ++failures;
+                }
+                last = expected - 1;
+            }
+        });
+    }
+
+    for (int i = 0; i != 2000; ++i) {
+        t.insert(i);
+        t.publish();
+    }
+    done.store(true);
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(0u, failures.load());
+    EXPECT_EQ(1999, *std::prev(t.read()->end()));
+}
@@ -0,0 +1,148 @@
+#ifndef PERSISTENT_AVL_TREE_H
+#define PERSISTENT_AVL_TREE_H
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Copy-on-write variant of avl_tree. Copies share the whole structure in O(1),
+// mutations copy only the nodes on the root-to-change path. Nodes have no
+// parent pointers, so iterators carry the path from the root instead.
+// Any mutation invalidates iterators of the mutated tree, but never those of
+// its copies.
+template<typename T>
+struct persistent_avl_tree {
+private:
+    struct avl_tree_node;
+    typedef std::shared_ptr<avl_tree_node> node_ptr;
+    struct avl_tree_node {
+        T value;
+        ptrdiff_t height = 1;
+        node_ptr left = nullptr;
+        node_ptr right = nullptr;
+
+        explicit avl_tree_node(T const& value);
+    };
+
+    node_ptr root = nullptr;
+
+    template<bool is_const_iterator>
+    struct const_noconst_iterator {
+        using iterator_category = std::bidirectional_iterator_tag;
+        using value_type = T;
+        using difference_type = ptrdiff_t;
+        using pointer = T const*;
+        using reference = T const&;
+
+    private:
+        avl_tree_node const* root;
+        std::vector<avl_tree_node const*> path;
+
+        const_noconst_iterator(avl_tree_node const*, std::vector<avl_tree_node const*>&&) noexcept;
+
+        avl_tree_node const* current() const noexcept;
+
+        friend struct persistent_avl_tree;
+    public:
+        const_noconst_iterator();
+        const_noconst_iterator(const_noconst_iterator const&) = default;
+        const_noconst_iterator(const_noconst_iterator&&) noexcept = default;
+        template<bool any_const_noconst, typename = std::enable_if_t<is_const_iterator && !any_const_noconst>>
+        const_noconst_iterator(const_noconst_iterator<any_const_noconst> const&); // NOLINT
+
+        const_noconst_iterator& operator=(const_noconst_iterator const&) = default;
+        const_noconst_iterator& operator=(const_noconst_iterator&&) noexcept = default;
+
+        template<bool any_const_noconst>
+        bool operator==(const_noconst_iterator<any_const_noconst> const&) const noexcept;
+        template<bool any_const_noconst>
+        bool operator!=(const_noconst_iterator<any_const_noconst> const&) const noexcept;
+
+        typename const_noconst_iterator::reference operator* () const noexcept;
+        typename const_noconst_iterator::pointer operator-> () const noexcept;
+
+        const_noconst_iterator& operator++();
+        const_noconst_iterator operator++(int); // NOLINT
+        const_noconst_iterator& operator--();
+        const_noconst_iterator operator--(int); // NOLINT
+    };
+
+public:
+    typedef const_noconst_iterator<false> iterator;
+    typedef const_noconst_iterator<true> const_iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+private:
+    static ptrdiff_t height(node_ptr const&) noexcept;
+    static void fix_height(node_ptr const&) noexcept;
+    static ptrdiff_t difference(node_ptr const&) noexcept;
+    static void unshare(node_ptr&);
+    static void rr_rotation(node_ptr&);
+    static void ll_rotation(node_ptr&);
+    static void rl_rotation(node_ptr&);
+    static void lr_rotation(node_ptr&);
+    static void balance(node_ptr&);
+
+    static node_ptr insert(node_ptr const&, T const&, bool&);
+    static node_ptr remove(node_ptr const&, T const&, bool&);
+    static node_ptr remove_minimum(node_ptr const&, node_ptr&);
+
+    static node_ptr join(node_ptr const&, T const&, node_ptr const&);
+    static void split(node_ptr const&, T const&, node_ptr&, node_ptr&, bool&);
+    template<typename F>
+    static void for_each_value(avl_tree_node const*, F&);
+    template<typename Added, typename Removed>
+    static void diff(node_ptr const&, node_ptr const&, Added&, Removed&);
+
+    static iterator find(node_ptr const&, T const&);
+    static iterator lower_bound(node_ptr const&, T const&);
+    static iterator upper_bound(node_ptr const&, T const&);
+
+public:
+    persistent_avl_tree() noexcept;
+    persistent_avl_tree(persistent_avl_tree const&) noexcept;
+    persistent_avl_tree& operator=(persistent_avl_tree const&) noexcept;
+    ~persistent_avl_tree();
+
+    iterator find(T const&) const;
+    iterator lower_bound(T const&) const;
+    iterator upper_bound(T const&) const;
+    std::pair<iterator, bool> insert(T const&);
+    iterator erase(const_iterator);
+    bool empty() const noexcept;
+    void clear() noexcept;
+
+    void swap(persistent_avl_tree&) noexcept;
+
+    // Calls on_added for every value of to that is not in from and
+    // on_removed for every value of from that is not in to, together in
+    // ascending order. Subtrees the two trees share are skipped without
+    // being visited; for the rest the root of one side splits the other,
+    // so trees copied from each other are compared in time proportional
+    // to the changes made since, times a log factor. The splits allocate
+    // temporary nodes; neither tree is changed.
+    template<typename Added, typename Removed>
+    friend void diff(persistent_avl_tree const& from, persistent_avl_tree const& to, Added on_added,
+                     Removed on_removed)
+    {
+        persistent_avl_tree::diff(from.root, to.root, on_added, on_removed);
+    }
+
+    iterator begin() const;
+    const_iterator cbegin() const;
+    iterator end() const noexcept;
+    const_iterator cend() const noexcept;
+    reverse_iterator rbegin() const;
+    const_reverse_iterator crbegin() const;
+    reverse_iterator rend() const;
+    const_reverse_iterator crend() const;
+};
+
+template<typename T>
+void swap(persistent_avl_tree<T>&, persistent_avl_tree<T>&) noexcept;
+
+#include <persistent_avl_tree.tpp>
+#endif //PERSISTENT_AVL_TREE_H
@@ -0,0 +1,581 @@
+#include <algorithm>
+
+template<typename T>
+persistent_avl_tree<T>::avl_tree_node::avl_tree_node(T const& value) : value(value) { }
+
+template<typename T>
+ptrdiff_t persistent_avl_tree<T>::height(node_ptr const& node) noexcept
+{
+    return node ? node->height : 0;
+}
+
+template<typename T>
+void persistent_avl_tree<T>::fix_height(node_ptr const& node) noexcept
+{
+    node->height = std::max(height(node->left), height(node->right)) + 1;
+}
+
+template<typename T>
+ptrdiff_t persistent_avl_tree<T>::difference(node_ptr const& node) noexcept
+{
+    return height(node->left) - height(node->right);
+}
+
+// Must only be called on a slot owned by a node that is already private to
+// the mutation in progress: then use_count() == 1 means nobody else sees it.
+template<typename T>
+void persistent_avl_tree<T>::unshare(node_ptr& node)
+{
+    if (node.use_count() != 1) {
+        node.reset(new avl_tree_node(*node));
+    }
+}
+
+template<typename T>
+void persistent_avl_tree<T>::rr_rotation(node_ptr& node)
+{
+    unshare(node->right);
+    node_ptr right = std::move(node->right);
+    node->right = std::move(right->left);
+    fix_height(node);
+    right->left = std::move(node);
+    fix_height(right);
+    node = std::move(right);
+}
+
+template<typename T>
+void persistent_avl_tree<T>::ll_rotation(node_ptr& node)
+{
+    unshare(node->left);
+    node_ptr left = std::move(node->left);
+    node->left = std::move(left->right);
+    fix_height(node);
+    left->right = std::move(node);
+    fix_height(left);
+    node = std::move(left);
+}
+
+template<typename T>
+void persistent_avl_tree<T>::lr_rotation(node_ptr& node)
+{
+    unshare(node->left);
+    rr_rotation(node->left);
+    ll_rotation(node);
+}
+
+template<typename T>
+void persistent_avl_tree<T>::rl_rotation(node_ptr& node)
+{
+    unshare(node->right);
+    ll_rotation(node->right);
+    rr_rotation(node);
+}
+
+template<typename T>
+void persistent_avl_tree<T>::balance(node_ptr& node)
+{
+    fix_height(node);
+    auto diff = difference(node);
+    if (diff > 1) {
+        if (difference(node->left) >= 0) {
+            ll_rotation(node);
+        }
+        else {
+            lr_rotation(node);
+        }
+    }
+    else {
+        if (diff < -1) {
+            if (difference(node->right) > 0) {
+                rl_rotation(node);
+            }
+            else {
+                rr_rotation(node);
+            }
+        }
+    }
+}
+
+template<typename T>
+persistent_avl_tree<T>::persistent_avl_tree() noexcept { }
+
+template<typename T>
+persistent_avl_tree<T>::persistent_avl_tree(persistent_avl_tree const& other) noexcept : root(other.root) { }
+
+template<typename T>
+persistent_avl_tree<T>& persistent_avl_tree<T>::operator=(persistent_avl_tree const& other) noexcept
+{
+    root = other.root;
+    return *this;
+}
+
+template<typename T>
+persistent_avl_tree<T>::~persistent_avl_tree() = default;
+
+template<typename T>
+template<bool is_const_iterator>
+persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::const_noconst_iterator() : root(nullptr) { }
+
+template<typename T>
+template<bool is_const_iterator>
+persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::const_noconst_iterator(avl_tree_node const* root,
+        std::vector<avl_tree_node const*>&& path) noexcept : root(root), path(std::move(path)) { }
+
+template<typename T>
+template<bool is_const_iterator>
+template<bool any_const_noconst, typename>
+persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::const_noconst_iterator(
+        persistent_avl_tree<T>::const_noconst_iterator<any_const_noconst> const& other) : root(other.root), path(other.path) { }
+
+template<typename T>
+template<bool is_const_iterator>
+typename persistent_avl_tree<T>::avl_tree_node const* persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::current() const noexcept
+{
+    return path.empty() ? nullptr : path.back();
+}
+
+template<typename T>
+template<bool is_const_iterator>
+template<bool any_const_noconst>
+bool persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator==(
+        persistent_avl_tree<T>::const_noconst_iterator<any_const_noconst> const& other) const noexcept {
+    return current() == other.current();
+}
+
+template<typename T>
+template<bool is_const_iterator>
+template<bool any_const_noconst>
+bool persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator!=(
+        persistent_avl_tree<T>::const_noconst_iterator<any_const_noconst> const& other) const noexcept {
+    return !operator==(other);
+}
+
+template<typename T>
+template<bool is_const_iterator>
+typename persistent_avl_tree<T>::template const_noconst_iterator<is_const_iterator>& persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator++() {
+    avl_tree_node const* node = path.back();
+    if (node->right) {
+        node = node->right.get();
+        path.push_back(node);
+        while (node->left) {
+            node = node->left.get();
+            path.push_back(node);
+        }
+    } else {
+        path.pop_back();
+        while (!path.empty() && path.back()->right.get() == node) {
+            node = path.back();
+            path.pop_back();
+        }
+    }
+    return *this;
+}
+
+template<typename T>
+template<bool is_const_iterator>
+typename persistent_avl_tree<T>::template const_noconst_iterator<is_const_iterator>& persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator--()
+{
+    if (path.empty()) {
+        for (avl_tree_node const* node = root; node; node = node->right.get()) {
+            path.push_back(node);
+        }
+        return *this;
+    }
+    avl_tree_node const* node = path.back();
+    if (node->left) {
+        node = node->left.get();
+        path.push_back(node);
+        while (node->right) {
+            node = node->right.get();
+            path.push_back(node);
+        }
+    }
+    else {
+        path.pop_back();
+        while (!path.empty() && path.back()->left.get() == node) {
+            node = path.back();
+            path.pop_back();
+        }
+    }
+    return *this;
+}
+
+template<typename T>
+template<bool is_const_iterator>
+typename persistent_avl_tree<T>::template const_noconst_iterator<is_const_iterator> persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator++(int) {
+    const const_noconst_iterator copy(*this);
+    ++(*this);
+    return copy;
+}
+
+template<typename T>
+template<bool is_const_iterator>
+typename persistent_avl_tree<T>::template const_noconst_iterator<is_const_iterator> persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator--(int) {
+    const const_noconst_iterator copy(*this);
+    --(*this);
+    return copy;
+}
+
+template<typename T>
+template<bool is_const_iterator>
+typename persistent_avl_tree<T>::template const_noconst_iterator<is_const_iterator>::reference persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator*() const noexcept
+{
+    return path.back()->value;
+}
+
+template<typename T>
+template<bool is_const_iterator>
+typename persistent_avl_tree<T>::template const_noconst_iterator<is_const_iterator>::pointer persistent_avl_tree<T>::const_noconst_iterator<is_const_iterator>::operator->() const noexcept
+{
+    return &path.back()->value;
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::find(node_ptr const& root, T const& value)
+{
+    std::vector<avl_tree_node const*> path;
+    path.reserve(height(root));
+    avl_tree_node const* node = root.get();
+    while (node != nullptr) {
+        path.push_back(node);
+        if (value < node->value) {
+            node = node->left.get();
+        }
+        else if (node->value < value) {
+            node = node->right.get();
+        }
+        else {
+            return iterator(root.get(), std::move(path));
+        }
+    }
+    return iterator(root.get(), {});
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::lower_bound(node_ptr const& root, T const& value)
+{
+    std::vector<avl_tree_node const*> path;
+    path.reserve(height(root));
+    size_t successor = 0;
+    avl_tree_node const* node = root.get();
+    while (node != nullptr) {
+        path.push_back(node);
+        if (node->value < value) {
+            node = node->right.get();
+        }
+        else {
+            successor = path.size();
+            node = node->left.get();
+        }
+    }
+    path.resize(successor);
+    return iterator(root.get(), std::move(path));
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::upper_bound(node_ptr const& root, T const& value)
+{
+    std::vector<avl_tree_node const*> path;
+    path.reserve(height(root));
+    size_t successor = 0;
+    avl_tree_node const* node = root.get();
+    while (node != nullptr) {
+        path.push_back(node);
+        if (value < node->value) {
+            successor = path.size();
+            node = node->left.get();
+        }
+        else {
+            node = node->right.get();
+        }
+    }
+    path.resize(successor);
+    return iterator(root.get(), std::move(path));
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::find(T const& value) const
+{
+    return find(root, value);
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::lower_bound(T const& value) const
+{
+    return lower_bound(root, value);
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::upper_bound(T const& value) const
+{
+    return upper_bound(root, value);
+}
+
+template<typename T>
+bool persistent_avl_tree<T>::empty() const noexcept {
+    return root == nullptr;
+}
+
+template<typename T>
+void persistent_avl_tree<T>::clear() noexcept {
+    root.reset();
+}
+
+// insert and remove return the new version of the subtree and leave the old
+// one untouched, so any exception simply drops the half-built path.
+template<typename T>
+typename persistent_avl_tree<T>::node_ptr persistent_avl_tree<T>::insert(node_ptr const& node, T const& value, bool& inserted)
+{
+    if (node == nullptr) {
+        inserted = true;
+        return node_ptr(new avl_tree_node(value));
+    }
+    if (value < node->value) {
+        node_ptr left = insert(node->left, value, inserted);
+        if (!inserted) {
+            return node;
+        }
+        node_ptr copy(new avl_tree_node(*node));
+        copy->left = std::move(left);
+        balance(copy);
+        return copy;
+    }
+    if (node->value < value) {
+        node_ptr right = insert(node->right, value, inserted);
+        if (!inserted) {
+            return node;
+        }
+        node_ptr copy(new avl_tree_node(*node));
+        copy->right = std::move(right);
+        balance(copy);
+        return copy;
+    }
+    inserted = false;
+    return node;
+}
+
+template<typename T>
+std::pair<typename persistent_avl_tree<T>::iterator, bool> persistent_avl_tree<T>::insert(T const& value)
+{
+    bool inserted = false;
+    node_ptr new_root = insert(root, value, inserted);
+    if (!inserted) {
+        return {find(root, value), false};
+    }
+    iterator it = find(new_root, value);
+    root = std::move(new_root);
+    return {std::move(it), true};
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::node_ptr persistent_avl_tree<T>::remove_minimum(node_ptr const& node, node_ptr& minimum)
+{
+    if (node->left == nullptr) {
+        minimum = node;
+        return node->right;
+    }
+    node_ptr left = remove_minimum(node->left, minimum);
+    node_ptr copy(new avl_tree_node(*node));
+    copy->left = std::move(left);
+    balance(copy);
+    return copy;
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::node_ptr persistent_avl_tree<T>::remove(node_ptr const& node, T const& value, bool& removed)
+{
+    if (node == nullptr) {
+        removed = false;
+        return node;
+    }
+    if (value < node->value) {
+        node_ptr left = remove(node->left, value, removed);
+        if (!removed) {
+            return node;
+        }
+        node_ptr copy(new avl_tree_node(*node));
+        copy->left = std::move(left);
+        balance(copy);
+        return copy;
+    }
+    if (node->value < value) {
+        node_ptr right = remove(node->right, value, removed);
+        if (!removed) {
+            return node;
+        }
+        node_ptr copy(new avl_tree_node(*node));
+        copy->right = std::move(right);
+        balance(copy);
+        return copy;
+    }
+    removed = true;
+    if (node->right == nullptr) {
+        return node->left;
+    }
+    if (node->left == nullptr) {
+        return node->right;
+    }
+    node_ptr minimum;
+    node_ptr right = remove_minimum(node->right, minimum);
+    node_ptr copy(new avl_tree_node(minimum->value));
+    copy->left = node->left;
+    copy->right = std::move(right);
+    balance(copy);
+    return copy;
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::erase(const_iterator it)
+{
+    T const& value = *it;
+    bool removed = false;
+    node_ptr new_root = remove(root, value, removed);
+    iterator next = upper_bound(new_root, value);
+    root = std::move(new_root);
+    return next;
+}
+
+template<typename T>
+void persistent_avl_tree<T>::swap(persistent_avl_tree& other) noexcept {
+    root.swap(other.root);
+}
+
+// Both sides are left as they are: the nodes along the spine that value
+// is hung from are copied.
+template<typename T>
+typename persistent_avl_tree<T>::node_ptr persistent_avl_tree<T>::join(node_ptr const& left, T const& value,
+                                                                       node_ptr const& right)
+{
+    node_ptr node;
+    if (height(left) > height(right) + 1) {
+        node_ptr joined = join(left->right, value, right);
+        node.reset(new avl_tree_node(*left));
+        node->right = std::move(joined);
+    }
+    else if (height(right) > height(left) + 1) {
+        node_ptr joined = join(left, value, right->left);
+        node.reset(new avl_tree_node(*right));
+        node->left = std::move(joined);
+    }
+    else {
+        node.reset(new avl_tree_node(value));
+        node->left = left;
+        node->right = right;
+    }
+    balance(node);
+    return node;
+}
+
+template<typename T>
+void persistent_avl_tree<T>::split(node_ptr const& node, T const& value, node_ptr& less, node_ptr& greater,
+                                   bool& found)
+{
+    if (node == nullptr) {
+        less = nullptr;
+        greater = nullptr;
+        found = false;
+    }
+    else if (value < node->value) {
+        node_ptr rest;
+        split(node->left, value, less, rest, found);
+        greater = join(rest, node->value, node->right);
+    }
+    else if (node->value < value) {
+        node_ptr rest;
+        split(node->right, value, rest, greater, found);
+        less = join(node->left, node->value, rest);
+    }
+    else {
+        less = node->left;
+        greater = node->right;
+        found = true;
+    }
+}
+
+template<typename T>
+template<typename F>
+void persistent_avl_tree<T>::for_each_value(avl_tree_node const* node, F& f)
+{
+    if (node) {
+        for_each_value(node->left.get(), f);
+        f(node->value);
+        for_each_value(node->right.get(), f);
+    }
+}
+
+template<typename T>
+template<typename Added, typename Removed>
+void persistent_avl_tree<T>::diff(node_ptr const& from, node_ptr const& to, Added& on_added, Removed& on_removed)
+{
+    if (from == to) {
+        return;
+    }
+    if (from == nullptr) {
+        for_each_value(to.get(), on_added);
+        return;
+    }
+    if (to == nullptr) {
+        for_each_value(from.get(), on_removed);
+        return;
+    }
+    node_ptr less;
+    node_ptr greater;
+    bool found = false;
+    split(to, from->value, less, greater, found);
+    diff(from->left, less, on_added, on_removed);
+    if (!found) {
+        on_removed(from->value);
+    }
+    diff(from->right, greater, on_added, on_removed);
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::begin() const {
+    std::vector<avl_tree_node const*> path;
+    path.reserve(height(root));
+    for (avl_tree_node const* node = root.get(); node; node = node->left.get()) {
+        path.push_back(node);
+    }
+    return iterator(root.get(), std::move(path));
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::const_iterator persistent_avl_tree<T>::cbegin() const {
+    return begin();
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::iterator persistent_avl_tree<T>::end() const noexcept {
+    return iterator(root.get(), {});
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::const_iterator persistent_avl_tree<T>::cend() const noexcept {
+    return const_iterator(root.get(), {});
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::reverse_iterator persistent_avl_tree<T>::rbegin() const {
+    return persistent_avl_tree<T>::reverse_iterator(end());
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::const_reverse_iterator persistent_avl_tree<T>::crbegin() const {
+    return persistent_avl_tree<T>::const_reverse_iterator(cend());
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::reverse_iterator persistent_avl_tree<T>::rend() const {
+    return persistent_avl_tree<T>::reverse_iterator(begin());
+}
+
+template<typename T>
+typename persistent_avl_tree<T>::const_reverse_iterator persistent_avl_tree<T>::crend() const {
+    return persistent_avl_tree<T>::const_reverse_iterator(cbegin());
+}
+
+template<typename T>
+void swap(persistent_avl_tree<T>& lhs, persistent_avl_tree<T>& rhs) noexcept
+{
+    lhs.swap(rhs);
+}
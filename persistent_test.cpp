@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "persistent_avl_tree.h"
+#include "counted.h"
+using container = persistent_avl_tree<counted>;
+
+#include "tests.inl"
+
+TEST(persistent, copy_is_isolated)
+{
+    counted::no_new_instances_guard g;
+
+    container c;
+    mass_insert(c, {5, 3, 8, 1, 4, 7, 9});
+    container snapshot = c;
+    c.insert(6);
+    c.erase(c.find(3));
+    expect_eq(snapshot, {1, 3, 4, 5, 7, 8, 9});
+    expect_eq(c, {1, 4, 5, 6, 7, 8, 9});
+    snapshot.erase(snapshot.find(9));
+    expect_eq(snapshot, {1, 3, 4, 5, 7, 8});
+    expect_eq(c, {1, 4, 5, 6, 7, 8, 9});
+}
+
+TEST(persistent, snapshot_outlives_source)
+{
+    counted::no_new_instances_guard g;
+
+    container snapshot;
+    {
+        container c;
+        mass_insert(c, {2, 1, 3});
+        snapshot = c;
+        c.clear();
+    }
+    expect_eq(snapshot, {1, 2, 3});
+}
+
+TEST(persistent, snapshot_iterators_survive_mutation)
+{
+    counted::no_new_instances_guard g;
+
+    container c;
+    mass_insert(c, {1, 2, 3, 4, 5, 6, 7, 8});
+    container snapshot = c;
+    container::const_iterator i = snapshot.find(4);
+    for (int k = 1; k <= 8; ++k) {
+        c.erase(c.find(k));
+    }
+    EXPECT_TRUE(c.empty());
+    EXPECT_EQ(4, *i++);
+    EXPECT_EQ(5, *i);
+    EXPECT_EQ(snapshot.end(), std::next(i, 4));
+}
+
+TEST(persistent, many_versions)
+{
+    counted::no_new_instances_guard g;
+
+    std::vector<container> versions(1);
+    for (int k = 0; k != 64; ++k) {
+        versions.push_back(versions.back());
+        versions.back().insert((k * 37) % 64);
+    }
+    for (size_t k = 0; k != versions.size(); ++k) {
+        EXPECT_EQ(static_cast<ptrdiff_t>(k), std::distance(versions[k].begin(), versions[k].end()));
+    }
+    while (versions.size() > 1) {
+        versions.erase(versions.begin());
+    }
+    for (int k = 0; k != 64; ++k) {
+        EXPECT_NE(versions.back().end(), versions.back().find(k));
+    }
+}
+
+namespace
+{
+// An int key that counts the comparisons made on it.
+struct compared
+{
+    static size_t comparisons;
+    int value;
+
+    friend bool operator<(compared a, compared b)
+    {
+        ++comparisons;
+        return a.value < b.value;
+    }
+};
+
+size_t compared::comparisons = 0;
+}
+
+TEST(persistent, diff_matches_set_difference)
+{
+    std::mt19937 rng(47);
+    persistent_avl_tree<int> from;
+    for (int i = 0; i != 3000; ++i) {
+        from.insert(static_cast<int>(rng() % 5000));
+    }
+    persistent_avl_tree<int> to = from;
+    for (int i = 0; i != 300; ++i) {
+        int value = static_cast<int>(rng() % 5000);
+        auto it = to.find(value);
+        if (it != to.end()) {
+            to.erase(it);
+        }
+        else {
+            to.insert(value);
+        }
+    }
+    persistent_avl_tree<int> unrelated;
+    for (int i = 0; i != 2000; ++i) {
+        unrelated.insert(static_cast<int>(rng() % 5000));
+    }
+
+    for (auto const* other : {&to, &unrelated, &from}) {
+        std::vector<int> added;
+        std::vector<int> removed;
+        std::vector<int> order;
+        diff(from, *other, [&](int value) { added.push_back(value); order.push_back(value); },
+             [&](int value) { removed.push_back(value); order.push_back(value); });
+
+        std::vector<int> expected_added;
+        std::vector<int> expected_removed;
+        std::set_difference(other->begin(), other->end(), from.begin(), from.end(), std::back_inserter(expected_added));
+        std::set_difference(from.begin(), from.end(), other->begin(), other->end(), std::back_inserter(expected_removed));
+        EXPECT_EQ(expected_added, added);
+        EXPECT_EQ(expected_removed, removed);
+        EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+    }
+
+    std::vector<int> all;
+    diff(persistent_avl_tree<int>(), from, [&](int value) { all.push_back(value); }, [](int) { ADD_FAILURE(); });
+    EXPECT_TRUE(std::equal(from.begin(), from.end(), all.begin(), all.end()));
+}
+
+TEST(persistent, diff_skips_shared_subtrees)
+{
+    persistent_avl_tree<compared> from;
+    for (int i = 0; i != 100000; ++i) {
+        from.insert(compared{i * 2});
+    }
+    persistent_avl_tree<compared> to = from;
+    for (int i = 0; i != 10; ++i) {
+        to.insert(compared{i * 20000 + 1});
+        to.erase(to.find(compared{i * 19998}));
+    }
+    size_t added = 0;
+    size_t removed = 0;
+    compared::comparisons = 0;
+    diff(from, to, [&](compared) { ++added; }, [&](compared) { ++removed; });
+    EXPECT_EQ(10u, added);
+    EXPECT_EQ(10u, removed);
+    // a walk over both trees in lockstep would compare 100000 times
+    EXPECT_LT(compared::comparisons, 2000u);
+}
+
+TEST(fault_injection, persistent_copy_is_non_throwing)
+{
+    faulty_run([]
+    {
+        container c;
+        mass_insert(c, {3, 2, 4, 1});
+        try
+        {
+            container c2 = c;
+            c2 = c;
+        }
+        catch (...)
+        {
+            fault_injection_disable dg;
+            ADD_FAILURE();
+            throw;
+        }
+    });
+}
+
+TEST(fault_injection, persistent_insert_keeps_snapshot)
+{
+    faulty_run([]
+    {
+        container c;
+        mass_insert(c, {6, 3, 8, 2, 5, 7, 10});
+        container snapshot = c;
+        try
+        {
+            c.erase(c.find(6));
+            c.insert(4);
+        }
+        catch (...)
+        {
+            fault_injection_disable dg;
+            expect_eq(snapshot, {2, 3, 5, 6, 7, 8, 10});
+            throw;
+        }
+        fault_injection_disable dg;
+        expect_eq(snapshot, {2, 3, 5, 6, 7, 8, 10});
+        expect_eq(c, {2, 3, 4, 5, 7, 8, 10});
+    });
+}
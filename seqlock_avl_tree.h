@@ -0,0 +1,76 @@
+#ifndef SEQLOCK_AVL_TREE_H
+#define SEQLOCK_AVL_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+
+#include <epoch.h>
+
+// Set for read-mostly tables: writers are serialized and make the sequence
+// counter odd for the length of each structural change. Readers take no
+// locks and write nothing shared but their epoch, they descend through
+// atomic links and start over if the counter moved meanwhile. Nodes a
+// reader may still be on are freed through epoch_retire.
+template<typename T>
+struct seqlock_avl_tree {
+private:
+    struct avl_tree_node : epoch_retired {
+        T const value;
+        ptrdiff_t height = 1;
+        std::atomic<avl_tree_node*> left{nullptr};
+        std::atomic<avl_tree_node*> right{nullptr};
+
+        explicit avl_tree_node(T const&);
+    };
+
+    // A descent that raced with rotations can wander; past this depth it
+    // cannot be a valid path and is retried.
+    static constexpr size_t max_depth = 128;
+
+    std::atomic<uint64_t> sequence{0};
+    std::atomic<avl_tree_node*> root{nullptr};
+    std::mutex writer;
+
+    struct write_section {
+        std::atomic<uint64_t>& sequence;
+
+        explicit write_section(std::atomic<uint64_t>&) noexcept;
+        write_section(write_section const&) = delete;
+        ~write_section();
+    };
+
+    static ptrdiff_t height(avl_tree_node*) noexcept;
+    static void fix_height(avl_tree_node*) noexcept;
+    static avl_tree_node* rotate_left(avl_tree_node*) noexcept;
+    static avl_tree_node* rotate_right(avl_tree_node*) noexcept;
+    static avl_tree_node* balance(avl_tree_node*) noexcept;
+    static avl_tree_node* insert(avl_tree_node*, avl_tree_node*);
+    static avl_tree_node* remove_minimum(avl_tree_node*, avl_tree_node*&) noexcept;
+    static avl_tree_node* remove(avl_tree_node*, T const&, avl_tree_node*&);
+    static void reclaim(epoch_retired*) noexcept;
+    static void destroy(avl_tree_node*) noexcept;
+
+    avl_tree_node* find_locked(T const&) const;
+    template<typename F>
+    auto read(F) const;
+    template<bool inclusive>
+    std::optional<T> bound(T const&) const;
+
+public:
+    seqlock_avl_tree() noexcept;
+    seqlock_avl_tree(seqlock_avl_tree const&) = delete;
+    seqlock_avl_tree& operator=(seqlock_avl_tree const&) = delete;
+    ~seqlock_avl_tree();
+
+    bool contains(T const&) const;
+    std::optional<T> lower_bound(T const&) const;
+    std::optional<T> upper_bound(T const&) const;
+    bool insert(T const&);
+    bool erase(T const&);
+};
+
+#include <seqlock_avl_tree.tpp>
+#endif //SEQLOCK_AVL_TREE_H
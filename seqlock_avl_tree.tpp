@@ -0,0 +1,277 @@
+#include <algorithm>
+#include <memory>
+
+template<typename T>
+seqlock_avl_tree<T>::avl_tree_node::avl_tree_node(T const& value) : value(value) { }
+
+template<typename T>
+seqlock_avl_tree<T>::seqlock_avl_tree() noexcept { }
+
+template<typename T>
+seqlock_avl_tree<T>::~seqlock_avl_tree()
+{
+    destroy(root.load());
+}
+
+template<typename T>
+void seqlock_avl_tree<T>::destroy(avl_tree_node* node) noexcept
+{
+    if (node) {
+        destroy(node->left.load());
+        destroy(node->right.load());
+        delete node;
+    }
+}
+
+template<typename T>
+seqlock_avl_tree<T>::write_section::write_section(std::atomic<uint64_t>& sequence) noexcept : sequence(sequence)
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template<typename T>
+seqlock_avl_tree<T>::write_section::~write_section()
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename T>
+void seqlock_avl_tree<T>::reclaim(epoch_retired* node) noexcept
+{
+    delete static_cast<avl_tree_node*>(node);
+}
+
+// Everything below up to find_locked runs under the writer lock. Links are
+// published with release stores, so a reader that reaches a node through
+// them also sees its value.
+
+template<typename T>
+ptrdiff_t seqlock_avl_tree<T>::height(avl_tree_node* node) noexcept
+{
+    return node ? node->height : 0;
+}
+
+template<typename T>
+void seqlock_avl_tree<T>::fix_height(avl_tree_node* node) noexcept
+{
+    node->height = std::max(height(node->left.load(std::memory_order_relaxed)),
+                            height(node->right.load(std::memory_order_relaxed))) + 1;
+}
+
+template<typename T>
+typename seqlock_avl_tree<T>::avl_tree_node* seqlock_avl_tree<T>::rotate_left(avl_tree_node* node) noexcept
+{
+    avl_tree_node* right = node->right.load(std::memory_order_relaxed);
+    node->right.store(right->left.load(std::memory_order_relaxed), std::memory_order_release);
+    right->left.store(node, std::memory_order_release);
+    fix_height(node);
+    fix_height(right);
+    return right;
+}
+
+template<typename T>
+typename seqlock_avl_tree<T>::avl_tree_node* seqlock_avl_tree<T>::rotate_right(avl_tree_node* node) noexcept
+{
+    avl_tree_node* left = node->left.load(std::memory_order_relaxed);
+    node->left.store(left->right.load(std::memory_order_relaxed), std::memory_order_release);
+    left->right.store(node, std::memory_order_release);
+    fix_height(node);
+    fix_height(left);
+    return left;
+}
+
+template<typename T>
+typename seqlock_avl_tree<T>::avl_tree_node* seqlock_avl_tree<T>::balance(avl_tree_node* node) noexcept
+{
+    fix_height(node);
+    avl_tree_node* left = node->left.load(std::memory_order_relaxed);
+    avl_tree_node* right = node->right.load(std::memory_order_relaxed);
+    ptrdiff_t diff = height(left) - height(right);
+    if (diff > 1) {
+        if (height(left->left.load(std::memory_order_relaxed)) < height(left->right.load(std::memory_order_relaxed))) {
+            node->left.store(rotate_left(left), std::memory_order_release);
+        }
+        return rotate_right(node);
+    }
+    if (diff < -1) {
+        if (height(right->right.load(std::memory_order_relaxed)) < height(right->left.load(std::memory_order_relaxed))) {
+            node->right.store(rotate_right(right), std::memory_order_release);
+        }
+        return rotate_left(node);
+    }
+    return node;
+}
+
+// The value is known to be absent; comparisons happen before any link is
+// changed, so a throwing one leaves the tree as it was.
+template<typename T>
+typename seqlock_avl_tree<T>::avl_tree_node* seqlock_avl_tree<T>::insert(avl_tree_node* node, avl_tree_node* inserted)
+{
+    if (node == nullptr) {
+        return inserted;
+    }
+    if (inserted->value < node->value) {
+        node->left.store(insert(node->left.load(std::memory_order_relaxed), inserted), std::memory_order_release);
+    }
+    else {
+        node->right.store(insert(node->right.load(std::memory_order_relaxed), inserted), std::memory_order_release);
+    }
+    return balance(node);
+}
+
+template<typename T>
+typename seqlock_avl_tree<T>::avl_tree_node* seqlock_avl_tree<T>::remove_minimum(avl_tree_node* node, avl_tree_node*& minimum) noexcept
+{
+    avl_tree_node* left = node->left.load(std::memory_order_relaxed);
+    if (left == nullptr) {
+        minimum = node;
+        return node->right.load(std::memory_order_relaxed);
+    }
+    node->left.store(remove_minimum(left, minimum), std::memory_order_release);
+    return balance(node);
+}
+
+template<typename T>
+typename seqlock_avl_tree<T>::avl_tree_node* seqlock_avl_tree<T>::remove(avl_tree_node* node, T const& value, avl_tree_node*& removed)
+{
+    if (value < node->value) {
+        node->left.store(remove(node->left.load(std::memory_order_relaxed), value, removed), std::memory_order_release);
+        return balance(node);
+    }
+    if (node->value < value) {
+        node->right.store(remove(node->right.load(std::memory_order_relaxed), value, removed), std::memory_order_release);
+        return balance(node);
+    }
+    removed = node;
+    avl_tree_node* left = node->left.load(std::memory_order_relaxed);
+    avl_tree_node* right = node->right.load(std::memory_order_relaxed);
+    if (right == nullptr) {
+        return left;
+    }
+    avl_tree_node* minimum = nullptr;
+    right = remove_minimum(right, minimum);
+    minimum->left.store(left, std::memory_order_release);
+    minimum->right.store(right, std::memory_order_release);
+    return balance(minimum);
+}
+
+template<typename T>
+typename seqlock_avl_tree<T>::avl_tree_node* seqlock_avl_tree<T>::find_locked(T const& value) const
+{
+    avl_tree_node* node = root.load(std::memory_order_relaxed);
+    while (node && (value < node->value || node->value < value)) {
+        node = (value < node->value ? node->left : node->right).load(std::memory_order_relaxed);
+    }
+    return node;
+}
+
+// descend gets the root and returns nothing when it gave up on a path that
+// is too deep; its answer only counts if no writer ran in the meantime.
+template<typename T>
+template<typename F>
+auto seqlock_avl_tree<T>::read(F descend) const
+{
+    epoch_guard guard;
+    while (true) {
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        auto result = descend(root.load(std::memory_order_acquire));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (result && sequence.load(std::memory_order_relaxed) == before) {
+            return *std::move(result);
+        }
+    }
+}
+
+template<typename T>
+bool seqlock_avl_tree<T>::contains(T const& value) const
+{
+    return read([&value](avl_tree_node* node) -> std::optional<bool>
+    {
+        for (size_t depth = 0; depth != max_depth; ++depth) {
+            if (node == nullptr) {
+                return false;
+            }
+            if (value < node->value) {
+                node = node->left.load(std::memory_order_acquire);
+            }
+            else if (node->value < value) {
+                node = node->right.load(std::memory_order_acquire);
+            }
+            else {
+                return true;
+            }
+        }
+        return std::nullopt;
+    });
+}
+
+template<typename T>
+template<bool inclusive>
+std::optional<T> seqlock_avl_tree<T>::bound(T const& value) const
+{
+    return read([&value](avl_tree_node* node) -> std::optional<std::optional<T>>
+    {
+        avl_tree_node* best = nullptr;
+        for (size_t depth = 0; depth != max_depth; ++depth) {
+            if (node == nullptr) {
+                return best ? std::optional<T>(best->value) : std::nullopt;
+            }
+            if (inclusive ? !(node->value < value) : value < node->value) {
+                best = node;
+                node = node->left.load(std::memory_order_acquire);
+            }
+            else {
+                node = node->right.load(std::memory_order_acquire);
+            }
+        }
+        return std::nullopt;
+    });
+}
+
+template<typename T>
+std::optional<T> seqlock_avl_tree<T>::lower_bound(T const& value) const
+{
+    return bound<true>(value);
+}
+
+template<typename T>
+std::optional<T> seqlock_avl_tree<T>::upper_bound(T const& value) const
+{
+    return bound<false>(value);
+}
+
+// Lookups and allocation happen before the counter goes odd, so readers
+// only retry for writes that really change the tree.
+template<typename T>
+bool seqlock_avl_tree<T>::insert(T const& value)
+{
+    std::lock_guard<std::mutex> lock(writer);
+    if (find_locked(value)) {
+        return false;
+    }
+    std::unique_ptr<avl_tree_node> node(new avl_tree_node(value));
+    write_section section(sequence);
+    root.store(insert(root.load(std::memory_order_relaxed), node.get()), std::memory_order_release);
+    node.release();
+    return true;
+}
+
+template<typename T>
+bool seqlock_avl_tree<T>::erase(T const& value)
+{
+    std::lock_guard<std::mutex> lock(writer);
+    if (!find_locked(value)) {
+        return false;
+    }
+    avl_tree_node* removed = nullptr;
+    {
+        write_section section(sequence);
+        root.store(remove(root.load(std::memory_order_relaxed), value, removed), std::memory_order_release);
+    }
+    epoch_retire(removed, reclaim);
+    return true;
+}
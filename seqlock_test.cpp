@@ -0,0 +1,115 @@
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "counted.h"
+#include "fault_injection.h"
+#include "seqlock_avl_tree.h"
+
+TEST(seqlock, sequential_matches_std_set)
+{
+    counted::no_new_instances_guard g;
+    {
+        seqlock_avl_tree<counted> c;
+        std::set<int> expected;
+        std::mt19937 rng(7);
+        for (int i = 0; i != 4000; ++i) {
+            int value = static_cast<int>(rng() % 300);
+            switch (rng() % 4) {
+                case 0:
+                    EXPECT_EQ(expected.insert(value).second, c.insert(value));
+                    break;
+                case 1:
+                    EXPECT_EQ(expected.erase(value) == 1, c.erase(value));
+                    break;
+                case 2: {
+                    auto it = expected.lower_bound(value);
+                    auto found = c.lower_bound(value);
+                    EXPECT_EQ(it != expected.end(), found.has_value());
+                    if (found) {
+                        EXPECT_EQ(*it, *found);
+                    }
+                    it = expected.upper_bound(value);
+                    found = c.upper_bound(value);
+                    EXPECT_EQ(it != expected.end(), found.has_value());
+                    if (found) {
+                        EXPECT_EQ(*it, *found);
+                    }
+                    break;
+                }
+                default:
+                    EXPECT_EQ(expected.count(value) == 1, c.contains(value));
+            }
+        }
+    }
+    epoch_synchronize();
+}
+
+TEST(seqlock, throwing_insert_leaves_tree_readable)
+{
+    faulty_run([]
+    {
+        seqlock_avl_tree<counted> c;
+        for (int i = 0; i != 8; ++i) {
+            try {
+                c.insert(i * 3 % 8);
+            }
+            catch (...) {
+                fault_injection_disable dg;
+                for (int j = 0; j != i; ++j) {
+                    EXPECT_TRUE(c.contains(j * 3 % 8));
+                }
+                EXPECT_FALSE(c.contains(i * 3 % 8));
+                throw;
+            }
+        }
+    });
+    epoch_synchronize();
+}
+
+// Readers look for keys that are never erased while a writer churns the
+// keys around them; every rotation the writer makes must be invisible.
+TEST(seqlock, readers_during_writes)
+{
+    seqlock_avl_tree<int> c;
+    int const keys = 4096;
+    for (int i = 0; i < keys; i += 2) {
+        c.insert(i);
+    }
+    std::atomic<bool> done{false};
+    std::vector<std::thread> readers;
+    for (unsigned t = 0; t != 4; ++t) {
+        readers.emplace_back([&c, &done, t]
+        {
+            std::mt19937 rng(t);
+            while (!done.load()) {
+                int key = static_cast<int>(rng() % keys) & ~1;
+                EXPECT_TRUE(c.contains(key));
+                auto next = c.upper_bound(key);
+                ASSERT_TRUE(next.has_value() || key == keys - 2);
+                if (next) {
+                    EXPECT_LT(key, *next);
+                    EXPECT_LE(*next, key + 2);
+                }
+            }
+        });
+    }
+    std::mt19937 rng(42);
+    for (int i = 0; i != 100000; ++i) {
+        int key = static_cast<int>(rng() % keys) | 1;
+        if (rng() % 2) {
+            c.insert(key);
+        }
+        else {
+            c.erase(key);
+        }
+    }
+    done.store(true);
+    for (std::thread& thread : readers) {
+        thread.join();
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef SHARDED_AVL_TREE_H
+#define SHARDED_AVL_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <shared_mutex>
+
+#include <avl_tree.h>
+
+// Thread-safe set split into Shards contiguous key ranges, each an avl_tree
+// behind its own reader-writer lock. Shard i holds [low_i, low_{i+1}); an
+// absent low means the range is still empty at the top end. When a shard
+// grows well past the average, the part that evens it out with its smaller
+// neighbour, at most max_moved values at a time, is split off and joined
+// onto it, moving the boundary with it.
+template<typename T, size_t Shards>
+struct sharded_avl_tree {
+    static_assert(Shards > 0, "at least one shard is required");
+
+private:
+    struct alignas(64) shard {
+        mutable std::shared_mutex lock;
+        avl_tree<T> tree;
+        std::atomic<size_t> size{0};
+        std::optional<T> low{};
+    };
+
+    // a shard may hold this many values over one and a half times the average
+    static constexpr size_t skew_slack = 64;
+    // values one rebalance moves at most, which bounds how long it keeps two
+    // shards locked; a shard further out of balance is evened out over
+    // several inserts
+    static constexpr size_t max_moved = 1024;
+
+    shard shards[Shards];
+    std::atomic<size_t> total{0};
+
+    bool above_low(size_t, T const&) const;
+    bool below_high(size_t, T const&) const;
+    size_t route(T const&) const;
+    template<typename Lock>
+    Lock lock_range(T const&, size_t&) const;
+    size_t neighbour(size_t) const noexcept;
+    bool skewed(size_t, size_t) const noexcept;
+    size_t rebalance(size_t);
+    template<typename F>
+    std::optional<T> first_from(T const&, F) const;
+
+public:
+    sharded_avl_tree();
+    sharded_avl_tree(sharded_avl_tree const&) = delete;
+    sharded_avl_tree& operator=(sharded_avl_tree const&) = delete;
+
+    bool contains(T const&) const;
+    bool insert(T const&);
+    bool erase(T const&);
+    std::optional<T> lower_bound(T const&) const;
+    std::optional<T> upper_bound(T const&) const;
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+
+    // Visits every value in order. Neighbouring shards are locked hand over
+    // hand, so values present for the whole call are seen exactly once.
+    template<typename F>
+    void for_each(F) const;
+};
+
+#include <sharded_avl_tree.tpp>
+#endif //SHARDED_AVL_TREE_H
@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <utility>
+
+template<typename T, size_t Shards>
+sharded_avl_tree<T, Shards>::sharded_avl_tree() = default;
+
+// Both checks expect the caller to hold the lock of shard i; the boundary
+// above it only moves while shards i and i + 1 are both locked exclusively.
+template<typename T, size_t Shards>
+bool sharded_avl_tree<T, Shards>::above_low(size_t i, T const& value) const
+{
+    return i == 0 || (shards[i].low && !(value < *shards[i].low));
+}
+
+template<typename T, size_t Shards>
+bool sharded_avl_tree<T, Shards>::below_high(size_t i, T const& value) const
+{
+    return i + 1 == Shards || !shards[i + 1].low || value < *shards[i + 1].low;
+}
+
+// Only a guess, boundaries may move between reading one low and the next.
+template<typename T, size_t Shards>
+size_t sharded_avl_tree<T, Shards>::route(T const& value) const
+{
+    size_t lo = 0;
+    size_t hi = Shards - 1;
+    while (lo < hi) {
+        size_t mid = (lo + hi + 1) / 2;
+        std::shared_lock<std::shared_mutex> lock(shards[mid].lock);
+        if (above_low(mid, value)) {
+            lo = mid;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+template<typename T, size_t Shards>
+template<typename Lock>
+Lock sharded_avl_tree<T, Shards>::lock_range(T const& value, size_t& index) const
+{
+    while (true) {
+        size_t i = route(value);
+        Lock lock(shards[i].lock);
+        if (above_low(i, value) && below_high(i, value)) {
+            index = i;
+            return lock;
+        }
+    }
+}
+
+// Index of the smaller neighbour of shard i.
+template<typename T, size_t Shards>
+size_t sharded_avl_tree<T, Shards>::neighbour(size_t i) const noexcept
+{
+    if (i == 0) {
+        return 1;
+    }
+    if (i + 1 == Shards) {
+        return i - 1;
+    }
+    return shards[i - 1].size.load(std::memory_order_relaxed) <=
+           shards[i + 1].size.load(std::memory_order_relaxed) ? i - 1 : i + 1;
+}
+
+template<typename T, size_t Shards>
+bool sharded_avl_tree<T, Shards>::skewed(size_t i, size_t target) const noexcept
+{
+    size_t size = shards[i].size.load(std::memory_order_relaxed);
+    size_t average = total.load(std::memory_order_relaxed) / Shards;
+    return size > average + average / 2 + skew_slack &&
+           size > shards[target].size.load(std::memory_order_relaxed) + skew_slack;
+}
+
+// Evens out shard i and its smaller neighbour, by at most max_moved values,
+// and returns the neighbour's index, since the values it took may leave it
+// skewed against its other side. The boundary is found by walking in from
+// the end that is handed over, so both locks are held for a bounded number
+// of steps however large the shard is, and the sizes stay exact.
+template<typename T, size_t Shards>
+size_t sharded_avl_tree<T, Shards>::rebalance(size_t i)
+{
+    size_t target = neighbour(i);
+    size_t first = std::min(i, target);
+    std::unique_lock<std::shared_mutex> first_lock(shards[first].lock);
+    std::unique_lock<std::shared_mutex> second_lock(shards[first + 1].lock);
+    if (!skewed(i, target)) {
+        return i;
+    }
+    shard& from = shards[i];
+    shard& to = shards[target];
+    size_t size = from.size.load(std::memory_order_relaxed);
+    size_t moved = std::min((size - to.size.load(std::memory_order_relaxed)) / 2, max_moved);
+
+    auto middle = target > i ? std::prev(from.tree.end(), static_cast<ptrdiff_t>(moved))
+                             : std::next(from.tree.begin(), static_cast<ptrdiff_t>(moved));
+    std::optional<T> boundary(*middle);
+    avl_tree<T> upper = from.tree.split(*boundary);
+    if (target > i) {
+        upper.join(to.tree);
+        to.tree.swap(upper);
+        to.low = std::move(boundary);
+    }
+    else {
+        to.tree.join(from.tree);
+        from.tree.swap(upper);
+        from.low = std::move(boundary);
+    }
+    from.size.fetch_sub(moved, std::memory_order_relaxed);
+    to.size.fetch_add(moved, std::memory_order_relaxed);
+    return target;
+}
+
+template<typename T, size_t Shards>
+bool sharded_avl_tree<T, Shards>::contains(T const& value) const
+{
+    size_t i;
+    auto lock = lock_range<std::shared_lock<std::shared_mutex>>(value, i);
+    return shards[i].tree.find(value) != shards[i].tree.end();
+}
+
+template<typename T, size_t Shards>
+bool sharded_avl_tree<T, Shards>::insert(T const& value)
+{
+    size_t i;
+    {
+        auto lock = lock_range<std::unique_lock<std::shared_mutex>>(value, i);
+        if (!shards[i].tree.insert(value).second) {
+            return false;
+        }
+        shards[i].size.fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+    }
+    for (size_t steps = 0; Shards > 1 && steps != Shards && skewed(i, neighbour(i)); ++steps) {
+        i = rebalance(i);
+    }
+    return true;
+}
+
+template<typename T, size_t Shards>
+bool sharded_avl_tree<T, Shards>::erase(T const& value)
+{
+    size_t i;
+    auto lock = lock_range<std::unique_lock<std::shared_mutex>>(value, i);
+    auto it = shards[i].tree.find(value);
+    if (it == shards[i].tree.end()) {
+        return false;
+    }
+    shards[i].tree.erase(it);
+    shards[i].size.fetch_sub(1, std::memory_order_relaxed);
+    total.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+// Every value in later shards is greater than value, so once the shard value
+// routes to has nothing left the answer is the first value further on.
+template<typename T, size_t Shards>
+template<typename F>
+std::optional<T> sharded_avl_tree<T, Shards>::first_from(T const& value, F bound) const
+{
+    size_t i;
+    auto lock = lock_range<std::shared_lock<std::shared_mutex>>(value, i);
+    typename avl_tree<T>::const_iterator it = bound(shards[i].tree, value);
+    while (it == shards[i].tree.end()) {
+        if (++i == Shards) {
+            return std::nullopt;
+        }
+        std::shared_lock<std::shared_mutex> next(shards[i].lock);
+        lock.swap(next);
+        it = shards[i].tree.begin();
+    }
+    return *it;
+}
+
+template<typename T, size_t Shards>
+std::optional<T> sharded_avl_tree<T, Shards>::lower_bound(T const& value) const
+{
+    return first_from(value, [](avl_tree<T> const& tree, T const& v) { return tree.lower_bound(v); });
+}
+
+template<typename T, size_t Shards>
+std::optional<T> sharded_avl_tree<T, Shards>::upper_bound(T const& value) const
+{
+    return first_from(value, [](avl_tree<T> const& tree, T const& v) { return tree.upper_bound(v); });
+}
+
+template<typename T, size_t Shards>
+template<typename F>
+void sharded_avl_tree<T, Shards>::for_each(F f) const
+{
+    std::shared_lock<std::shared_mutex> lock(shards[0].lock);
+    for (size_t i = 0;;) {
+        for (T const& value : shards[i].tree) {
+            f(value);
+        }
+        if (++i == Shards) {
+            return;
+        }
+        std::shared_lock<std::shared_mutex> next(shards[i].lock);
+        lock.swap(next);
+    }
+}
+
+template<typename T, size_t Shards>
+size_t sharded_avl_tree<T, Shards>::size() const noexcept
+{
+    return total.load(std::memory_order_relaxed);
+}
+
+template<typename T, size_t Shards>
+bool sharded_avl_tree<T, Shards>::empty() const noexcept
+{
+    return size() == 0;
+}
@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "sharded_avl_tree.h"
+
+TEST(sharded, sequential_inserts_spread_over_shards)
+{
+    sharded_avl_tree<int, 8> c;
+    int const count = 20000;
+    for (int i = 0; i != count; ++i) {
+        EXPECT_TRUE(c.insert(i));
+    }
+    EXPECT_FALSE(c.insert(count / 2));
+    EXPECT_EQ(static_cast<size_t>(count), c.size());
+
+    int expected = 0;
+    c.for_each([&expected](int value)
+    {
+        EXPECT_EQ(expected++, value);
+    });
+    EXPECT_EQ(count, expected);
+
+    for (int i = 0; i != count; ++i) {
+        EXPECT_TRUE(c.contains(i));
+    }
+    EXPECT_FALSE(c.contains(-1));
+    EXPECT_FALSE(c.contains(count));
+}
+
+TEST(sharded, bounds_cross_shard_boundaries)
+{
+    sharded_avl_tree<int, 4> c;
+    for (int i = 0; i != 4000; i += 2) {
+        c.insert(i);
+    }
+    for (int i = 0; i != 3998; i += 2) {
+        EXPECT_TRUE(c.erase(i));
+        EXPECT_EQ(i + 2, *c.lower_bound(i));
+        EXPECT_EQ(i + 2, *c.upper_bound(i));
+        EXPECT_EQ(i + 2, *c.lower_bound(i + 1));
+    }
+    EXPECT_EQ(3998, *c.lower_bound(-100));
+    EXPECT_FALSE(c.upper_bound(3998));
+    EXPECT_FALSE(c.lower_bound(3999));
+    EXPECT_TRUE(c.erase(3998));
+    EXPECT_TRUE(c.empty());
+    EXPECT_FALSE(c.lower_bound(0));
+}
+
+TEST(sharded, concurrent_updates_and_scans)
+{
+    sharded_avl_tree<int, 8> c;
+    size_t const threads_count = 8;
+    int const keys = 4096;
+    int const operations = 50000;
+
+    std::vector<std::vector<int>> balance(threads_count, std::vector<int>(keys));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t != threads_count; ++t) {
+        threads.emplace_back([&c, &balance, t]
+        {
+            std::mt19937 rng(static_cast<unsigned>(t));
+            for (int i = 0; i != operations; ++i) {
+                int key = static_cast<int>(rng() % keys);
+                switch (rng() % 8) {
+                    case 0:
+                    case 1:
+                    case 2:
+                        balance[t][key] += c.insert(key);
+                        break;
+                    case 3:
+                        balance[t][key] -= c.erase(key);
+                        break;
+                    case 4:
+                        if (i % 64 == 0) {
+                            int last = -1;
+                            c.for_each([&last](int value)
+                            {
+                                EXPECT_LT(last, value);
+                                last = value;
+                            });
+                        }
+                        break;
+                    default:
+                        if (auto next = c.upper_bound(key)) {
+                            EXPECT_LT(key, *next);
+                        }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    size_t present = 0;
+    for (int key = 0; key != keys; ++key) {
+        int total = 0;
+        for (size_t t = 0; t != threads_count; ++t) {
+            total += balance[t][key];
+        }
+        EXPECT_TRUE(total == 0 || total == 1);
+        EXPECT_EQ(total == 1, c.contains(key));
+        present += total;
+    }
+    EXPECT_EQ(present, c.size());
+}
@@ -0,0 +1,123 @@
+#ifndef SHARED_AVL_TREE_H
+#define SHARED_AVL_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+#include <avl_tree_serializer.h>
+
+enum class shm_role {
+    writer, reader
+};
+
+// Tree placed in a POSIX shared memory segment, so that processes on one
+// host query a single copy. Links are offsets into the segment, which
+// every process may map at its own address. One process opens it as the
+// writer; readers map it read-only and synchronize with the writer through
+// a sequence counter in the segment the same way seqlock_avl_tree does,
+// so they write nothing shared. Nodes are reused through a free list
+// rather than reclaimed by epochs, so a reader may see a node change under
+// it; it notices by the counter or by a link leading out of its mapping
+// and starts over, remapping first when the segment has grown.
+//
+// There must be at most one writer per segment. Each object is meant for
+// one thread at a time; threads of a reader process open one each.
+template<typename T>
+struct shared_avl_tree {
+    static_assert(std::is_trivially_copyable_v<T>, "shared_avl_tree stores values as raw bytes");
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "links must be address-free atomics");
+
+private:
+    struct shared_node {
+        T value;
+        std::atomic<uint64_t> left;
+        std::atomic<uint64_t> right;
+        int32_t height;
+
+        explicit shared_node(T const&) noexcept;
+    };
+
+    struct segment_header {
+        char magic[4];
+        uint32_t version;
+        uint32_t value_size;
+        uint32_t node_size;
+        std::atomic<uint64_t> sequence;
+        std::atomic<uint64_t> segment_size;
+        std::atomic<uint64_t> root;
+        std::atomic<uint64_t> size;
+        // only touched by the writer
+        uint64_t free_list;
+        uint64_t used;
+    };
+
+    struct write_section {
+        std::atomic<uint64_t>& sequence;
+
+        explicit write_section(std::atomic<uint64_t>&) noexcept;
+        write_section(write_section const&) = delete;
+        ~write_section();
+    };
+
+    static constexpr char expected_magic[4] = {'A', 'V', 'L', 'S'};
+    static constexpr uint32_t current_version = 1;
+    static constexpr size_t initial_segment_size = 1 << 16;
+    static constexpr size_t max_depth = 128;
+
+    shm_role role;
+    int fd = -1;
+    char* base = nullptr;
+    size_t mapping_size = 0;
+
+    static uint64_t nodes_offset() noexcept;
+    segment_header& header() const noexcept;
+    shared_node* node(uint64_t) const noexcept;
+    int32_t height(uint64_t) const noexcept;
+    void fix_height(uint64_t) const noexcept;
+    uint64_t rotate_left(uint64_t) const noexcept;
+    uint64_t rotate_right(uint64_t) const noexcept;
+    uint64_t balance(uint64_t) const noexcept;
+    uint64_t insert(uint64_t, uint64_t);
+    uint64_t remove_minimum(uint64_t, uint64_t&) const noexcept;
+    uint64_t remove(uint64_t, T const&, uint64_t&);
+    uint64_t find_locked(T const&) const;
+
+    void map(size_t);
+    void grow();
+    uint64_t allocate(T const&);
+    void deallocate(uint64_t) noexcept;
+    void close_segment() noexcept;
+    template<typename F>
+    auto read(F);
+    template<bool inclusive>
+    std::optional<T> bound(T const&);
+
+public:
+    // The writer creates the segment if it does not exist; a reader needs
+    // it to. Throws std::system_error if the segment cannot be opened and
+    // avl_tree_snapshot_error if it holds something else.
+    shared_avl_tree(char const* name, shm_role);
+    shared_avl_tree(shared_avl_tree const&) = delete;
+    shared_avl_tree& operator=(shared_avl_tree const&) = delete;
+    ~shared_avl_tree();
+
+    // Removes the segment name; processes that have it mapped keep it.
+    static void unlink(char const* name) noexcept;
+
+    // Writer only.
+    bool insert(T const&);
+    bool erase(T const&);
+
+    // Queries may remap the segment, which is why they are not const.
+    bool contains(T const&);
+    std::optional<T> lower_bound(T const&);
+    std::optional<T> upper_bound(T const&);
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+};
+
+#include <shared_avl_tree.tpp>
+#endif //SHARED_AVL_TREE_H
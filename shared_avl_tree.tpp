@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <cerrno>
+#include <new>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mman.h>
+
+template<typename T>
+shared_avl_tree<T>::shared_node::shared_node(T const& value) noexcept : value(value), left(0), right(0), height(1) { }
+
+template<typename T>
+shared_avl_tree<T>::write_section::write_section(std::atomic<uint64_t>& sequence) noexcept : sequence(sequence)
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+template<typename T>
+shared_avl_tree<T>::write_section::~write_section()
+{
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::nodes_offset() noexcept
+{
+    return (sizeof(segment_header) + alignof(shared_node) - 1) / alignof(shared_node) * alignof(shared_node);
+}
+
+template<typename T>
+typename shared_avl_tree<T>::segment_header& shared_avl_tree<T>::header() const noexcept
+{
+    return *reinterpret_cast<segment_header*>(base);
+}
+
+// Null for offsets outside this process's mapping, which a reader can
+// follow after racing with the writer.
+template<typename T>
+typename shared_avl_tree<T>::shared_node* shared_avl_tree<T>::node(uint64_t offset) const noexcept
+{
+    if (offset < nodes_offset() || offset > mapping_size - sizeof(shared_node)) {
+        return nullptr;
+    }
+    return reinterpret_cast<shared_node*>(base + offset);
+}
+
+// Everything below up to the readers runs in the writer only. Links are
+// published with release stores, so a reader that reaches a node through
+// them also sees its value.
+
+template<typename T>
+int32_t shared_avl_tree<T>::height(uint64_t offset) const noexcept
+{
+    return offset ? node(offset)->height : 0;
+}
+
+template<typename T>
+void shared_avl_tree<T>::fix_height(uint64_t offset) const noexcept
+{
+    shared_node* n = node(offset);
+    n->height = std::max(height(n->left.load(std::memory_order_relaxed)),
+                         height(n->right.load(std::memory_order_relaxed))) + 1;
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::rotate_left(uint64_t offset) const noexcept
+{
+    shared_node* n = node(offset);
+    uint64_t right = n->right.load(std::memory_order_relaxed);
+    n->right.store(node(right)->left.load(std::memory_order_relaxed), std::memory_order_release);
+    node(right)->left.store(offset, std::memory_order_release);
+    fix_height(offset);
+    fix_height(right);
+    return right;
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::rotate_right(uint64_t offset) const noexcept
+{
+    shared_node* n = node(offset);
+    uint64_t left = n->left.load(std::memory_order_relaxed);
+    n->left.store(node(left)->right.load(std::memory_order_relaxed), std::memory_order_release);
+    node(left)->right.store(offset, std::memory_order_release);
+    fix_height(offset);
+    fix_height(left);
+    return left;
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::balance(uint64_t offset) const noexcept
+{
+    fix_height(offset);
+    shared_node* n = node(offset);
+    uint64_t left = n->left.load(std::memory_order_relaxed);
+    uint64_t right = n->right.load(std::memory_order_relaxed);
+    int32_t difference = height(left) - height(right);
+    if (difference == 2) {
+        if (height(node(left)->left.load(std::memory_order_relaxed)) <
+            height(node(left)->right.load(std::memory_order_relaxed))) {
+            n->left.store(rotate_left(left), std::memory_order_release);
+        }
+        return rotate_right(offset);
+    }
+    if (difference == -2) {
+        if (height(node(right)->right.load(std::memory_order_relaxed)) <
+            height(node(right)->left.load(std::memory_order_relaxed))) {
+            n->right.store(rotate_right(right), std::memory_order_release);
+        }
+        return rotate_left(offset);
+    }
+    return offset;
+}
+
+// Links are only written on the way back up, so a throwing comparison on
+// the way down leaves the tree as it was.
+template<typename T>
+uint64_t shared_avl_tree<T>::insert(uint64_t offset, uint64_t fresh)
+{
+    if (offset == 0) {
+        return fresh;
+    }
+    shared_node* n = node(offset);
+    if (node(fresh)->value < n->value) {
+        n->left.store(insert(n->left.load(std::memory_order_relaxed), fresh), std::memory_order_release);
+    }
+    else {
+        n->right.store(insert(n->right.load(std::memory_order_relaxed), fresh), std::memory_order_release);
+    }
+    return balance(offset);
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::remove_minimum(uint64_t offset, uint64_t& minimum) const noexcept
+{
+    shared_node* n = node(offset);
+    uint64_t left = n->left.load(std::memory_order_relaxed);
+    if (left == 0) {
+        minimum = offset;
+        return n->right.load(std::memory_order_relaxed);
+    }
+    n->left.store(remove_minimum(left, minimum), std::memory_order_release);
+    return balance(offset);
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::remove(uint64_t offset, T const& value, uint64_t& removed)
+{
+    shared_node* n = node(offset);
+    if (value < n->value) {
+        n->left.store(remove(n->left.load(std::memory_order_relaxed), value, removed), std::memory_order_release);
+    }
+    else if (n->value < value) {
+        n->right.store(remove(n->right.load(std::memory_order_relaxed), value, removed), std::memory_order_release);
+    }
+    else {
+        removed = offset;
+        uint64_t left = n->left.load(std::memory_order_relaxed);
+        uint64_t right = n->right.load(std::memory_order_relaxed);
+        if (right == 0) {
+            return left;
+        }
+        uint64_t minimum = 0;
+        right = remove_minimum(right, minimum);
+        node(minimum)->left.store(left, std::memory_order_release);
+        node(minimum)->right.store(right, std::memory_order_release);
+        return balance(minimum);
+    }
+    return balance(offset);
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::find_locked(T const& value) const
+{
+    uint64_t offset = header().root.load(std::memory_order_relaxed);
+    while (offset) {
+        shared_node* n = node(offset);
+        if (value < n->value) {
+            offset = n->left.load(std::memory_order_relaxed);
+        }
+        else if (n->value < value) {
+            offset = n->right.load(std::memory_order_relaxed);
+        }
+        else {
+            break;
+        }
+    }
+    return offset;
+}
+
+template<typename T>
+void shared_avl_tree<T>::map(size_t size)
+{
+    int protection = role == shm_role::writer ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* mapped = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        throw std::system_error(errno, std::generic_category(), "shared_avl_tree: mmap");
+    }
+    if (base) {
+        munmap(base, mapping_size);
+    }
+    base = static_cast<char*>(mapped);
+    mapping_size = size;
+}
+
+// Readers learn the new size from the header and remap on their next query.
+template<typename T>
+void shared_avl_tree<T>::grow()
+{
+    size_t size = mapping_size * 2;
+    if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+        throw std::system_error(errno, std::generic_category(), "shared_avl_tree: ftruncate");
+    }
+    map(size);
+    header().segment_size.store(size, std::memory_order_release);
+}
+
+template<typename T>
+uint64_t shared_avl_tree<T>::allocate(T const& value)
+{
+    uint64_t offset = header().free_list;
+    if (offset) {
+        header().free_list = node(offset)->left.load(std::memory_order_relaxed);
+    }
+    else {
+        if (header().used + sizeof(shared_node) > mapping_size) {
+            grow();
+        }
+        offset = header().used;
+        header().used += sizeof(shared_node);
+    }
+    new (base + offset) shared_node(value);
+    return offset;
+}
+
+template<typename T>
+void shared_avl_tree<T>::deallocate(uint64_t offset) noexcept
+{
+    node(offset)->left.store(header().free_list, std::memory_order_relaxed);
+    header().free_list = offset;
+}
+
+template<typename T>
+void shared_avl_tree<T>::close_segment() noexcept
+{
+    if (base) {
+        munmap(base, mapping_size);
+        base = nullptr;
+    }
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+template<typename T>
+shared_avl_tree<T>::shared_avl_tree(char const* name, shm_role role) : role(role)
+{
+    fd = role == shm_role::writer ? shm_open(name, O_RDWR | O_CREAT, 0600) : shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        throw std::system_error(errno, std::generic_category(), "shared_avl_tree: shm_open");
+    }
+    try {
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            throw std::system_error(errno, std::generic_category(), "shared_avl_tree: stat");
+        }
+        if (info.st_size == 0 && role == shm_role::writer) {
+            if (ftruncate(fd, static_cast<off_t>(initial_segment_size)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "shared_avl_tree: ftruncate");
+            }
+            map(initial_segment_size);
+            segment_header& h = *new (base) segment_header();
+            std::copy(std::begin(expected_magic), std::end(expected_magic), h.magic);
+            h.version = current_version;
+            h.value_size = sizeof(T);
+            h.node_size = sizeof(shared_node);
+            h.used = nodes_offset();
+            h.segment_size.store(initial_segment_size, std::memory_order_release);
+            return;
+        }
+        if (static_cast<uint64_t>(info.st_size) < sizeof(segment_header)) {
+            throw avl_tree_snapshot_error("shared_avl_tree: segment too short");
+        }
+        map(static_cast<size_t>(info.st_size));
+        segment_header const& h = header();
+        if (!std::equal(std::begin(h.magic), std::end(h.magic), expected_magic)) {
+            throw avl_tree_snapshot_error("shared_avl_tree: not a shared tree");
+        }
+        if (h.version != current_version) {
+            throw avl_tree_snapshot_error("shared_avl_tree: unsupported version");
+        }
+        if (h.value_size != sizeof(T) || h.node_size != sizeof(shared_node)) {
+            throw avl_tree_snapshot_error("shared_avl_tree: written for another value type");
+        }
+    }
+    catch (...) {
+        close_segment();
+        throw;
+    }
+}
+
+template<typename T>
+shared_avl_tree<T>::~shared_avl_tree()
+{
+    close_segment();
+}
+
+template<typename T>
+void shared_avl_tree<T>::unlink(char const* name) noexcept
+{
+    shm_unlink(name);
+}
+
+// Lookups and allocation happen before the counter goes odd, so readers
+// only retry for writes that really change the tree.
+template<typename T>
+bool shared_avl_tree<T>::insert(T const& value)
+{
+    if (find_locked(value)) {
+        return false;
+    }
+    uint64_t fresh = allocate(value);
+    try {
+        write_section section(header().sequence);
+        header().root.store(insert(header().root.load(std::memory_order_relaxed), fresh), std::memory_order_release);
+        header().size.fetch_add(1, std::memory_order_relaxed);
+    }
+    catch (...) {
+        deallocate(fresh);
+        throw;
+    }
+    return true;
+}
+
+template<typename T>
+bool shared_avl_tree<T>::erase(T const& value)
+{
+    if (!find_locked(value)) {
+        return false;
+    }
+    uint64_t removed = 0;
+    {
+        write_section section(header().sequence);
+        header().root.store(remove(header().root.load(std::memory_order_relaxed), value, removed),
+                            std::memory_order_release);
+        header().size.fetch_sub(1, std::memory_order_relaxed);
+    }
+    deallocate(removed);
+    return true;
+}
+
+template<typename T>
+template<typename F>
+auto shared_avl_tree<T>::read(F descend)
+{
+    while (true) {
+        uint64_t before = header().sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+        size_t segment_size = header().segment_size.load(std::memory_order_acquire);
+        if (segment_size > mapping_size) {
+            map(segment_size);
+        }
+        auto result = descend(header().root.load(std::memory_order_acquire));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (result && header().sequence.load(std::memory_order_relaxed) == before) {
+            return *std::move(result);
+        }
+    }
+}
+
+template<typename T>
+bool shared_avl_tree<T>::contains(T const& value)
+{
+    return read([this, &value](uint64_t offset) -> std::optional<bool>
+    {
+        for (size_t depth = 0; depth != max_depth; ++depth) {
+            if (offset == 0) {
+                return false;
+            }
+            shared_node* n = node(offset);
+            if (n == nullptr) {
+                return std::nullopt;
+            }
+            if (value < n->value) {
+                offset = n->left.load(std::memory_order_acquire);
+            }
+            else if (n->value < value) {
+                offset = n->right.load(std::memory_order_acquire);
+            }
+            else {
+                return true;
+            }
+        }
+        return std::nullopt;
+    });
+}
+
+template<typename T>
+template<bool inclusive>
+std::optional<T> shared_avl_tree<T>::bound(T const& value)
+{
+    return read([this, &value](uint64_t offset) -> std::optional<std::optional<T>>
+    {
+        shared_node* best = nullptr;
+        for (size_t depth = 0; depth != max_depth; ++depth) {
+            if (offset == 0) {
+                return best ? std::optional<T>(best->value) : std::nullopt;
+            }
+            shared_node* n = node(offset);
+            if (n == nullptr) {
+                return std::nullopt;
+            }
+            if (inclusive ? !(n->value < value) : value < n->value) {
+                best = n;
+                offset = n->left.load(std::memory_order_acquire);
+            }
+            else {
+                offset = n->right.load(std::memory_order_acquire);
+            }
+        }
+        return std::nullopt;
+    });
+}
+
+template<typename T>
+std::optional<T> shared_avl_tree<T>::lower_bound(T const& value)
+{
+    return bound<true>(value);
+}
+
+template<typename T>
+std::optional<T> shared_avl_tree<T>::upper_bound(T const& value)
+{
+    return bound<false>(value);
+}
+
+template<typename T>
+size_t shared_avl_tree<T>::size() const noexcept
+{
+    return static_cast<size_t>(header().size.load(std::memory_order_relaxed));
+}
+
+template<typename T>
+bool shared_avl_tree<T>::empty() const noexcept
+{
+    return size() == 0;
+}
@@ -0,0 +1,132 @@
+#include <gtest/gtest.h>
+
+#include <random>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "shared_avl_tree.h"
+
+namespace
+{
+// A segment name of this process, unlinked again at the end.
+struct scratch_segment
+{
+    std::string name;
+
+    explicit scratch_segment(char const* suffix)
+        : name("/avl_tree_test_" + std::to_string(getpid()) + "_" + suffix)
+    {
+        shared_avl_tree<int>::unlink(name.c_str());
+    }
+
+    ~scratch_segment()
+    {
+        shared_avl_tree<int>::unlink(name.c_str());
+    }
+};
+
+// Runs f in a child process and returns its exit status; the child must
+// not use gtest assertions, it reports through the status.
+template<typename F>
+int in_child(F f)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        _exit(f() ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+}
+
+TEST(shared, reader_sees_writer)
+{
+    scratch_segment segment("basic");
+    shared_avl_tree<int> writer(segment.name.c_str(), shm_role::writer);
+    std::set<int> expected;
+    std::mt19937 rng(41);
+    for (int i = 0; i != 5000; ++i) {
+        int value = static_cast<int>(rng() % 3000);
+        if (rng() % 3 == 0) {
+            EXPECT_EQ(expected.erase(value) != 0, writer.erase(value));
+        }
+        else {
+            EXPECT_EQ(expected.insert(value).second, writer.insert(value));
+        }
+    }
+
+    shared_avl_tree<int> reader(segment.name.c_str(), shm_role::reader);
+    EXPECT_EQ(expected.size(), reader.size());
+    for (int i = -1; i < 3001; ++i) {
+        EXPECT_EQ(expected.count(i) != 0, reader.contains(i));
+        auto lower = expected.lower_bound(i);
+        EXPECT_EQ(lower == expected.end() ? std::nullopt : std::optional<int>(*lower), reader.lower_bound(i));
+        auto upper = expected.upper_bound(i);
+        EXPECT_EQ(upper == expected.end() ? std::nullopt : std::optional<int>(*upper), reader.upper_bound(i));
+    }
+}
+
+TEST(shared, reopened_writer_keeps_contents)
+{
+    scratch_segment segment("reopen");
+    {
+        shared_avl_tree<int> writer(segment.name.c_str(), shm_role::writer);
+        for (int i = 0; i != 100; ++i) {
+            writer.insert(i * 2);
+        }
+    }
+    shared_avl_tree<int> writer(segment.name.c_str(), shm_role::writer);
+    EXPECT_EQ(100u, writer.size());
+    EXPECT_FALSE(writer.insert(10));
+    EXPECT_TRUE(writer.insert(11));
+    EXPECT_THROW(shared_avl_tree<double>(segment.name.c_str(), shm_role::reader), avl_tree_snapshot_error);
+    EXPECT_THROW(shared_avl_tree<int>("/avl_tree_test_missing", shm_role::reader), std::system_error);
+}
+
+// Readers in other processes run while the writer inserts ascending values
+// and grows the segment several times; anything below the size they saw
+// must already be there.
+TEST(shared, concurrent_reader_processes)
+{
+    scratch_segment segment("processes");
+    shared_avl_tree<int> writer(segment.name.c_str(), shm_role::writer);
+    writer.insert(0);
+    int const total = 100000;
+
+    std::vector<pid_t> readers;
+    for (int r = 0; r != 3; ++r) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            bool ok = true;
+            shared_avl_tree<int> reader(segment.name.c_str(), shm_role::reader);
+            std::mt19937 rng(r);
+            for (size_t seen = reader.size(); seen < static_cast<size_t>(total); seen = reader.size()) {
+                int value = static_cast<int>(rng() % seen);
+                ok = ok && reader.contains(value) && reader.lower_bound(value) == value;
+                ok = ok && !reader.contains(total + value);
+            }
+            _exit(ok ? 0 : 1);
+        }
+        readers.push_back(pid);
+    }
+    for (int i = 1; i != total; ++i) {
+        writer.insert(i);
+    }
+    for (pid_t pid : readers) {
+        int status = 0;
+        waitpid(pid, &status, 0);
+        EXPECT_TRUE(WIFEXITED(status));
+        EXPECT_EQ(0, WEXITSTATUS(status));
+    }
+    EXPECT_EQ(0, in_child([&segment]
+    {
+        shared_avl_tree<int> reader(segment.name.c_str(), shm_role::reader);
+        return reader.size() == static_cast<size_t>(total) && reader.upper_bound(total - 2) == total - 1;
+    }));
+}
@@ -1,5 +1,829 @@
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "avl_tree.h"
 #include "counted.h"
 using container = avl_tree<counted>;
 
-#include "tests.inl"
\ No newline at end of file
+#include "tests.inl"
+TEST(split_join, split_and_join_back)
+{
+    counted::no_new_instances_guard g;
+
+    for (int at = -1; at != 42; ++at) {
+        container c;
+        for (int i = 0; i != 40; ++i) {
+            c.insert((i * 17) % 40);
+        }
+        container greater = c.split(at);
+        int expected = 0;
+        for (int value : c) {
+            EXPECT_EQ(expected++, value);
+        }
+        EXPECT_EQ(std::max(0, std::min(at, 40)), expected);
+        for (int value : greater) {
+            EXPECT_EQ(expected++, value);
+        }
+        EXPECT_EQ(40, expected);
+
+        c.join(greater);
+        EXPECT_TRUE(greater.empty());
+        expected = 0;
+        for (int value : c) {
+            EXPECT_EQ(expected++, value);
+        }
+        EXPECT_EQ(40, expected);
+        EXPECT_EQ(39, *--c.end());
+    }
+}
+
+TEST(split_join, join_uneven_heights)
+{
+    counted::no_new_instances_guard g;
+
+    container small;
+    container large;
+    small.insert(-1);
+    for (int i = 0; i != 1000; ++i) {
+        large.insert(i);
+    }
+    small.join(large);
+    EXPECT_EQ(-1, *small.begin());
+    large.join(small);
+    EXPECT_EQ(-1, *large.begin());
+    EXPECT_TRUE(small.empty());
+
+    container high = large.split(500);
+    high.insert(2000);
+    large.join(high);
+    int expected = -1;
+    for (int value : large) {
+        EXPECT_EQ(expected, value);
+        expected = expected == 999 ? 2000 : expected + 1;
+    }
+    EXPECT_EQ(2001, expected);
+    for (int i = 0; i != 1000; i += 2) {
+        large.erase(large.find(i));
+    }
+    EXPECT_EQ(1, *large.find(1));
+}
+
+TEST(fault_injection, split)
+{
+    faulty_run([]
+    {
+        container c;
+        mass_insert(c, {5, 2, 8, 1, 3, 7, 9, 4, 6});
+        try {
+            container greater = c.split(5);
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            expect_eq(c, {1, 2, 3, 4, 5, 6, 7, 8, 9});
+            throw;
+        }
+    });
+}
+
+TEST(batch, insert_batch_reports_per_key)
+{
+    counted::no_new_instances_guard g;
+
+    container c;
+    mass_insert(c, {3, 7});
+    std::vector<counted> keys{5, 3, 9, 5, 1, 7, 8};
+    std::vector<bool> inserted = c.insert_batch(keys.data(), keys.data() + keys.size());
+    EXPECT_EQ((std::vector<bool>{true, false, true, false, true, false, true}), inserted);
+    expect_eq(c, {1, 3, 5, 7, 8, 9});
+    EXPECT_EQ(1, *c.begin());
+}
+
+TEST(batch, erase_batch_reports_per_key)
+{
+    counted::no_new_instances_guard g;
+
+    container c;
+    mass_insert(c, {1, 2, 3, 4, 5, 6, 7, 8, 9});
+    std::vector<counted> keys{4, 10, 1, 4, 9, 0};
+    std::vector<bool> erased = c.erase_batch(keys.data(), keys.data() + keys.size());
+    EXPECT_EQ((std::vector<bool>{true, false, true, false, true, false}), erased);
+    expect_eq(c, {2, 3, 5, 6, 7, 8});
+    EXPECT_EQ(2, *c.begin());
+    c.erase_batch(keys.data(), keys.data());
+    expect_eq(c, {2, 3, 5, 6, 7, 8});
+}
+
+TEST(batch, large_batches_match_std_set)
+{
+    avl_tree<int> c;
+    std::set<int> expected;
+    std::mt19937 rng(11);
+    for (int round = 0; round != 6; ++round) {
+        std::vector<int> keys(50000);
+        for (int& key : keys) {
+            key = static_cast<int>(rng() % 200000);
+        }
+        bool inserting = round % 3 != 2;
+        std::vector<bool> result = inserting
+                                   ? c.insert_batch(avl_execution::par, keys.data(), keys.data() + keys.size())
+                                   : c.erase_batch(avl_execution::par, keys.data(), keys.data() + keys.size());
+        for (size_t i = 0; i != keys.size(); ++i) {
+            bool changed = inserting ? expected.insert(keys[i]).second : expected.erase(keys[i]) == 1;
+            EXPECT_EQ(changed, result[i]);
+        }
+        EXPECT_TRUE(std::equal(c.begin(), c.end(), expected.begin(), expected.end()));
+    }
+    for (int key : expected) {
+        c.erase(c.find(key));
+    }
+    EXPECT_TRUE(c.empty());
+}
+
+TEST(fault_injection, insert_batch)
+{
+    faulty_run([]
+    {
+        container c;
+        mass_insert(c, {2, 4, 6, 8});
+        std::vector<counted> keys{5, 1, 4, 9};
+        try {
+            c.insert_batch(keys.data(), keys.data() + keys.size());
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            expect_eq(c, {2, 4, 6, 8});
+            throw;
+        }
+        fault_injection_disable dg;
+        expect_eq(c, {1, 2, 4, 5, 6, 8, 9});
+    });
+}
+
+TEST(fault_injection, erase_batch)
+{
+    faulty_run([]
+    {
+        container c;
+        mass_insert(c, {2, 4, 6, 8});
+        std::vector<counted> keys{4, 1, 8};
+        try {
+            c.erase_batch(keys.data(), keys.data() + keys.size());
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            expect_eq(c, {2, 4, 6, 8});
+            throw;
+        }
+        fault_injection_disable dg;
+        expect_eq(c, {2, 6});
+    });
+}
+
+TEST(bulk, large_copy)
+{
+    avl_tree<int> c;
+    std::mt19937 rng(17);
+    for (int i = 0; i != 100000; ++i) {
+        c.insert(static_cast<int>(rng() % 1000000));
+    }
+    avl_tree<int> copy(c, avl_execution::par);
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), copy.begin(), copy.end()));
+    EXPECT_TRUE(std::equal(c.rbegin(), c.rend(), copy.rbegin(), copy.rend()));
+    copy.erase(copy.begin());
+    EXPECT_NE(*c.begin(), *copy.begin());
+}
+
+TEST(bulk, overloads_without_policy_stay_on_calling_thread)
+{
+    std::vector<int> sorted(100000);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    uint64_t executed = thread_pool::global().stats().executed;
+    avl_tree<int> c;
+    c.assign_sorted(sorted.begin(), sorted.end());
+    avl_tree<int> copy(c);
+    copy.insert_batch(sorted.data(), sorted.data() + sorted.size());
+    copy.erase_batch(sorted.data(), sorted.data() + sorted.size() / 2);
+    std::stringstream packed;
+    c.save_packed(packed);
+    avl_tree<int> loaded;
+    loaded.load(packed);
+    EXPECT_EQ(executed, thread_pool::global().stats().executed);
+    EXPECT_TRUE(std::equal(loaded.begin(), loaded.end(), sorted.begin(), sorted.end()));
+    EXPECT_EQ(sorted.size() / 2, static_cast<size_t>(std::distance(copy.begin(), copy.end())));
+}
+
+TEST(bulk, assign_sorted)
+{
+    counted::no_new_instances_guard g;
+
+    container c;
+    mass_insert(c, {100, 200});
+    std::vector<counted> sorted{1, 2, 3, 5, 8, 13, 21};
+    c.assign_sorted(sorted.begin(), sorted.end());
+    expect_eq(c, {1, 2, 3, 5, 8, 13, 21});
+    expect_reverse_eq(c, {21, 13, 8, 5, 3, 2, 1});
+    c.insert(4);
+    c.erase(c.find(13));
+    expect_eq(c, {1, 2, 3, 4, 5, 8, 21});
+
+    std::set<int> source{7, 8, 9};
+    c.assign_sorted(source.begin(), source.end());
+    expect_eq(c, {7, 8, 9});
+    c.assign_sorted(source.end(), source.end());
+    EXPECT_TRUE(c.empty());
+}
+
+TEST(bulk, large_assign_sorted)
+{
+    std::vector<int> sorted(1000000);
+    std::iota(sorted.begin(), sorted.end(), 0);
+    avl_tree<int> c;
+    c.assign_sorted(avl_execution::par, sorted.begin(), sorted.end());
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), sorted.begin(), sorted.end()));
+    for (int i = 0; i < 1000000; i += 3) {
+        c.erase(c.find(i));
+    }
+    EXPECT_EQ(1, *c.begin());
+    EXPECT_EQ(999998, *--c.end());
+}
+
+TEST(fault_injection, assign_sorted)
+{
+    faulty_run([]
+    {
+        container c;
+        mass_insert(c, {2, 4});
+        std::vector<counted> sorted{1, 3, 5, 7};
+        try {
+            c.assign_sorted(sorted.begin(), sorted.end());
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            expect_eq(c, {2, 4});
+            throw;
+        }
+        fault_injection_disable dg;
+        expect_eq(c, {1, 3, 5, 7});
+    });
+}
+
+TEST(scan, reduce_matches_serial)
+{
+    avl_tree<int> c;
+    std::vector<int> sorted(200000);
+    for (size_t i = 0; i != sorted.size(); ++i) {
+        sorted[i] = static_cast<int>(i * 3);
+    }
+    c.assign_sorted(sorted.begin(), sorted.end());
+
+    auto plus = [](long long a, long long b) { return a + b; };
+    long long expected = std::accumulate(sorted.begin(), sorted.end(), 0ll);
+    EXPECT_EQ(expected, c.reduce(avl_execution::par, c.begin(), c.end(), 0ll, plus));
+    EXPECT_EQ(expected, c.reduce(avl_execution::seq, c.begin(), c.end(), 0ll, plus));
+
+    auto first = c.lower_bound(1000);
+    auto last = c.upper_bound(450000);
+    long long partial = std::accumulate(first, last, 0ll);
+    EXPECT_EQ(partial, c.reduce(avl_execution::par, first, last, 0ll, plus));
+    EXPECT_EQ(partial, c.reduce(avl_execution::par, c.find(1005), last, 1002ll, plus));
+    EXPECT_EQ(7, c.reduce(avl_execution::par, first, first, 7, plus));
+}
+
+// Concatenation is associative but not commutative, so this only passes if
+// partial results are combined in order.
+TEST(scan, ordered_transform_reduce)
+{
+    avl_tree<int> c;
+    for (int i = 0; i != 30000; ++i) {
+        c.insert(i);
+    }
+    auto digit = [](int value) { return std::string(1, static_cast<char>('0' + value % 10)); };
+    auto concat = [](std::string a, std::string const& b) { return a += b; };
+    std::string expected = c.transform_reduce(avl_execution::seq, c.begin(), c.end(), std::string(), concat, digit);
+    EXPECT_EQ(30000u, expected.size());
+    EXPECT_EQ(expected, c.transform_reduce(avl_execution::par, c.begin(), c.end(), std::string(), concat, digit));
+    EXPECT_EQ(expected.substr(15, 20000),
+              c.transform_reduce(avl_execution::par, c.find(15), c.find(20015), std::string(), concat, digit));
+}
+
+TEST(scan, parallel_for_each_visits_range_once)
+{
+    avl_tree<int> c;
+    for (int i = 0; i != 100000; ++i) {
+        c.insert(i * 2);
+    }
+    std::vector<std::atomic<int>> visits(200000);
+    c.for_each(avl_execution::par, c.lower_bound(501), c.lower_bound(150000), [&visits](int value)
+    {
+        ++visits[value];
+    });
+    for (int i = 0; i != 200000; ++i) {
+        EXPECT_EQ(i % 2 == 0 && i > 501 && i < 150000 ? 1 : 0, visits[i].load());
+    }
+
+    std::vector<int> order;
+    c.for_each(avl_execution::seq, c.find(10), c.find(20), [&order](int value)
+    {
+        order.push_back(value);
+    });
+    EXPECT_EQ((std::vector<int>{10, 12, 14, 16, 18}), order);
+}
+
+template<>
+struct avl_tree_serializer<counted>
+{
+    static void write(std::ostream& out, counted const& value)
+    {
+        avl_tree_serializer<int>::write(out, value);
+    }
+
+    static counted read(std::istream& in)
+    {
+        return avl_tree_serializer<int>::read(in);
+    }
+};
+
+template<>
+struct avl_tree_serializer<std::string>
+{
+    static void write(std::ostream& out, std::string const& value)
+    {
+        avl_tree_serializer<uint32_t>::write(out, static_cast<uint32_t>(value.size()));
+        out.write(value.data(), value.size());
+    }
+
+    static std::string read(std::istream& in)
+    {
+        std::string value(avl_tree_serializer<uint32_t>::read(in), '\0');
+        in.read(&value[0], value.size());
+        return value;
+    }
+};
+
+TEST(snapshot, round_trip)
+{
+    avl_tree<int> c;
+    std::mt19937 rng(38);
+    for (int i = 0; i != 50000; ++i) {
+        c.insert(static_cast<int>(rng() % 1000000));
+    }
+    std::stringstream stream;
+    c.save(stream);
+    avl_tree<int> loaded;
+    loaded.insert(-1);
+    loaded.load(stream);
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), loaded.begin(), loaded.end()));
+    loaded.insert(1000001);
+    EXPECT_EQ(1000001, *--loaded.end());
+
+    std::stringstream empty_stream;
+    avl_tree<int>().save(empty_stream);
+    loaded.load(empty_stream);
+    EXPECT_TRUE(loaded.empty());
+}
+
+TEST(snapshot, custom_serializer)
+{
+    avl_tree<std::string> c;
+    for (char const* value : {"pear", "", "apple", "fig", "banana"}) {
+        c.insert(value);
+    }
+    std::stringstream stream;
+    c.save(stream);
+    avl_tree<std::string> loaded;
+    loaded.load(stream);
+    EXPECT_EQ((std::vector<std::string>{"", "apple", "banana", "fig", "pear"}),
+              std::vector<std::string>(loaded.begin(), loaded.end()));
+}
+
+TEST(snapshot, rejects_damaged_input)
+{
+    avl_tree<int> c;
+    for (int i = 0; i != 100; ++i) {
+        c.insert(i);
+    }
+    std::stringstream stream;
+    c.save(stream);
+    std::string const bytes = stream.str();
+
+    avl_tree<int> loaded;
+    loaded.insert(7);
+    auto expect_rejected = [&loaded](std::string const& input)
+    {
+        std::stringstream damaged(input);
+        EXPECT_THROW(loaded.load(damaged), avl_tree_snapshot_error);
+        EXPECT_EQ((std::vector<int>{7}), std::vector<int>(loaded.begin(), loaded.end()));
+    };
+    expect_rejected("");
+    expect_rejected("XVLT" + bytes.substr(4));
+    std::string version = bytes;
+    version[4] = 2;
+    expect_rejected(version);
+    expect_rejected(bytes.substr(0, bytes.size() - 1));
+}
+
+TEST(fault_injection, load)
+{
+    std::stringstream stream;
+    {
+        container c;
+        mass_insert(c, {1, 3, 5, 7});
+        c.save(stream);
+    }
+    std::string const bytes = stream.str();
+    faulty_run([&bytes]
+    {
+        container c;
+        mass_insert(c, {2, 4});
+        std::stringstream in(bytes);
+        try {
+            c.load(in);
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            expect_eq(c, {2, 4});
+            throw;
+        }
+        fault_injection_disable dg;
+        expect_eq(c, {1, 3, 5, 7});
+    });
+}
+
+TEST(hinted_insert, good_and_bad_hints)
+{
+    std::set<int> expected;
+    avl_tree<int> c;
+    EXPECT_EQ(10, *c.insert(c.end(), 10));
+    expected.insert(10);
+    std::mt19937 rng(46);
+    for (int i = 0; i != 20000; ++i) {
+        int value = static_cast<int>(rng() % 30000);
+        auto hint = c.lower_bound(value);
+        if (i % 4 == 0) {
+            // any hint is allowed, a wrong one only costs a search
+            hint = c.lower_bound(static_cast<int>(rng() % 30000));
+        }
+        auto it = c.insert(hint, value);
+        EXPECT_EQ(value, *it);
+        expected.insert(value);
+    }
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), c.begin(), c.end()));
+    EXPECT_EQ(*expected.begin(), *c.begin());
+
+    avl_tree<int> ascending;
+    for (int i = 0; i != 1000; ++i) {
+        ascending.insert(ascending.end(), i);
+    }
+    for (int i = 0; i != 1000; ++i) {
+        ascending.insert(ascending.begin(), -1 - i);
+    }
+    EXPECT_EQ(-1000, *ascending.begin());
+    EXPECT_EQ(999, *--ascending.end());
+    EXPECT_EQ(2000, std::distance(ascending.begin(), ascending.end()));
+}
+
+TEST(fault_injection, hinted_insert)
+{
+    faulty_run([]
+    {
+        container c;
+        mass_insert(c, {1, 3, 5});
+        try {
+            c.insert(c.find(3), 2);
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            expect_eq(c, {1, 3, 5});
+            throw;
+        }
+        fault_injection_disable dg;
+        expect_eq(c, {1, 2, 3, 5});
+    });
+}
+
+namespace
+{
+// The most comparisons a search can take: an AVL tree of n values is at
+// most 1.44 log2 n high, and a search compares once per level and once more
+// to tell a match.
+size_t search_budget(size_t n)
+{
+    return static_cast<size_t>(std::ceil(1.44 * std::log2(static_cast<double>(n)))) + 2;
+}
+
+// Keys of the AVL tree of height h with the fewest nodes, a Fibonacci
+// tree, in level order. Inserting them in that order builds exactly that
+// tree without rotations. The in-order keys are 0, 2, 4, ...
+std::vector<int> fibonacci_tree_keys(int h)
+{
+    struct subtree {
+        int height;
+        int first;
+    };
+    // a Fibonacci tree of height h holds size(h) = size(h - 1) + size(h - 2) + 1 nodes
+    auto size = [](int height)
+    {
+        int a = 0;
+        int b = 1;
+        for (int i = 0; i != height; ++i) {
+            b = std::exchange(a, b) + b + 1;
+        }
+        return a;
+    };
+    std::vector<int> keys;
+    std::vector<subtree> level{{h, 0}};
+    while (!level.empty()) {
+        std::vector<subtree> next;
+        for (subtree const& t : level) {
+            if (t.height == 0) {
+                continue;
+            }
+            int left = size(t.height - 1);
+            keys.push_back(2 * (t.first + left));
+            next.push_back({t.height - 1, t.first});
+            next.push_back({std::max(t.height - 2, 0), t.first + left + 1});
+        }
+        level = std::move(next);
+    }
+    return keys;
+}
+}
+
+TEST(budget, search_comparisons)
+{
+    for (int h = 1; h != 21; ++h) {
+        std::vector<int> const keys = fibonacci_tree_keys(h);
+        int const n = static_cast<int>(keys.size());
+        container c;
+        for (int key : keys) {
+            c.insert(key);
+        }
+        size_t const budget = search_budget(static_cast<size_t>(n));
+        size_t worst_find = 0;
+        size_t worst_bound = 0;
+        for (int key = -1; key <= 2 * n; ++key) {
+            counted const probe(key);
+            operation_counter find_count;
+            c.find(probe);
+            worst_find = std::max(worst_find, find_count.comparisons);
+            operation_counter bound_count;
+            c.lower_bound(probe);
+            c.upper_bound(probe);
+            worst_bound = std::max(worst_bound, bound_count.comparisons / 2);
+        }
+        // the tree is as high as AVL allows for n: the deepest search
+        // compares once on each of the h levels and once to tell a match
+        EXPECT_EQ(static_cast<size_t>(h) + 1, worst_find) << "h = " << h;
+        EXPECT_LE(worst_find, budget) << "find, n = " << n;
+        EXPECT_LE(worst_bound, budget) << "lower_bound/upper_bound, n = " << n;
+
+        // iterators climb by pointer and never compare
+        operation_counter scan_count;
+        EXPECT_EQ(n, std::distance(c.begin(), c.end()));
+        EXPECT_EQ(n, std::distance(c.rbegin(), c.rend()));
+        EXPECT_EQ(0u, scan_count.comparisons);
+    }
+}
+
+TEST(budget, allocations)
+{
+    avl_tree<int> c;
+    for (int i = 0; i != 1000; ++i) {
+        c.insert(i * 7 % 1000);
+    }
+    {
+        operation_counter count;
+        c.insert(5000);
+        // the node and its shared_ptr control block
+        EXPECT_LE(count.allocations, 2u);
+    }
+    {
+        operation_counter count;
+        c.insert(5000);
+        c.find(500);
+        c.lower_bound(500);
+        c.upper_bound(500);
+        c.erase(c.find(500));
+        for (int value : c) {
+            static_cast<void>(value);
+        }
+        EXPECT_EQ(0u, count.allocations);
+    }
+    {
+        operation_counter count;
+        avl_tree<int> copy(c, avl_execution::seq);
+        EXPECT_LE(count.allocations, 2 * 1000u);
+    }
+}
+
+TEST(merge, overlapping_sources)
+{
+    std::mt19937 rng(44);
+    std::vector<std::vector<int>> parts(5);
+    std::set<int> expected;
+    for (int i = 0; i != 40000; ++i) {
+        int value = static_cast<int>(rng() % 60000);
+        parts[rng() % parts.size()].push_back(value);
+        expected.insert(value);
+    }
+    parts.emplace_back();
+    std::vector<std::pair<std::vector<int>::const_iterator, std::vector<int>::const_iterator>> sources;
+    for (auto& part : parts) {
+        std::sort(part.begin(), part.end());
+        sources.emplace_back(part.cbegin(), part.cend());
+    }
+    // the same range twice only adds duplicates
+    sources.push_back(sources.front());
+
+    avl_tree<int> c;
+    c.insert(-5);
+    c.assign_merged(sources);
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), c.begin(), c.end()));
+    for (int value : {-1, 0, 30000, 59999, 60000}) {
+        EXPECT_EQ(expected.count(value) != 0, c.find(value) != c.end());
+    }
+    c.insert(-1);
+    c.erase(c.find(*expected.rbegin()));
+    EXPECT_EQ(-1, *c.begin());
+
+    c.assign_merged(decltype(sources){});
+    EXPECT_TRUE(c.empty());
+}
+
+TEST(merge, snapshot_readers)
+{
+    std::vector<std::stringstream> files(3);
+    for (size_t part = 0; part != files.size(); ++part) {
+        avl_tree<std::string> c;
+        for (int i = 0; i != 1000; ++i) {
+            c.insert(std::to_string(i * static_cast<int>(part + 1)));
+        }
+        c.save(files[part]);
+    }
+    std::vector<std::unique_ptr<avl_tree_snapshot_reader<std::string>>> readers;
+    std::vector<std::pair<avl_tree_snapshot_reader<std::string>::iterator,
+                          avl_tree_snapshot_reader<std::string>::iterator>> sources;
+    for (auto& file : files) {
+        readers.push_back(std::make_unique<avl_tree_snapshot_reader<std::string>>(file));
+        sources.emplace_back(readers.back()->begin(), readers.back()->end());
+    }
+    avl_tree<std::string> merged;
+    merged.assign_merged(sources);
+
+    std::set<std::string> expected;
+    for (int part = 1; part <= 3; ++part) {
+        for (int i = 0; i != 1000; ++i) {
+            expected.insert(std::to_string(i * part));
+        }
+    }
+    EXPECT_TRUE(std::equal(expected.begin(), expected.end(), merged.begin(), merged.end()));
+
+    std::stringstream packed;
+    avl_tree<int>().save_packed(packed);
+    EXPECT_THROW(avl_tree_snapshot_reader<int>{packed}, avl_tree_snapshot_error);
+}
+
+TEST(fault_injection, assign_merged)
+{
+    std::vector<counted> odd{1, 3, 5, 7};
+    std::vector<counted> low{1, 2, 3};
+    faulty_run([&odd, &low]
+    {
+        container c;
+        mass_insert(c, {2, 4});
+        try {
+            c.assign_merged(std::vector<std::pair<std::vector<counted>::const_iterator,
+                                                  std::vector<counted>::const_iterator>>{
+                {odd.cbegin(), odd.cend()}, {low.cbegin(), low.cend()}});
+        }
+        catch (...) {
+            fault_injection_disable dg;
+            expect_eq(c, {2, 4});
+            throw;
+        }
+        fault_injection_disable dg;
+        expect_eq(c, {1, 2, 3, 5, 7});
+    });
+}
+
+TEST(snapshot, packed_round_trip)
+{
+    avl_tree<int> c;
+    std::mt19937 rng(43);
+    for (int i = 0; i != 100000; ++i) {
+        c.insert(static_cast<int>(rng() % 1000000) - 500000);
+    }
+    c.insert(std::numeric_limits<int>::min());
+    c.insert(std::numeric_limits<int>::max());
+    std::stringstream packed;
+    c.save_packed(packed);
+    std::stringstream plain;
+    c.save(plain);
+    EXPECT_LT(packed.str().size() * 4, plain.str().size());
+
+    avl_tree<int> loaded;
+    loaded.insert(3);
+    loaded.load(packed);
+    EXPECT_TRUE(std::equal(c.begin(), c.end(), loaded.begin(), loaded.end()));
+
+    avl_tree<uint64_t> wide;
+    for (uint64_t value : {uint64_t(0), uint64_t(1), uint64_t(1) << 40, ~uint64_t(0)}) {
+        wide.insert(value);
+    }
+    std::stringstream wide_stream;
+    wide.save_packed(wide_stream);
+    avl_tree<uint64_t> wide_loaded;
+    wide_loaded.load(wide_stream);
+    EXPECT_EQ((std::vector<uint64_t>{0, 1, uint64_t(1) << 40, ~uint64_t(0)}),
+              std::vector<uint64_t>(wide_loaded.begin(), wide_loaded.end()));
+}
+
+TEST(snapshot, packed_dense_keys)
+{
+    avl_tree<long long> c;
+    std::vector<long long> sorted(300000);
+    std::iota(sorted.begin(), sorted.end(), 1000000000000ll);
+    c.assign_sorted(sorted.begin(), sorted.end());
+    std::stringstream packed;
+    c.save_packed(packed);
+    // consecutive keys leave nothing to store but each block's first key
+    EXPECT_LT(packed.str().size(), sorted.size() * sizeof(long long) / 100);
+
+    avl_tree<long long> loaded;
+    loaded.load(avl_execution::par, packed);
+    EXPECT_TRUE(std::equal(loaded.begin(), loaded.end(), sorted.begin(), sorted.end()));
+
+    std::stringstream empty;
+    avl_tree<long long>().save_packed(empty);
+    loaded.load(empty);
+    EXPECT_TRUE(loaded.empty());
+}
+
+TEST(snapshot, packed_blocks_without_gaps)
+{
+    // blocks of consecutive keys and a last block of one key pack no gap
+    // bytes, which the Debug build's checked vector catches if touched
+    for (size_t size : {size_t(1), avl_tree_packed::block_size + 1, 3 * avl_tree_packed::block_size}) {
+        std::vector<int> sorted(size);
+        std::iota(sorted.begin(), sorted.end(), -5);
+        avl_tree<int> c;
+        c.assign_sorted(sorted.begin(), sorted.end());
+        std::stringstream packed;
+        c.save_packed(packed);
+        avl_tree<int> loaded;
+        loaded.load(packed);
+        EXPECT_TRUE(std::equal(loaded.begin(), loaded.end(), sorted.begin(), sorted.end()));
+    }
+}
+
+TEST(snapshot, packed_rejects_damaged_input)
+{
+    avl_tree<int> c;
+    for (int i = 0; i != 1000; ++i) {
+        c.insert(i * 3);
+    }
+    std::stringstream stream;
+    c.save_packed(stream);
+    std::string const bytes = stream.str();
+
+    avl_tree<int> loaded;
+    loaded.insert(7);
+    auto expect_rejected = [&loaded](std::string const& input)
+    {
+        std::stringstream damaged(input);
+        EXPECT_THROW(loaded.load(damaged), avl_tree_snapshot_error);
+        EXPECT_EQ((std::vector<int>{7}), std::vector<int>(loaded.begin(), loaded.end()));
+    };
+    expect_rejected(bytes.substr(0, bytes.size() - 1));
+    // the second block's first key below the end of the first block
+    std::string unordered = bytes;
+    size_t second_block = 24 + 9 + (127 * 2 + 7) / 8;
+    std::fill(unordered.begin() + second_block, unordered.begin() + second_block + 8, '\0');
+    expect_rejected(unordered);
+
+    // ordered as 64-bit keys but not as ints, which they do not fit
+    avl_tree<long long> wide;
+    wide.insert(0);
+    wide.insert(1ll << 40);
+    std::stringstream wide_stream;
+    wide.save_packed(wide_stream);
+    expect_rejected(wide_stream.str());
+
+    std::stringstream strings;
+    avl_tree<std::string>().save(strings);
+    std::string packed_strings = strings.str();
+    packed_strings[3] = 'P';
+    std::stringstream packed_strings_stream(packed_strings);
+    avl_tree<std::string> string_tree;
+    EXPECT_THROW(string_tree.load(packed_strings_stream), avl_tree_snapshot_error);
+}